@@ -0,0 +1,239 @@
+//
+// Copyright 0000 <Nobody>
+// @file
+// @author David Matthew Mattli <dmattli@usgs.gov>
+//
+// @section LICENSE
+//
+// This software is in the public domain, furnished "as is", without
+// technical support, and with no warranty, express or implied, as to
+// its usefulness for any purpose.
+//
+// @section DESCRIPTION
+//
+// The ChunkBufferPool class recycles RasterChunk pixel buffers.
+//
+//
+
+#include "src/chunkpool.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/mempolicy.h>
+#endif
+
+#include <map>
+#include <utility>
+#include <vector>
+
+namespace librasterblaster {
+/** \cond DOXYHIDE **/
+// Requests below this size all share the smallest class
+const size_t kMinimumClassSize = 4096;
+
+// Rounds value up to a multiple of step
+static size_t RoundUp(size_t value, size_t step) {
+  return ((value + step - 1) / step) * step;
+}
+
+// Returns the NUMA node the calling thread runs on, or -1
+static int CurrentNumaNode() {
+#if defined(__linux__) && defined(SYS_getcpu)
+  unsigned int cpu = 0;
+  unsigned int node = 0;
+  if (syscall(SYS_getcpu, &cpu, &node, NULL) == 0) {
+    return static_cast<int>(node);
+  }
+#endif
+  return -1;
+}
+
+// Sets the memory policy of the page-aligned buffer to prefer node. The
+// pages are still untouched, so they are placed on node when first written.
+static bool BindToNumaNode(void *buffer, size_t size, int node) {
+#if defined(__linux__) && defined(SYS_mbind)
+  const size_t bits_per_word = 8 * sizeof(unsigned long);  // NOLINT
+  unsigned long nodemask[16] = { 0 };  // NOLINT
+  if (node < 0 || static_cast<size_t>(node) >= 16 * bits_per_word) {
+    return false;
+  }
+  nodemask[node / bits_per_word] |= 1UL << (node % bits_per_word);
+  return syscall(SYS_mbind, buffer, size, MPOL_PREFERRED, nodemask,
+                 16 * bits_per_word, 0) == 0;
+#else
+  return false;
+#endif
+}
+/** \endcond **/
+
+ChunkBufferPool *ChunkBufferPool::Instance() {
+  static ChunkBufferPool pool;
+  return &pool;
+}
+
+ChunkBufferPool::ChunkBufferPool() {
+  capacity_ = static_cast<size_t>(1) << 30;
+  huge_page_threshold_ = static_cast<size_t>(64) << 20;
+  numa_binding_ = false;
+  statistics_.hits = 0;
+  statistics_.misses = 0;
+  statistics_.cached_bytes = 0;
+  statistics_.huge_page_allocations = 0;
+  statistics_.numa_allocations = 0;
+}
+
+ChunkBufferPool::~ChunkBufferPool() {
+  Clear();
+}
+
+size_t ChunkBufferPool::ClassSize(size_t size) {
+  if (size <= kMinimumClassSize) {
+    return kMinimumClassSize;
+  }
+
+  // Round up to a multiple of a quarter of the largest power of two not
+  // greater than size.
+  size_t power = kMinimumClassSize;
+  while (power <= size / 2) {
+    power *= 2;
+  }
+  return RoundUp(size, power / 4);
+}
+
+void *ChunkBufferPool::Allocate(size_t class_size, bool huge, int node) {
+  size_t alignment = kChunkBufferAlignment;
+  if (huge) {
+    alignment = kHugePageSize;
+  } else if (node >= 0) {
+    alignment = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  }
+
+  void *buffer = NULL;
+  if (posix_memalign(&buffer, alignment, class_size) != 0) {
+    return NULL;
+  }
+
+#ifdef MADV_HUGEPAGE
+  if (huge && madvise(buffer, class_size, MADV_HUGEPAGE) == 0) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    statistics_.huge_page_allocations++;
+  }
+#endif
+  if (node >= 0 && BindToNumaNode(buffer, class_size, node)) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    statistics_.numa_allocations++;
+  }
+
+  return buffer;
+}
+
+void *ChunkBufferPool::Acquire(size_t size, bool zero) {
+  size_t class_size = ClassSize(size);
+  bool huge = false;
+  int node = -1;
+  void *buffer = NULL;
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (huge_page_threshold_ > 0 && size >= huge_page_threshold_) {
+      huge = true;
+      class_size = RoundUp(class_size, kHugePageSize);
+    }
+    if (numa_binding_) {
+      node = CurrentNumaNode();
+      if (node >= 0) {
+        // Bound buffers must cover whole pages
+        class_size = RoundUp(class_size,
+                             static_cast<size_t>(sysconf(_SC_PAGESIZE)));
+      }
+    }
+
+    std::vector<void*> &free_list = free_lists_[BufferClass(node,
+                                                            class_size)];
+    if (!free_list.empty()) {
+      buffer = free_list.back();
+      free_list.pop_back();
+      statistics_.cached_bytes -= class_size;
+      statistics_.hits++;
+    } else {
+      statistics_.misses++;
+    }
+  }
+
+  if (buffer == NULL) {
+    buffer = Allocate(class_size, huge, node);
+    if (buffer == NULL) {
+      return NULL;
+    }
+  }
+  if (zero) {
+    memset(buffer, 0, size);
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  live_buffers_[buffer] = BufferClass(node, class_size);
+  return buffer;
+}
+
+void ChunkBufferPool::Release(void *buffer) {
+  if (buffer == NULL) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::map<void*, BufferClass>::iterator live = live_buffers_.find(buffer);
+    if (live != live_buffers_.end()) {
+      const BufferClass buffer_class = live->second;
+      const size_t class_size = buffer_class.second;
+      live_buffers_.erase(live);
+      if (statistics_.cached_bytes + class_size <= capacity_) {
+        free_lists_[buffer_class].push_back(buffer);
+        statistics_.cached_bytes += class_size;
+        return;
+      }
+    }
+  }
+
+  free(buffer);
+}
+
+void ChunkBufferPool::Clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (std::map<BufferClass, std::vector<void*> >::iterator i =
+           free_lists_.begin();
+       i != free_lists_.end();
+       ++i) {
+    for (size_t j = 0; j < i->second.size(); ++j) {
+      free(i->second[j]);
+    }
+  }
+  free_lists_.clear();
+  statistics_.cached_bytes = 0;
+}
+
+void ChunkBufferPool::set_capacity(size_t capacity) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  capacity_ = capacity;
+}
+
+void ChunkBufferPool::set_huge_page_threshold(size_t threshold) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  huge_page_threshold_ = threshold;
+}
+
+void ChunkBufferPool::set_numa_binding(bool enabled) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  numa_binding_ = enabled;
+}
+
+ChunkBufferPool::Statistics ChunkBufferPool::statistics() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return statistics_;
+}
+}
@@ -0,0 +1,146 @@
+//
+// Copyright 0000 <Nobody>
+// @file
+// @author David Matthew Mattli <dmattli@usgs.gov>
+//
+// @section LICENSE
+//
+// This software is in the public domain, furnished "as is", without
+// technical support, and with no warranty, express or implied, as to
+// its usefulness for any purpose.
+//
+// @section DESCRIPTION
+//
+// The ChunkBufferPool class recycles RasterChunk pixel buffers.
+//
+//
+
+#ifndef SRC_CHUNKPOOL_H_
+#define SRC_CHUNKPOOL_H_
+
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "src/std_int.h"
+
+namespace librasterblaster {
+/// Alignment, in bytes, of every buffer handed out by the ChunkBufferPool
+const size_t kChunkBufferAlignment = 64;
+/// Size, in bytes, of a transparent huge page
+const size_t kHugePageSize = static_cast<size_t>(2) << 20;
+
+/// A size-classed pool of pixel buffers
+/**
+ * RasterChunk draws its pixel buffers from this pool and returns them when it
+ * is destroyed. A released buffer is kept in a free list for its size class
+ * and handed out again to the next request of that class, so the pages are
+ * already mapped and warm. Size classes are a quarter of a power of two apart,
+ * which bounds the wasted space to 25%.
+ *
+ * Buffers of at least huge_page_threshold bytes are aligned to and sized in
+ * whole huge pages, and the kernel is asked to back them with transparent
+ * huge pages. With NUMA binding enabled, buffers are placed on the NUMA node
+ * of the thread that acquires them and are only recycled on that node.
+ *
+ * There is one pool per process, i.e. per MPI rank.
+ */
+class ChunkBufferPool {
+ public:
+  /// Pool usage counters
+  struct Statistics {
+    /// Requests served from a free list
+    int64_t hits;
+    /// Requests that needed a new allocation
+    int64_t misses;
+    /// Bytes held in the free lists
+    int64_t cached_bytes;
+    /// Allocations advised to use transparent huge pages
+    int64_t huge_page_allocations;
+    /// Allocations bound to a NUMA node
+    int64_t numa_allocations;
+  };
+
+  /**
+   * @brief Returns the pool of this process.
+   */
+  static ChunkBufferPool *Instance();
+
+  /**
+   * @brief Returns a buffer with room for at least size bytes. The buffer is
+   * aligned to kChunkBufferAlignment bytes.
+   *
+   * @param size Number of bytes needed
+   * @param zero If true the first size bytes are set to zero. Pass false when
+   *        the caller overwrites the whole buffer anyway.
+   *
+   * @return Returns NULL if the allocation fails.
+   */
+  void *Acquire(size_t size, bool zero);
+
+  /**
+   * @brief Returns buffer to the pool. Buffers that were not allocated by
+   * Acquire are passed to free().
+   */
+  void Release(void *buffer);
+
+  /**
+   * @brief Frees every buffer held in the free lists.
+   */
+  void Clear();
+
+  /**
+   * @brief Sets the maximum number of bytes kept in the free lists. Buffers
+   * released while the pool is full are freed. The default is 1 GiB.
+   */
+  void set_capacity(size_t capacity);
+
+  /**
+   * @brief Sets the size, in bytes, from which buffers use transparent huge
+   * pages. 0 disables huge pages. The default is 64 MiB.
+   */
+  void set_huge_page_threshold(size_t threshold);
+
+  /**
+   * @brief Enables or disables binding buffers to the NUMA node of the
+   * acquiring thread. Binding is disabled by default.
+   */
+  void set_numa_binding(bool enabled);
+
+  /**
+   * @brief Returns the counters of the pool.
+   */
+  Statistics statistics();
+
+  /**
+   * @brief Returns the size class that a request for size bytes is served
+   * from.
+   */
+  static size_t ClassSize(size_t size);
+
+ private:
+  ChunkBufferPool();
+  ~ChunkBufferPool();
+  ChunkBufferPool(const ChunkBufferPool&);
+  ChunkBufferPool& operator=(const ChunkBufferPool&);
+
+  /// A NUMA node, -1 if unbound, and a size class
+  typedef std::pair<int, size_t> BufferClass;
+
+  void *Allocate(size_t class_size, bool huge, int node);
+
+  std::mutex mutex_;
+  /// Free buffers, by node and size class
+  std::map<BufferClass, std::vector<void*> > free_lists_;
+  /// Node and size class of every buffer handed out by Acquire
+  std::map<void*, BufferClass> live_buffers_;
+  size_t capacity_;
+  size_t huge_page_threshold_;
+  bool numa_binding_;
+  Statistics statistics_;
+};
+}
+
+#endif  // SRC_CHUNKPOOL_H_
@@ -15,6 +15,7 @@
 //
 //
 
+#include <ctype.h>
 #include <getopt.h>
 
 #include "src/configuration.h"
@@ -30,8 +31,45 @@ struct option longopts[] = {
   {"dstnodata", required_argument, NULL, 'f'},
   {"tile-size", required_argument, NULL, 'x'},
   {"timing-file", required_argument, NULL, 'c'},
+  {"row-alignment", required_argument, NULL, 'a'},
+  {"huge-page-threshold", required_argument, NULL, 'H'},
+  {"numa-bind", no_argument, NULL, 'N'},
+  {"memory-per-rank", required_argument, NULL, 'm'},
+  {"no-mmap", no_argument, NULL, 'M'},
+  {"read-footprint", no_argument, NULL, 'F'},
+  {"threads", required_argument, NULL, 'T'},
+  {"collective-write", no_argument, NULL, 'W'},
+  {"async-write", no_argument, NULL, 'A'},
+  {"rank-layout", no_argument, NULL, 'L'},
+  {"tile-alignment", required_argument, NULL, 'S'},
+  {"mpi-hint", required_argument, NULL, 'I'},
+  {"compress", required_argument, NULL, 'Z'},
+  {"compress-level", required_argument, NULL, 'z'},
+  {"cog", no_argument, NULL, 'O'},
+  {"sparse", no_argument, NULL, 'P'},
   {0, 0, 0, 0}
 };
+
+// Parses a byte count with an optional K, M or G suffix, negative counts
+// are 0
+static int64_t ParseByteCount(const char *text) {
+  char *suffix = NULL;
+  int64_t count = strtoll(text, &suffix, 10);
+  switch (*suffix) {
+    case 'G': case 'g':
+      count <<= 10;
+      // fall through
+    case 'M': case 'm':
+      count <<= 10;
+      // fall through
+    case 'K': case 'k':
+      count <<= 10;
+      break;
+    default:
+      break;
+  }
+  return count < 0 ? 0 : count;
+}
 /** \endcode **/
 
 Configuration::Configuration() {
@@ -39,6 +77,21 @@ Configuration::Configuration() {
   partition_size = -1;
   tile_size = 1024;
   timing_filename = "";
+  row_alignment = kChunkBufferAlignment;
+  huge_page_threshold = static_cast<int64_t>(64) << 20;
+  numa_binding = false;
+  memory_per_rank = 0;
+  mmap_input = true;
+  read_footprint = false;
+  thread_count = 1;
+  collective_write = false;
+  async_write = false;
+  rank_layout = false;
+  tile_alignment = 0;
+  compression = "NONE";
+  compression_level = -1;
+  cog = false;
+  sparse = false;
 }
 
 Configuration::Configuration(int argc, char *argv[]) {
@@ -48,6 +101,21 @@ Configuration::Configuration(int argc, char *argv[]) {
   resampler = NEAREST;
   tile_size = 1024;
   timing_filename = "";
+  row_alignment = kChunkBufferAlignment;
+  huge_page_threshold = static_cast<int64_t>(64) << 20;
+  numa_binding = false;
+  memory_per_rank = 0;
+  mmap_input = true;
+  read_footprint = false;
+  thread_count = 1;
+  collective_write = false;
+  async_write = false;
+  rank_layout = false;
+  tile_alignment = 0;
+  compression = "NONE";
+  compression_level = -1;
+  cog = false;
+  sparse = false;
   while ((c = getopt_long(argc,
                           argv,
                           "p:r:f:n:x:c",
@@ -65,11 +133,33 @@ Configuration::Configuration(int argc, char *argv[]) {
         partition_size = strtol(optarg, NULL, 10);
         break;
       case 'r':
-      arg = optarg;
-        if (arg == "mean") {
-          resampler = MEAN;
-        } else if (arg == "nearest") {
-          resampler = NEAREST;
+        arg = optarg;
+        resamplers.clear();
+        while (arg != "") {
+          const size_t comma = arg.find(',');
+          const std::string name = arg.substr(0, comma);
+          arg = comma == std::string::npos ? "" : arg.substr(comma + 1);
+
+          if (name == "mean") {
+            resamplers.push_back(MEAN);
+          } else if (name == "nearest") {
+            resamplers.push_back(NEAREST);
+          } else if (name == "min") {
+            resamplers.push_back(MIN);
+          } else if (name == "max") {
+            resamplers.push_back(MAX);
+          } else if (name == "count") {
+            resamplers.push_back(COUNT);
+          } else {
+            fprintf(stderr, "%s: unknown resampler '%s': ignored\n",
+                    argv[0], name.c_str());
+          }
+        }
+        if (!resamplers.empty()) {
+          resampler = resamplers[0];
+        }
+        if (resamplers.size() == 1) {
+          resamplers.clear();
         }
         break;
       case 'f':
@@ -81,6 +171,81 @@ Configuration::Configuration(int argc, char *argv[]) {
       case 'c':
         timing_filename = optarg;
         break;
+      case 'a':
+        row_alignment = static_cast<int>(strtol(optarg, NULL, 10));
+        if (row_alignment < 1) {
+          fprintf(stderr, "Invalid row alignment %s, using 1\n", optarg);
+          row_alignment = 1;
+        }
+        break;
+      case 'H':
+        huge_page_threshold = ParseByteCount(optarg);
+        break;
+      case 'N':
+        numa_binding = true;
+        break;
+      case 'm':
+        memory_per_rank = ParseByteCount(optarg);
+        break;
+      case 'M':
+        mmap_input = false;
+        break;
+      case 'F':
+        read_footprint = true;
+        break;
+      case 'T':
+        thread_count = static_cast<int>(strtol(optarg, NULL, 10));
+        if (thread_count < 1) {
+          fprintf(stderr, "Invalid thread count %s, using 1\n", optarg);
+          thread_count = 1;
+        }
+        break;
+      case 'W':
+        collective_write = true;
+        break;
+      case 'A':
+        async_write = true;
+        break;
+      case 'L':
+        rank_layout = true;
+        break;
+      case 'S':
+        tile_alignment = ParseByteCount(optarg);
+        break;
+      case 'I': {
+        arg = optarg;
+        const size_t equals = arg.find('=');
+        if (equals == std::string::npos || equals == 0) {
+          fprintf(stderr, "%s: MPI hint '%s' is not key=value: ignored\n",
+                  argv[0], optarg);
+          break;
+        }
+        mpi_hints.push_back(std::make_pair(arg.substr(0, equals),
+                                           arg.substr(equals + 1)));
+        break;
+      }
+      case 'Z':
+        arg = optarg;
+        for (size_t i = 0; i < arg.size(); ++i) {
+          arg[i] = toupper(arg[i]);
+        }
+        if (arg == "NONE" || arg == "DEFLATE" || arg == "LZW"
+            || arg == "ZSTD") {
+          compression = arg;
+        } else {
+          fprintf(stderr, "%s: unknown compression '%s': ignored\n",
+                  argv[0], optarg);
+        }
+        break;
+      case 'z':
+        compression_level = static_cast<int>(strtol(optarg, NULL, 10));
+        break;
+      case 'O':
+        cog = true;
+        break;
+      case 'P':
+        sparse = true;
+        break;
       default:
         fprintf(stderr, "%s: option '-%c' is invalid: ignored\n",
                 argv[0], optopt);
@@ -20,6 +20,8 @@
 #define SRC_CONFIGURATION_H_
 
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "src/resampler.h"
 #include "src/reprojection_tools.h"
@@ -78,6 +80,13 @@ struct Configuration {
    * value is NEAREST.
    */
   RESAMPLER resampler;
+  /**
+   * @brief The resamplers to evaluate in a single pass, set when a
+   * comma-separated list such as "min,max,mean" is given to -r. The first
+   * entry is also stored in resampler. Each resampler is written to its own
+   * output file. The default value is empty.
+   */
+  std::vector<RESAMPLER> resamplers;
   /**
    * @brief This is set to the fillvalue specified by the user.
    */
@@ -99,6 +108,101 @@ struct Configuration {
    * @brief Name of timing information file
    */
   string timing_filename;
+  /**
+   * @brief Alignment, in bytes, of the rows of RasterChunk buffers. The
+   * default value is 64, 1 disables row padding.
+   */
+  int row_alignment;
+  /**
+   * @brief Size, in bytes, from which chunk buffers use transparent huge
+   * pages. The default value is 64 MiB, 0 disables huge pages.
+   */
+  int64_t huge_page_threshold;
+  /**
+   * @brief If true, chunk buffers are bound to the NUMA node of the thread
+   * that allocates them. The default value is false.
+   */
+  bool numa_binding;
+  /**
+   * @brief Memory, in bytes, available to each process. When it is set the
+   * partition size is chosen to fit this budget and partition_size is
+   * ignored. A K, M or G suffix may be given. The default value is 0, unset.
+   */
+  int64_t memory_per_rank;
+  /**
+   * @brief If true, uncompressed TIFF input is read through a memory mapping
+   * instead of GDAL. The default value is true.
+   */
+  bool mmap_input;
+  /**
+   * @brief If true, only the input tiles or strips that the output pixel
+   * footprints touch are read, rather than the whole minbox of each
+   * partition. The default value is false.
+   */
+  bool read_footprint;
+  /**
+   * @brief Number of threads that reproject each partition. The default
+   * value is 1.
+   */
+  int thread_count;
+  /**
+   * @brief If true, output partitions are written with collective MPI-IO,
+   * see sptw::write_area_all. The default value is false.
+   */
+  bool collective_write;
+  /**
+   * @brief If true, the output chunks of a partition are written with
+   * non-blocking MPI-IO while the next partition is read and reprojected,
+   * which keeps two partitions of output chunks in memory. It has no effect
+   * with collective_write. The default value is false.
+   */
+  bool async_write;
+  /**
+   * @brief If true, the output tiles are stored in the order in which the
+   * processes write them, so that the partitions of each process form one
+   * contiguous extent of the file. The tile offset table keeps the file a
+   * valid TIFF. The default value is false.
+   */
+  bool rank_layout;
+  /**
+   * @brief Every output tile starts at a multiple of this many bytes,
+   * usually the stripe size of a parallel filesystem. A K, M or G suffix may
+   * be given. The default value is 0, which uses the striping_unit hint if
+   * one is given and packs the tiles otherwise.
+   */
+  int64_t tile_alignment;
+  /**
+   * @brief MPI-IO hints the output files are created and opened with, such
+   * as striping_factor, striping_unit, cb_nodes or romio_cb_write, each
+   * given as key=value to a --mpi-hint option. The default value is empty.
+   */
+  std::vector<std::pair<string, string> > mpi_hints;
+  /**
+   * @brief Compression of the output tiles: NONE, DEFLATE, LZW or ZSTD. The
+   * tiles are compressed in parallel by the processes that compute them.
+   * The default value is "NONE".
+   */
+  string compression;
+  /**
+   * @brief Level of the compression, -1 for its default. The default value
+   * is -1.
+   */
+  int compression_level;
+  /**
+   * @brief If true, the output is a Cloud Optimized GeoTIFF: reduced
+   * resolution overviews down to a single tile are computed in parallel from
+   * the output tiles and stored before them, with every directory at the
+   * start of the file. The default value is false.
+   */
+  bool cog;
+  /**
+   * @brief If true, output tiles that only hold the fill value, such as
+   * those outside of the projected globe, are not written and are stored
+   * with offset and byte count 0. The fill value is stored as the nodata
+   * value of the output so those tiles read as it. The default value is
+   * false.
+   */
+  bool sparse;
 };
 }
 
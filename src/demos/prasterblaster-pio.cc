@@ -17,26 +17,39 @@
 ///
 ///
 
+#include <float.h>
+#include <limits.h>
+#include <string.h>
 #include <sys/time.h>
 
 #include <algorithm>
+#include <string>
 #include <vector>
 
 #include "src/configuration.h"
+#include "src/mappedraster.h"
 #include "src/reprojection_tools.h"
 
 #include "src/demos/sptw.h"
 #include "src/utils.h"
 
+using std::string;
 using std::vector;
 
 using librasterblaster::Area;
+using librasterblaster::AreaIsFill;
 using librasterblaster::BlockPartition;
+using librasterblaster::BlockResidency;
+using librasterblaster::ChunkBufferPool;
+using librasterblaster::DownsampleChunk;
 using librasterblaster::RasterChunk;
+using librasterblaster::RasterDescriptor;
 using librasterblaster::Configuration;
+using librasterblaster::MappedRaster;
 using librasterblaster::PRB_ERROR;
 using librasterblaster::PRB_BADARG;
 using librasterblaster::PRB_NOERROR;
+using librasterblaster::RESAMPLER;
 
 using sptw::PTIFF;
 using sptw::open_raster;
@@ -54,7 +67,7 @@ USAGE:
 \verbatim
 prasterblaster [--t_srs target_srs] [--s_srs source_srs] 
                [-r resampling_method] [-n partition_size]
-               [--dstnodata no_data_value]
+               [--dstnodata no_data_value] [--row-alignment bytes]
                source_file destination_file
 
 \endverbatim
@@ -71,26 +84,217 @@ prasterblaster-pio.cc.
  */
 namespace librasterblaster {
 PRB_ERROR write_rasterchunk(PTIFF *ptiff,
-                             RasterChunk *chunk) {
+                            const RasterChunkView &view,
+                            bool collective = false) {
   Area write_area;
-  write_area.ul = chunk->ChunkToRaster(
-      librasterblaster::Coordinate(0.0, 0.0, librasterblaster::UNDEF));
-  write_area.lr = chunk->ChunkToRaster(
-      librasterblaster::Coordinate(chunk->column_count_-1,
-                                   chunk->row_count_-1,
-                                   librasterblaster::UNDEF));
-  sptw::write_area(ptiff,
-                   chunk->pixels_,
-                   write_area.ul.x,
-                   write_area.ul.y,
-                   write_area.lr.x,
-                   write_area.lr.y);
-  return PRB_NOERROR;
+  write_area.ul = view.raster_location_;
+  write_area.lr = librasterblaster::Coordinate(
+      view.raster_location_.x + view.column_count_ - 1,
+      view.raster_location_.y + view.row_count_ - 1,
+      librasterblaster::UNDEF);
+  sptw::SPTW_ERROR err = sptw::SP_None;
+  if (collective) {
+    err = sptw::write_area_all(ptiff,
+                               view.pixels_,
+                               view.row_stride_,
+                               write_area.ul.x,
+                               write_area.ul.y,
+                               write_area.lr.x,
+                               write_area.lr.y);
+  } else {
+    err = sptw::write_area_strided(ptiff,
+                                   view.pixels_,
+                                   view.row_stride_,
+                                   write_area.ul.x,
+                                   write_area.ul.y,
+                                   write_area.lr.x,
+                                   write_area.lr.y);
+  }
+  return err == sptw::SP_None ? PRB_NOERROR : PRB_IOERROR;
+}
+
+PRB_ERROR write_rasterchunk(PTIFF *ptiff,
+                            RasterChunk *chunk,
+                            bool collective = false) {
+  return write_rasterchunk(ptiff, chunk->View(), collective);
+}
+
+// Compresses the tiles of chunk and writes them, every process must call it
+// the same number of times
+PRB_ERROR write_rasterchunk_compressed(PTIFF *ptiff, RasterChunk *chunk) {
+  const sptw::SPTW_ERROR err = sptw::write_area_compressed(
+      ptiff,
+      chunk->pixels_,
+      chunk->row_stride_,
+      chunk->raster_location_.x,
+      chunk->raster_location_.y,
+      chunk->raster_location_.x + chunk->column_count_ - 1,
+      chunk->raster_location_.y + chunk->row_count_ - 1);
+  return err == sptw::SP_None ? PRB_NOERROR : PRB_IOERROR;
+}
+
+// Starts writing chunk and adds the writes to request, the chunk must be kept
+// until sptw::wait_write(request) has returned
+PRB_ERROR write_rasterchunk_async(PTIFF *ptiff,
+                                  RasterChunk *chunk,
+                                  sptw::WriteRequest *request) {
+  const sptw::SPTW_ERROR err = sptw::write_area_async(
+      ptiff,
+      chunk->pixels_,
+      chunk->row_stride_,
+      chunk->raster_location_.x,
+      chunk->raster_location_.y,
+      chunk->raster_location_.x + chunk->column_count_ - 1,
+      chunk->raster_location_.y + chunk->row_count_ - 1,
+      request);
+  return err == sptw::SP_None ? PRB_NOERROR : PRB_IOERROR;
+}
+
+// Returns the grid of overview level of raster, each level halving the rows
+// and columns of the one before it, rounding up
+RasterDescriptor OverviewDescriptor(const RasterDescriptor &raster,
+                                    int level) {
+  RasterDescriptor overview = raster;
+  const int64_t scale = static_cast<int64_t>(1) << level;
+  overview.row_count = (raster.row_count + scale - 1) / scale;
+  overview.column_count = (raster.column_count + scale - 1) / scale;
+  overview.geotransform[1] *= scale;
+  overview.geotransform[2] *= scale;
+  overview.geotransform[4] *= scale;
+  overview.geotransform[5] *= scale;
+  return overview;
+}
+
+// Downsamples chunk into a new chunk of the overview grid that chunk covers
+// the whole pixels of, NULL on error
+RasterChunk *DownsampleRasterChunk(RasterChunk *chunk,
+                                   const RasterDescriptor &overview,
+                                   RESAMPLER resampler,
+                                   string fillvalue,
+                                   int row_alignment) {
+  const int64_t ul_x = static_cast<int64_t>(chunk->raster_location_.x);
+  const int64_t ul_y = static_cast<int64_t>(chunk->raster_location_.y);
+  const Area overview_area(ul_x / 2,
+                           ul_y / 2,
+                           (ul_x + chunk->column_count_ - 1) / 2,
+                           (ul_y + chunk->row_count_ - 1) / 2);
+  RasterChunk *overview_chunk = RasterChunk::CreateRasterChunk(overview,
+                                                               overview_area,
+                                                               false,
+                                                               row_alignment);
+  if (overview_chunk != NULL
+      && !DownsampleChunk(chunk, overview_chunk, resampler, fillvalue)) {
+    delete overview_chunk;
+    overview_chunk = NULL;
+  }
+  return overview_chunk;
+}
+
+// Leaves the tiles of ptiff that lie within chunk and only hold the fill
+// value unallocated, see sptw::skip_tile, and returns how many there are
+int64_t SkipFillTiles(PTIFF *ptiff, RasterChunk *chunk, string fillvalue) {
+  const int64_t tile_size = ptiff->block_x_size;
+  const int64_t ul_x = static_cast<int64_t>(chunk->raster_location_.x);
+  const int64_t ul_y = static_cast<int64_t>(chunk->raster_location_.y);
+  const int64_t lr_x = ul_x + chunk->column_count_ - 1;
+  const int64_t lr_y = ul_y + chunk->row_count_ - 1;
+  int64_t count = 0;
+  for (int64_t tile_y = (ul_y + tile_size - 1) / tile_size;
+       tile_y * tile_size <= lr_y; ++tile_y) {
+    for (int64_t tile_x = (ul_x + tile_size - 1) / tile_size;
+         tile_x * tile_size <= lr_x; ++tile_x) {
+      const Area tile(tile_x * tile_size,
+                      tile_y * tile_size,
+                      std::min((tile_x + 1) * tile_size, ptiff->x_size) - 1,
+                      std::min((tile_y + 1) * tile_size, ptiff->y_size) - 1);
+      if (tile.lr.x <= lr_x && tile.lr.y <= lr_y
+          && AreaIsFill(chunk, tile, fillvalue)
+          && sptw::skip_tile(ptiff, tile_x, tile_y) == sptw::SP_None) {
+        ++count;
+      }
+    }
+  }
+  return count;
+}
+
+string StatisticFilename(string filename, RESAMPLER resampler) {
+  const size_t dot = filename.rfind('.');
+  const size_t slash = filename.rfind('/');
+  string suffix = string("_") + ResamplerName(resampler);
+
+  if (dot == string::npos || (slash != string::npos && dot < slash)) {
+    return filename + suffix;
+  }
+  return filename.substr(0, dot) + suffix + filename.substr(dot);
+}
+
+// Appends the bytes of value to buffer
+template <typename T>
+void PackValue(const T &value, vector<char> *buffer) {
+  const char *bytes = reinterpret_cast<const char*>(&value);
+  buffer->insert(buffer->end(), bytes, bytes + sizeof(T));
+}
+
+// Reads a value stored by PackValue at *position and moves past it
+template <typename T>
+void UnpackValue(const vector<char> &buffer, size_t *position, T *value) {
+  memcpy(value, &buffer[*position], sizeof(T));
+  *position += sizeof(T);
+}
+
+void PackDescriptor(const RasterDescriptor &raster, vector<char> *buffer) {
+  PackValue(raster.projection.size(), buffer);
+  buffer->insert(buffer->end(), raster.projection.begin(),
+                 raster.projection.end());
+  for (int i = 0; i < 6; ++i) {
+    PackValue(raster.geotransform[i], buffer);
+  }
+  PackValue(raster.row_count, buffer);
+  PackValue(raster.column_count, buffer);
+  PackValue(raster.band_count, buffer);
+  PackValue(raster.pixel_type, buffer);
+  PackValue(raster.block_width, buffer);
+  PackValue(raster.block_height, buffer);
+  PackValue(raster.has_nodata, buffer);
+  PackValue(raster.nodata, buffer);
+}
+
+void UnpackDescriptor(const vector<char> &buffer,
+                      size_t *position,
+                      RasterDescriptor *raster) {
+  size_t projection_size = 0;
+  UnpackValue(buffer, position, &projection_size);
+  raster->projection.assign(&buffer[*position], projection_size);
+  *position += projection_size;
+  for (int i = 0; i < 6; ++i) {
+    UnpackValue(buffer, position, &raster->geotransform[i]);
+  }
+  UnpackValue(buffer, position, &raster->row_count);
+  UnpackValue(buffer, position, &raster->column_count);
+  UnpackValue(buffer, position, &raster->band_count);
+  UnpackValue(buffer, position, &raster->pixel_type);
+  UnpackValue(buffer, position, &raster->block_width);
+  UnpackValue(buffer, position, &raster->block_height);
+  UnpackValue(buffer, position, &raster->has_nodata);
+  UnpackValue(buffer, position, &raster->nodata);
+}
+
+// Broadcasts buffer from rank 0 to every process
+void BroadcastBuffer(vector<char> *buffer) {
+  unsigned long size = buffer->size();
+  MPI_Bcast(&size, 1, MPI_UNSIGNED_LONG, 0, MPI_COMM_WORLD);
+  buffer->resize(size);
+  // MPI counts are ints
+  for (unsigned long offset = 0; offset < size; offset += INT_MAX) {
+    const int count = static_cast<int>(
+        std::min<unsigned long>(size - offset, INT_MAX));
+    MPI_Bcast(&(*buffer)[offset], count, MPI_CHAR, 0, MPI_COMM_WORLD);
+  }
 }
 
 /** Main function for the prasterblasterpio program */
 PRB_ERROR prasterblasterpio(Configuration conf) {
-  RasterChunk *in_chunk, *out_chunk;
+  RasterChunk *in_chunk;
   double start_time, end_time, preloop_time;
 
   start_time = MPI_Wtime();
@@ -109,29 +313,74 @@ PRB_ERROR prasterblasterpio(Configuration conf) {
   if (conf.input_filename == "" || conf.output_filename == "") {
     printf("USAGE:\n"
            "prasterblaster [--t_srs target_srs] [--s_srs source_srs]\n"
-           "               [-r resampling_method] [-n partition_size]\n"
+           "               [-r resampling_method[,resampling_method...]]\n"
+           "               [-n partition_size]\n"
            "               [--dstnodata no_data_value]\n"
            "               [--timing-file filename]\n"
            "               [--tile-size tile_size_in_pixels]\n"
+           "               [--row-alignment bytes]\n"
+           "               [--huge-page-threshold bytes[K|M|G]] [--numa-bind]\n"
+           "               [--memory-per-rank bytes[K|M|G]] [--no-mmap]\n"
+           "               [--read-footprint] [--threads count]\n"
+           "               [--collective-write] [--async-write]\n"
+           "               [--rank-layout] [--tile-alignment bytes[K|M|G]]\n"
+           "               [--mpi-hint key=value]...\n"
+           "               [--compress NONE|DEFLATE|LZW|ZSTD]"
+           " [--compress-level level]\n"
+           "               [--cog] [--sparse]\n"
            "               source_file destination_file\n");
     return PRB_BADARG;
   }
 
-  // Open the input raster
-  //
-  // The input raster is only read so we can use the serial i/o provided by the
-  // GDAL library.
-  GDALDataset *input_raster =
-      static_cast<GDALDataset*>(GDALOpen(conf.input_filename.c_str(),
-                                         GA_ReadOnly));
-  if (input_raster == NULL) {
-    fprintf(stderr, "Error opening input raster!\n");
-    return PRB_IOERROR;
+  // Chunk buffers are drawn from the pool, configure how it allocates them
+  ChunkBufferPool::Instance()->set_huge_page_threshold(
+      static_cast<size_t>(conf.huge_page_threshold));
+  ChunkBufferPool::Instance()->set_numa_binding(conf.numa_binding);
+
+  // With several resamplers the input is read and transformed once and each
+  // statistic is written to its own output file.
+  vector<RESAMPLER> resamplers = conf.resamplers;
+  vector<string> output_filenames;
+  if (resamplers.empty()) {
+    resamplers.push_back(conf.resampler);
+    output_filenames.push_back(conf.output_filename);
+  } else {
+    for (size_t i = 0; i < resamplers.size(); ++i) {
+      output_filenames.push_back(StatisticFilename(conf.output_filename,
+                                                   resamplers[i]));
+    }
   }
 
-  // If we are the process with rank 0 we are responsible for the creation of
-  // the output raster.
+  // Rank 0 reads the metadata of the input, computes the output grid and
+  // broadcasts what the other processes need in one descriptor. They open
+  // the input only to read their windows, and the outputs only with MPI-IO.
+  GDALDataset *input_raster = NULL;
+  MappedRaster *mapped_input = NULL;
+  RasterDescriptor input_descriptor;
+  RasterDescriptor output_descriptor;
+  vector<int64_t> mapped_description;
   if (rank == 0) {
+    // The input raster is only read so we can use the serial i/o provided by
+    // the GDAL library.
+    input_raster = static_cast<GDALDataset*>(
+        GDALOpen(conf.input_filename.c_str(), GA_ReadOnly));
+    if (input_raster == NULL) {
+      fprintf(stderr, "Error opening input raster!\n");
+      MPI_Abort(MPI_COMM_WORLD, 1);
+      return PRB_IOERROR;
+    }
+    input_descriptor = RasterDescriptor(input_raster);
+
+    // Uncompressed TIFF input is read straight from a memory mapping, other
+    // inputs go through GDAL
+    if (conf.mmap_input) {
+      mapped_input = MappedRaster::Open(conf.input_filename);
+    }
+    if (mapped_input != NULL) {
+      mapped_input->Describe(&mapped_description);
+      printf("Reading memory-mapped input\n");
+    }
+
     OGRSpatialReference sr;
     char *wkt;
     sr.SetFromUserInput(input_raster->GetProjectionRef());
@@ -141,64 +390,335 @@ PRB_ERROR prasterblasterpio(Configuration conf) {
            conf.input_filename.c_str(), conf.output_filename.c_str());
     OGRFree(wkt);
 
-    // Now we have to create the output raster
-    printf("Creating output raster...");
+    // The grid of the output rasters, which are created once the partitions
+    // are known
+    int64_t output_columns = 0, output_rows = 0;
     double gt[6];
-    input_raster->GetGeoTransform(gt);
-    PRB_ERROR err = librasterblaster::CreateOutputRaster(input_raster,
-                                                         conf.output_filename,
-                                                         conf.output_srs,
-                                                         conf.tile_size);
+    PRB_ERROR err = librasterblaster::OutputRasterGeometry(input_raster,
+                                                           conf.output_srs,
+                                                           &output_columns,
+                                                           &output_rows,
+                                                           gt);
     if (err != PRB_NOERROR) {
-      fprintf(stderr, "Error creating raster!: %d\n", err);
+      fprintf(stderr, "Error computing the output raster grid!: %d\n", err);
+      MPI_Abort(MPI_COMM_WORLD, 1);
       return PRB_IOERROR;
     }
+    OGRSpatialReference out_sr;
+    char *out_wkt = NULL;
+    out_sr.SetFromUserInput(conf.output_srs.c_str());
+    out_sr.exportToWkt(&out_wkt);
+    output_descriptor.projection = out_wkt;
+    memcpy(output_descriptor.geotransform, gt, sizeof(gt));
+    output_descriptor.row_count = output_rows;
+    output_descriptor.column_count = output_columns;
+    output_descriptor.band_count = input_descriptor.band_count;
+    output_descriptor.pixel_type = input_descriptor.pixel_type;
+    output_descriptor.block_width = conf.tile_size;
+    output_descriptor.block_height = conf.tile_size;
+    OGRFree(out_wkt);
   }
 
-  // Wait for rank 0 to finish creating the file
-  MPI_Barrier(MPI_COMM_WORLD);
-  PTIFF* output_raster = open_raster(conf.output_filename);
+  vector<char> descriptor;
   if (rank == 0) {
-    SPTW_ERROR sperr = populate_tile_offsets(output_raster,
-                                             conf.tile_size,
-                                             0);
-    if (sperr != sptw::SP_None) {
-      fprintf(stderr, "\nError populating tile offsets\n");
-    }
-    printf("done\n");
+    PackDescriptor(input_descriptor, &descriptor);
+    PackDescriptor(output_descriptor, &descriptor);
+    PackValue(mapped_description.size(), &descriptor);
+    const char *table = reinterpret_cast<const char*>(
+        mapped_description.data());
+    descriptor.insert(descriptor.end(), table,
+                      table + mapped_description.size() * sizeof(int64_t));
   }
-  close_raster(output_raster);
-  output_raster = open_raster(conf.output_filename);
-  MPI_Barrier(MPI_COMM_WORLD);
-
-  // Now open the new output file as a ProjectedRaster object. This object will
-  // only be used to read metadata. It will _not_ be used to write to the output
-  // file.
-  GDALDataset *gdal_output_raster =
-      static_cast<GDALDataset*>(GDALOpen(conf.output_filename.c_str(),
-                                         GA_Update));
+  BroadcastBuffer(&descriptor);
+  if (rank != 0) {
+    size_t position = 0;
+    UnpackDescriptor(descriptor, &position, &input_descriptor);
+    UnpackDescriptor(descriptor, &position, &output_descriptor);
+    size_t table_size = 0;
+    UnpackValue(descriptor, &position, &table_size);
+    mapped_description.resize(table_size);
+    if (table_size > 0) {
+      memcpy(&mapped_description[0], &descriptor[position],
+             table_size * sizeof(int64_t));
+    }
 
-  if (output_raster == NULL) {
-    fprintf(stderr, "Could not open output raster\n");
-    MPI_Abort(MPI_COMM_WORLD, 1);
-    return PRB_IOERROR;
+    if (!mapped_description.empty()) {
+      mapped_input = MappedRaster::Open(conf.input_filename,
+                                        mapped_description);
+    }
+    if (mapped_input == NULL) {
+      input_raster = static_cast<GDALDataset*>(
+          GDALOpen(conf.input_filename.c_str(), GA_ReadOnly));
+      if (input_raster == NULL) {
+        fprintf(stderr, "Error opening input raster!\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+        return PRB_IOERROR;
+      }
+    }
+  }
+  vector<char>().swap(descriptor);
+  // Tiles missing from a sparse input read as nodata, like through GDAL
+  if (mapped_input != NULL && input_descriptor.has_nodata) {
+    mapped_input->SetNoDataValue(input_descriptor.nodata,
+                                 input_descriptor.pixel_type);
   }
 
   vector<Area> partitions;
+  int partition_size = conf.partition_size;
+  // Compressed tiles are placed with collective calls once they are
+  // compressed, partitions cover whole tiles
+  sptw::SPTW_COMPRESSION compression = sptw::SP_Uncompressed;
+  if (conf.compression == "DEFLATE") {
+    compression = sptw::SP_Deflate;
+  } else if (conf.compression == "LZW") {
+    compression = sptw::SP_LZW;
+  } else if (conf.compression == "ZSTD") {
+    compression = sptw::SP_ZSTD;
+  }
+  const bool compressed = compression != sptw::SP_Uncompressed;
+  if (conf.cog && compressed) {
+    if (rank == 0) {
+      fprintf(stderr, "Cloud Optimized GeoTIFF output must be "
+              "uncompressed!\n");
+    }
+    return PRB_BADARG;
+  }
+  // Partition i is written while partition i + 1 is computed, its output
+  // chunks are kept until the writes have completed
+  const bool async_write = conf.async_write && !conf.collective_write
+      && !compressed;
+  sptw::WriteRequest pending_writes;
+  vector<RasterChunk*> pending_chunks;
+  // The source minbox of every output tile, when the partitions are sized
+  // to the memory budget
+  vector<Area> tile_minboxes;
+
+  if (conf.memory_per_rank > 0) {
+    // Size the partitions to fit the memory budget. The source minbox of
+    // every output tile is needed, each process computes a share of them.
+    const int64_t tile_size = conf.tile_size;
+    const int64_t tiles_across = (output_descriptor.column_count
+                                  + tile_size - 1) / tile_size;
+    const int64_t tiles_down = (output_descriptor.row_count + tile_size - 1)
+        / tile_size;
+    const int64_t tile_count = tiles_across * tiles_down;
+    vector<double> minbox_values(4 * tile_count, -DBL_MAX);
+    vector<double> all_minbox_values(4 * tile_count);
+
+    for (int64_t t = rank; t < tile_count; t += process_count) {
+      Area tile;
+      tile.ul.x = (t % tiles_across) * tile_size;
+      tile.ul.y = (t / tiles_across) * tile_size;
+      tile.lr.x = std::min(
+          tile.ul.x + tile_size,
+          static_cast<double>(output_descriptor.column_count)) - 1;
+      tile.lr.y = std::min(
+          tile.ul.y + tile_size,
+          static_cast<double>(output_descriptor.row_count)) - 1;
+      Area minbox = librasterblaster::RasterMinbox(output_descriptor,
+                                                   input_descriptor,
+                                                   tile);
+      minbox_values[4 * t] = minbox.ul.x;
+      minbox_values[4 * t + 1] = minbox.ul.y;
+      minbox_values[4 * t + 2] = minbox.lr.x;
+      minbox_values[4 * t + 3] = minbox.lr.y;
+    }
+    MPI_Allreduce(&minbox_values[0],
+                  &all_minbox_values[0],
+                  static_cast<int>(4 * tile_count),
+                  MPI_DOUBLE,
+                  MPI_MAX,
+                  MPI_COMM_WORLD);
+
+    tile_minboxes.resize(tile_count);
+    for (int64_t t = 0; t < tile_count; ++t) {
+      tile_minboxes[t] = Area(all_minbox_values[4 * t],
+                              all_minbox_values[4 * t + 1],
+                              all_minbox_values[4 * t + 2],
+                              all_minbox_values[4 * t + 3]);
+    }
+
+    const bool index_map = resamplers.size() == 1
+        && resamplers[0] == librasterblaster::NEAREST;
+    librasterblaster::PartitionPlan plan = librasterblaster::PlanPartitions(
+        tile_minboxes,
+        output_descriptor.row_count,
+        output_descriptor.column_count,
+        static_cast<int>(tile_size),
+        process_count,
+        input_descriptor.band_count,
+        input_descriptor.pixel_type,
+        static_cast<int>(resamplers.size()) * (async_write ? 2 : 1),
+        index_map,
+        conf.row_alignment,
+        conf.memory_per_rank);
+    partition_size = plan.partition_size;
+
+    // Whatever the working set leaves of the budget may be cached
+    const int64_t spare_bytes = conf.memory_per_rank - plan.peak_bytes;
+    ChunkBufferPool::Instance()->set_capacity(
+        spare_bytes > 0 ? static_cast<size_t>(spare_bytes) : 0);
+
+    if (rank == 0) {
+      printf("Partition plan for %lld bytes per process: %d tiles "
+             "(%d x %d), %lld partitions\n"
+             "  largest input chunk %lld bytes, output chunks %lld bytes, "
+             "peak %lld bytes\n",
+             static_cast<long long>(conf.memory_per_rank),
+             plan.partition_size,
+             plan.partition_width,
+             plan.partition_height,
+             static_cast<long long>(plan.partition_count),
+             static_cast<long long>(plan.input_bytes),
+             static_cast<long long>(plan.output_bytes),
+             static_cast<long long>(plan.peak_bytes));
+      if (!plan.fits) {
+        fprintf(stderr, "Warning: single tile partitions exceed the memory "
+                "budget\n");
+      }
+    }
+  }
 
   partitions = BlockPartition(rank,
                               process_count,
-                              output_raster->y_size,
-                              output_raster->x_size,
-                              output_raster->block_x_size,
-                              conf.partition_size);
+                              output_descriptor.row_count,
+                              output_descriptor.column_count,
+                              conf.tile_size,
+                              partition_size);
+
+  // Rank 0 creates the output rasters. Their headers are written directly
+  // and every process computes the tile offsets from the layout. With
+  // --rank-layout the tiles of each process are stored together, in the
+  // order the process writes them. Compressed tiles are always stored in the
+  // order they are written.
+  const bool rank_layout = conf.rank_layout && !compressed;
+  vector<int64_t> tile_order;
+  if (rank_layout) {
+    tile_order = librasterblaster::PartitionTileOrder(
+        process_count,
+        output_descriptor.row_count,
+        output_descriptor.column_count,
+        conf.tile_size,
+        partition_size);
+  }
+  const vector<int64_t> *output_tile_order =
+      rank_layout ? &tile_order : NULL;
+
+  // The MPI-IO hints apply to the output files, striping hints only when
+  // they are created. Tiles are aligned to the stripes unless told otherwise.
+  MPI_Info output_info = MPI_INFO_NULL;
+  int64_t tile_alignment = conf.tile_alignment;
+  string mpi_hints = "";
+  if (!conf.mpi_hints.empty()) {
+    MPI_Info_create(&output_info);
+  }
+  for (size_t i = 0; i < conf.mpi_hints.size(); ++i) {
+    const string &key = conf.mpi_hints[i].first;
+    const string &value = conf.mpi_hints[i].second;
+    MPI_Info_set(output_info, const_cast<char*>(key.c_str()),
+                 const_cast<char*>(value.c_str()));
+    if (key == "striping_unit" && conf.tile_alignment == 0 && !compressed) {
+      tile_alignment = strtoll(value.c_str(), NULL, 10);
+    }
+    mpi_hints += (i == 0 ? "" : ";") + key + "=" + value;
+  }
+  // Cloud Optimized GeoTIFF output has overviews down to a single tile
+  const int overview_count = conf.cog
+      ? sptw::cog_overview_count(output_descriptor.column_count,
+                                 output_descriptor.row_count,
+                                 conf.tile_size)
+      : 0;
+  // Skipped tiles read as the nodata value of the file, which is the fill
+  // value when it is not empty
+  const string sparse_nodata = conf.sparse ? conf.fillvalue : "";
+  sptw::RasterLayout output_layout;
+  if (rank == 0) {
+    printf("Creating output raster...");
+    GDALColorTable *ct = input_raster->GetRasterBand(1)->GetColorTable();
+    for (size_t i = 0; i < output_filenames.size(); ++i) {
+      SPTW_ERROR sperr = sptw::create_raster_direct(
+          output_filenames[i],
+          output_descriptor.column_count,
+          output_descriptor.row_count,
+          output_descriptor.band_count,
+          output_descriptor.pixel_type,
+          output_descriptor.geotransform,
+          output_descriptor.projection,
+          conf.tile_size,
+          tile_alignment,
+          compression,
+          conf.compression_level,
+          ct,
+          &output_layout,
+          output_tile_order,
+          output_info,
+          overview_count,
+          sparse_nodata);
+      if (sperr != sptw::SP_None) {
+        fprintf(stderr, "Error creating raster!: %d\n", sperr);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+        return PRB_IOERROR;
+      }
+    }
+    printf("done\n");
+  }
+
+  // Every output file has the same layout
+  MPI_Bcast(&output_layout, sizeof(output_layout), MPI_BYTE, 0,
+            MPI_COMM_WORLD);
+  vector<PTIFF*> output_rasters(output_filenames.size());
+  for (size_t i = 0; i < output_filenames.size(); ++i) {
+    output_rasters[i] = open_raster(output_filenames[i], output_layout,
+                                    output_tile_order, output_info);
+    if (output_rasters[i] == NULL) {
+      fprintf(stderr, "Could not open output raster\n");
+      MPI_Abort(MPI_COMM_WORLD, 1);
+      return PRB_IOERROR;
+    }
+  }
+  // The overviews of each output, and the grid of every level, the full
+  // resolution being level 0
+  vector<vector<PTIFF*> > overview_rasters(output_filenames.size());
+  vector<RasterDescriptor> level_descriptors(1, output_descriptor);
+  for (int l = 1; l <= overview_count; ++l) {
+    level_descriptors.push_back(OverviewDescriptor(output_descriptor, l));
+    for (size_t i = 0; i < output_filenames.size(); ++i) {
+      overview_rasters[i].push_back(sptw::open_overview(output_rasters[i],
+                                                        output_layout, l));
+      if (overview_rasters[i].back() == NULL) {
+        fprintf(stderr, "Could not open output overview\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+        return PRB_IOERROR;
+      }
+    }
+  }
+  // Partitions are made of whole tiles, so they hold every pixel of the
+  // overview pixels they cover as long as the tile size is a multiple of
+  // the scale of the overview. Those overviews are computed from the output
+  // chunks, the others from the level before them once it is written.
+  int memory_levels = 0;
+  while (memory_levels < overview_count
+         && conf.tile_size % (2 << memory_levels) == 0) {
+    ++memory_levels;
+  }
+  // With --sparse the tiles that only hold the fill value are not written,
+  // except on the levels that are read back to compute the next overview
+  vector<bool> sparse_levels(overview_count + 1, conf.sparse);
+  for (int l = memory_levels; l < overview_count; ++l) {
+    sparse_levels[l] = false;
+  }
+  long long sparse_tiles = 0;
+  vector<int64_t>().swap(tile_order);
+  if (output_info != MPI_INFO_NULL) {
+    MPI_Info_free(&output_info);
+  }
 
   if (rank == 0) {
     printf("Typical process has %lu partitions with base size: %d\n",
            static_cast<unsigned long>(partitions.size()),
-           conf.partition_size);
+           partition_size);
   }
-  double read_total, misc_start, misc_total;
+  double read_start, read_total, misc_start, misc_total;
   double write_start, write_end, write_total;
   double resample_start, resample_end, resample_total;
   double loop_start, prelude_end, minbox_total;
@@ -206,19 +726,88 @@ PRB_ERROR prasterblasterpio(Configuration conf) {
   read_total = write_total = resample_total = misc_total = minbox_total = 0.0;
   preloop_time = MPI_Wtime() - start_time;
 
+  // With --read-footprint the minbox search also records which input blocks
+  // the output pixel footprints touch, and only those are read
+  const int input_block_width = input_descriptor.block_width;
+  const int input_block_height = input_descriptor.block_height;
+  const int64_t input_pixel_size = static_cast<int64_t>(
+      GDALGetDataTypeSize(input_descriptor.pixel_type) / 8)
+      * input_descriptor.band_count;
+  int64_t input_bytes = 0;
+
+  vector<RasterChunk*> out_chunks(resamplers.size());
+
+  // Collective writes are made by every process, so processes with fewer
+  // partitions keep looping and write nothing
+  unsigned long loop_count = partitions.size();
+  if (conf.collective_write || compressed) {
+    unsigned long partition_count = partitions.size();
+    MPI_Allreduce(&partition_count, &loop_count, 1, MPI_UNSIGNED_LONG,
+                  MPI_MAX, MPI_COMM_WORLD);
+  }
+
   // Now we loop through the returned partitions
-  for (size_t i = 0; i < partitions.size(); ++i) {
+  for (size_t i = 0; i < loop_count; ++i) {
+    if (i >= partitions.size()) {
+      write_start = MPI_Wtime();
+      for (size_t j = 0; j < output_rasters.size(); ++j) {
+        const sptw::SPTW_ERROR sperr = compressed
+            ? sptw::write_area_compressed(output_rasters[j], NULL, 0,
+                                          0, 0, -1, -1)
+            : sptw::write_area_all(output_rasters[j], NULL, 0, 0, 0, -1, -1);
+        if (sperr != sptw::SP_None) {
+          fprintf(stderr, "Rank %d: Error writing chunk!\n", rank);
+          MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+      }
+      write_total += MPI_Wtime() - write_start;
+      continue;
+    }
     loop_start = MPI_Wtime();
 
     // Now we use the ProjectedRaster object we created for the input file to
-    // create a RasterChunk that has the pixel values read into it.
-    in_chunk = RasterChunk::CreateRasterChunk(input_raster,
-                                              gdal_output_raster,
-                                              partitions.at(i));
+    // create a RasterChunk that has the pixel values read into it. The read
+    // overwrites every pixel the kernels use so the buffer is not zeroed.
+    BlockResidency residency(input_block_width, input_block_height);
+    // The tile minboxes of the partition plan already cover the partition,
+    // unless the footprint blocks are needed too
+    const Area in_area = !tile_minboxes.empty() && !conf.read_footprint
+        ? librasterblaster::TileMinboxUnion(tile_minboxes,
+                                            output_descriptor.column_count,
+                                            conf.tile_size,
+                                            partitions.at(i))
+        : librasterblaster::RasterMinbox(output_descriptor,
+                                         input_descriptor,
+                                         partitions.at(i),
+                                         conf.read_footprint ? &residency
+                                         : NULL);
+    in_chunk = RasterChunk::CreateRasterChunk(input_descriptor,
+                                              in_area,
+                                              false,
+                                              conf.row_alignment);
     minbox_total += MPI_Wtime() - loop_start;
 
     prelude_end = MPI_Wtime();
-    PRB_ERROR chunk_err = RasterChunk::ReadRasterChunk(input_raster, in_chunk);
+    PRB_ERROR chunk_err = PRB_NOERROR;
+    const Area in_chunk_area(in_chunk->raster_location_.x,
+                             in_chunk->raster_location_.y,
+                             in_chunk->raster_location_.x
+                             + in_chunk->column_count_ - 1,
+                             in_chunk->raster_location_.y
+                             + in_chunk->row_count_ - 1);
+    if (residency.resident.empty()) {
+      input_bytes += in_chunk->row_count_ * in_chunk->column_count_
+          * input_pixel_size;
+    } else {
+      input_bytes += residency.ResidentPixels(in_chunk_area)
+          * input_pixel_size;
+    }
+    if (mapped_input != NULL) {
+      chunk_err = mapped_input->ReadRasterChunk(in_chunk, &residency);
+    } else {
+      chunk_err = RasterChunk::ReadRasterChunk(input_raster, in_chunk,
+                                               residency);
+    }
     if (chunk_err != PRB_NOERROR) {
       fprintf(stderr, "Error reading input chunk!\n");
       MPI_Abort(MPI_COMM_WORLD, 1);
@@ -229,27 +818,43 @@ PRB_ERROR prasterblasterpio(Configuration conf) {
     misc_start = MPI_Wtime();
     // We want a RasterChunk for the output area but we area going to generate
     // the pixel values not read them from the file so we use
-    // CreateRasterChunk
-    out_chunk = RasterChunk::CreateRasterChunk(gdal_output_raster,
-                                               partitions.at(i));
-    if (out_chunk == NULL) {
-      fprintf(stderr, "Error allocating output chunk! %f %f %f %f\n",
-              partitions[i].ul.x,
-              partitions[i].ul.y,
-              partitions[i].lr.x,
-              partitions[i].lr.y);
-      return PRB_BADARG;
+    // CreateRasterChunk. Every output pixel is assigned, so the buffers are
+    // not zeroed either.
+    for (size_t j = 0; j < out_chunks.size(); ++j) {
+      out_chunks[j] = RasterChunk::CreateRasterChunk(output_descriptor,
+                                                     partitions.at(i),
+                                                     false,
+                                                     conf.row_alignment);
+      if (out_chunks[j] == NULL) {
+        fprintf(stderr, "Error allocating output chunk! %f %f %f %f\n",
+                partitions[i].ul.x,
+                partitions[i].ul.y,
+                partitions[i].lr.x,
+                partitions[i].lr.y);
+        return PRB_BADARG;
+      }
     }
     misc_total += MPI_Wtime() - misc_start;
 
     // Now we call ReprojectChunk with the RasterChunk pair and the desired
     // resampler. ReprojectChunk performs the reprojection/resampling and fills
-    // the output RasterChunk with the new values.
+    // the output RasterChunk with the new values. ReprojectChunkMulti does the
+    // same for several resamplers in a single pass.
     resample_start = MPI_Wtime();
-    bool ret = ReprojectChunk(in_chunk,
-                              out_chunk,
-                              conf.fillvalue,
-                              conf.resampler);
+    bool ret = false;
+    if (out_chunks.size() == 1) {
+      ret = ReprojectChunk(in_chunk,
+                           out_chunks[0],
+                           conf.fillvalue,
+                           resamplers[0],
+                           conf.thread_count);
+    } else {
+      ret = ReprojectChunkMulti(in_chunk,
+                                out_chunks,
+                                conf.fillvalue,
+                                resamplers,
+                                conf.thread_count);
+    }
     if (ret == false) {
             fprintf(stderr, "Error reprojecting chunk!\n");
             MPI_Abort(MPI_COMM_WORLD, 1);
@@ -260,18 +865,83 @@ PRB_ERROR prasterblasterpio(Configuration conf) {
     write_start = MPI_Wtime();
     PRB_ERROR err;
 
-    err = write_rasterchunk(output_raster,
-                            out_chunk);
-    if (err != PRB_NOERROR) {
-      fprintf(stderr, "Rank %d: Error writing chunk!\n", rank);
-      MPI_Abort(MPI_COMM_WORLD, 1);
+    for (size_t j = 0; j < out_chunks.size() && sparse_levels[0]; ++j) {
+      sparse_tiles += SkipFillTiles(output_rasters[j], out_chunks[j],
+                                    conf.fillvalue);
+    }
+
+    if (async_write) {
+      // The previous partition was written while this one was computed
+      if (sptw::wait_write(&pending_writes) != sptw::SP_None) {
+        fprintf(stderr, "Rank %d: Error writing chunk!\n", rank);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+      }
+      for (size_t j = 0; j < pending_chunks.size(); ++j) {
+        delete pending_chunks[j];
+      }
+      pending_chunks = out_chunks;
+    }
+    for (size_t j = 0; j < out_chunks.size(); ++j) {
+      if (async_write) {
+        err = write_rasterchunk_async(output_rasters[j],
+                                      out_chunks[j],
+                                      &pending_writes);
+      } else if (compressed) {
+        err = write_rasterchunk_compressed(output_rasters[j], out_chunks[j]);
+      } else {
+        err = write_rasterchunk(output_rasters[j],
+                                out_chunks[j],
+                                conf.collective_write);
+      }
+      if (err != PRB_NOERROR) {
+        fprintf(stderr, "Rank %d: Error writing chunk!\n", rank);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+      }
     }
     write_end = MPI_Wtime();
     write_total += write_end - write_start;
 
+    for (size_t j = 0; j < out_chunks.size() && memory_levels > 0; ++j) {
+      RasterChunk *level_chunk = out_chunks[j];
+      for (int l = 1; l <= memory_levels; ++l) {
+        resample_start = MPI_Wtime();
+        RasterChunk *overview_chunk = DownsampleRasterChunk(
+            level_chunk,
+            level_descriptors[l],
+            resamplers[j],
+            conf.fillvalue,
+            conf.row_alignment);
+        if (level_chunk != out_chunks[j]) {
+          delete level_chunk;
+        }
+        if (overview_chunk == NULL) {
+          fprintf(stderr, "Error downsampling chunk!\n");
+          MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        resample_total += MPI_Wtime() - resample_start;
+
+        write_start = MPI_Wtime();
+        if (sparse_levels[l]) {
+          sparse_tiles += SkipFillTiles(overview_rasters[j][l - 1],
+                                        overview_chunk,
+                                        conf.fillvalue);
+        }
+        if (write_rasterchunk(overview_rasters[j][l - 1], overview_chunk)
+            != PRB_NOERROR) {
+          fprintf(stderr, "Rank %d: Error writing chunk!\n", rank);
+          MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        write_total += MPI_Wtime() - write_start;
+        level_chunk = overview_chunk;
+      }
+      delete level_chunk;
+    }
+
     misc_start = MPI_Wtime();
     delete in_chunk;
-    delete out_chunk;
+    for (size_t j = 0; j < out_chunks.size() && !async_write; ++j) {
+      delete out_chunks[j];
+    }
 
     if (rank == 0) {
       printf(" %d%% ",
@@ -287,13 +957,113 @@ PRB_ERROR prasterblasterpio(Configuration conf) {
 
   // Clean up
   write_start = MPI_Wtime();
-  close_raster(output_raster);
+  if (sptw::wait_write(&pending_writes) != sptw::SP_None) {
+    fprintf(stderr, "Rank %d: Error writing chunk!\n", rank);
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  }
+  for (size_t j = 0; j < pending_chunks.size(); ++j) {
+    delete pending_chunks[j];
+  }
+  write_total += MPI_Wtime() - write_start;
+
+  // The tiles of the other overviews cover pixels written by several
+  // processes. Each level is read back from the file once every process has
+  // written it and its tiles are shared out among the processes.
+  for (int l = memory_levels + 1; l <= overview_count; ++l) {
+    write_start = MPI_Wtime();
+    for (size_t j = 0; j < output_rasters.size(); ++j) {
+      if (sptw::sync_raster(output_rasters[j]) != sptw::SP_None) {
+        fprintf(stderr, "Rank %d: Error writing chunk!\n", rank);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+      }
+    }
+    write_total += MPI_Wtime() - write_start;
+
+    const RasterDescriptor &previous = level_descriptors[l - 1];
+    const RasterDescriptor &overview = level_descriptors[l];
+    const int64_t tile_size = conf.tile_size;
+    const int64_t tiles_across = (overview.column_count + tile_size - 1)
+        / tile_size;
+    const int64_t tiles_down = (overview.row_count + tile_size - 1)
+        / tile_size;
+    for (int64_t t = rank; t < tiles_across * tiles_down;
+         t += process_count) {
+      const int64_t ul_x = (t % tiles_across) * tile_size;
+      const int64_t ul_y = (t / tiles_across) * tile_size;
+      const Area source_area(
+          2 * ul_x,
+          2 * ul_y,
+          std::min(2 * (ul_x + tile_size) - 1, previous.column_count - 1),
+          std::min(2 * (ul_y + tile_size) - 1, previous.row_count - 1));
+      for (size_t j = 0; j < output_rasters.size(); ++j) {
+        PTIFF *source_raster = l == 1 ? output_rasters[j]
+            : overview_rasters[j][l - 2];
+        RasterChunk *source_chunk = RasterChunk::CreateRasterChunk(
+            previous, source_area, false, conf.row_alignment);
+        read_start = MPI_Wtime();
+        if (source_chunk == NULL
+            || sptw::read_area_strided(source_raster,
+                                       source_chunk->pixels_,
+                                       source_chunk->row_stride_,
+                                       source_area.ul.x,
+                                       source_area.ul.y,
+                                       source_area.lr.x,
+                                       source_area.lr.y) != sptw::SP_None) {
+          fprintf(stderr, "Rank %d: Error reading overview!\n", rank);
+          MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        read_total += MPI_Wtime() - read_start;
+
+        resample_start = MPI_Wtime();
+        RasterChunk *overview_chunk = DownsampleRasterChunk(
+            source_chunk,
+            overview,
+            resamplers[j],
+            conf.fillvalue,
+            conf.row_alignment);
+        delete source_chunk;
+        if (overview_chunk == NULL) {
+          fprintf(stderr, "Error downsampling chunk!\n");
+          MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        resample_total += MPI_Wtime() - resample_start;
+
+        write_start = MPI_Wtime();
+        if (sparse_levels[l]) {
+          sparse_tiles += SkipFillTiles(overview_rasters[j][l - 1],
+                                        overview_chunk,
+                                        conf.fillvalue);
+        }
+        if (write_rasterchunk(overview_rasters[j][l - 1], overview_chunk)
+            != PRB_NOERROR) {
+          fprintf(stderr, "Rank %d: Error writing chunk!\n", rank);
+          MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        write_total += MPI_Wtime() - write_start;
+        delete overview_chunk;
+      }
+    }
+  }
+
+  write_start = MPI_Wtime();
+  for (size_t i = 0; i < output_rasters.size(); ++i) {
+    for (size_t l = 0; l < overview_rasters[i].size(); ++l) {
+      if (close_raster(overview_rasters[i][l]) != sptw::SP_None) {
+        fprintf(stderr, "Rank %d: Error writing overview tile offsets!\n",
+                rank);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+      }
+    }
+    if (close_raster(output_rasters[i]) != sptw::SP_None) {
+      fprintf(stderr, "Rank %d: Error writing tile offsets!\n", rank);
+      MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+  }
   write_total += MPI_Wtime() - write_start;
 
   misc_start = MPI_Wtime();
-  output_raster = NULL;
-  delete gdal_output_raster;
   delete input_raster;
+  delete mapped_input;
   misc_total += MPI_Wtime() - misc_start;
 
   // Report runtimes
@@ -316,6 +1086,33 @@ PRB_ERROR prasterblasterpio(Configuration conf) {
              MPI_COMM_WORLD);
   double averages[7] = { 0.0 };
 
+  // Chunk buffer pool usage for each process: hits, misses, huge page
+  // allocations and NUMA-bound allocations, followed by the bytes of input
+  // read
+  ChunkBufferPool::Statistics pool_stats =
+      ChunkBufferPool::Instance()->statistics();
+  long long pool_counts[5] = { pool_stats.hits,
+                               pool_stats.misses,
+                               pool_stats.huge_page_allocations,
+                               pool_stats.numa_allocations,
+                               static_cast<long long>(input_bytes) };
+  std::vector<long long> process_pool_counts(process_count*5);
+  MPI_Gather(pool_counts,
+             5,
+             MPI_LONG_LONG,
+             &(process_pool_counts[0]),
+             5,
+             MPI_LONG_LONG,
+             0,
+             MPI_COMM_WORLD);
+  long long pool_totals[5] = { 0, 0, 0, 0, 0 };
+  long long sparse_total = 0;
+  MPI_Reduce(&sparse_tiles, &sparse_total, 1, MPI_LONG_LONG, MPI_SUM, 0,
+             MPI_COMM_WORLD);
+  for (unsigned int i = 0; i < process_pool_counts.size(); i++) {
+    pool_totals[i % 5] += process_pool_counts[i];
+  }
+
   for (unsigned int i = 0; i < process_runtimes.size(); i++) {
     averages[i % 7] += process_runtimes[i];
   }
@@ -334,6 +1131,22 @@ PRB_ERROR prasterblasterpio(Configuration conf) {
            averages[4],
            averages[5],
            averages[6]);
+    printf("Chunk buffer pool: %lld hits, %lld misses\n",
+           pool_totals[0],
+           pool_totals[1]);
+    printf("Huge pages above %lld bytes: %lld allocations, "
+           "NUMA binding %s: %lld allocations\n",
+           static_cast<long long>(conf.huge_page_threshold),
+           pool_totals[2],
+           conf.numa_binding ? "on" : "off",
+           pool_totals[3]);
+    printf("Input read: %lld bytes%s\n",
+           pool_totals[4],
+           conf.read_footprint ? ", footprint blocks only" : "");
+    if (conf.sparse) {
+      printf("Sparse output: %lld fill tiles left unallocated\n",
+             sparse_total);
+    }
   }
 
   FILE *timing_file = stdout;
@@ -349,8 +1162,14 @@ PRB_ERROR prasterblasterpio(Configuration conf) {
     struct timeval time;
     gettimeofday(&time, NULL);
     fprintf(timing_file, "finish_time,process_count,total,preloop,minbox,read"
-            ",resample,write,misc\n");
-    fprintf(timing_file, "%lld,%d,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f\n",
+            ",resample,write,misc,pool_hits,pool_misses,huge_page_threshold"
+            ",numa_binding,huge_page_allocations,numa_allocations"
+            ",read_footprint,input_bytes,collective_write,async_write"
+            ",rank_layout,tile_alignment,mpi_hints,compression"
+            ",overview_count,sparse_tiles\n");
+    fprintf(timing_file,
+            "%lld,%d,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%lld,%lld,%lld,%d"
+            ",%lld,%lld,%d,%lld,%d,%d,%d,%lld,%s,%s,%d,%lld\n",
             static_cast<long long>(time.tv_sec),
             process_count,
             averages[0],
@@ -359,12 +1178,31 @@ PRB_ERROR prasterblasterpio(Configuration conf) {
             averages[3],
             averages[4],
             averages[5],
-            averages[6]);
+            averages[6],
+            pool_totals[0],
+            pool_totals[1],
+            static_cast<long long>(conf.huge_page_threshold),
+            conf.numa_binding ? 1 : 0,
+            pool_totals[2],
+            pool_totals[3],
+            conf.read_footprint ? 1 : 0,
+            pool_totals[4],
+            conf.collective_write ? 1 : 0,
+            async_write ? 1 : 0,
+            rank_layout ? 1 : 0,
+            static_cast<long long>(tile_alignment),
+            mpi_hints.c_str(),
+            conf.compression.c_str(),
+            overview_count,
+            sparse_total);
 
     fprintf(timing_file, "process,total,preloop,minbox,read,resample"
-            ",write,misc\n");
+            ",write,misc,pool_hits,pool_misses,huge_page_allocations"
+            ",numa_allocations,input_bytes\n");
     for (unsigned int i = 0; i < process_runtimes.size(); i+=7) {
-      fprintf(timing_file, "%u,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f\n",
+      fprintf(timing_file,
+              "%u,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%lld,%lld,%lld,%lld"
+              ",%lld\n",
               i/7,
               process_runtimes.at(i),
               process_runtimes.at(i+1),
@@ -372,7 +1210,12 @@ PRB_ERROR prasterblasterpio(Configuration conf) {
               process_runtimes.at(i+3),
               process_runtimes.at(i+4),
               process_runtimes.at(i+5),
-              process_runtimes.at(i+6));
+              process_runtimes.at(i+6),
+              process_pool_counts.at(5*(i/7)),
+              process_pool_counts.at(5*(i/7)+1),
+              process_pool_counts.at(5*(i/7)+2),
+              process_pool_counts.at(5*(i/7)+3),
+              process_pool_counts.at(5*(i/7)+4));
     }
   }
   if (rank == 0 && conf.timing_filename != "") {
@@ -21,6 +21,7 @@
 
 #include "src/configuration.h"
 #include "src/demos/sptw.h"
+#include "src/rasterchunk.h"
 #include "src/utils.h"
 
 namespace librasterblaster {
@@ -34,6 +35,29 @@ namespace librasterblaster {
 PRB_ERROR write_rasterchunk(sptw::PTIFF *ptiff,
                             RasterChunk *chunk);
 
+/**
+ * @brief write_rasterchunk writes the pixels of view to the PTIFF ptiff. The
+ * view may be a window of a larger chunk, its rows are written in place
+ * without copying them into a contiguous buffer first.
+ *
+ * @param ptiff PTIFF target for output
+ * @param view RasterChunkView to be written to file
+ *
+ */
+PRB_ERROR write_rasterchunk(sptw::PTIFF *ptiff,
+                            const RasterChunkView &view);
+
+/**
+ * @brief StatisticFilename returns the name of the output file that receives
+ * the result of resampler when several resamplers are evaluated in one job,
+ * e.g. out.tif becomes out_min.tif.
+ *
+ * @param filename Output filename given in the Configuration
+ * @param resampler Resampler that is written to the returned file
+ *
+ */
+std::string StatisticFilename(std::string filename, RESAMPLER resampler);
+
 /**
  * @brief prasterblasterpio performs a complete, potentially parallel, raster
  * reprojection job using the parameters specified by conf.
@@ -18,13 +18,20 @@
 #include "src/demos/sptw.h"
 
 #include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
 #include <gdal_priv.h>
 #include <cpl_string.h>
+#include <cpl_vsi.h>
 #include <ogr_api.h>
 #include <ogr_spatialref.h>
 #include <mpi.h>
 #include <tiff.h>
 #include <tiffio.h>
+#include <zlib.h>
+#ifdef PRB_HAVE_ZSTD
+#include <zstd.h>
+#endif
 
 #include <algorithm>
 #include <sstream>
@@ -145,6 +152,16 @@ int16_t parse_int16(uint8_t *buffer, bool big_endian) {
     return (buffer[0]<<0 | buffer[1]<<8);
 }
 
+void export_int16(int16_t num, uint8_t *buffer, bool big_endian) {
+  if (big_endian) {
+    buffer[0] = (num>>8);
+    buffer[1] = (num>>0);
+  } else {
+    buffer[1] = (num>>8);
+    buffer[0] = (num>>0);
+  }
+}
+
 int64_t read_int64(PTIFF *tiff_file, int64_t offset, bool big_endian) {
   uint8_t read_buffer[8];
   MPI_File_read_at(tiff_file->fh,
@@ -152,7 +169,7 @@ int64_t read_int64(PTIFF *tiff_file, int64_t offset, bool big_endian) {
                    read_buffer,
                    sizeof(int64_t),
                    MPI_BYTE,
-                   NULL);
+                   MPI_STATUS_IGNORE);
   return parse_int64(read_buffer, big_endian);
 }
 
@@ -170,95 +187,841 @@ int write_int64(PTIFF *tiff_file,
   return 0;
 }
 
+// Writes size bytes at offset. MPI counts are ints, so writes larger than
+// INT_MAX bytes are issued in pieces.
+SPTW_ERROR write_bytes(PTIFF *tiff_file,
+                       int64_t offset,
+                       const char *buffer,
+                       int64_t size) {
+  MPI_Status status;
+  while (size > 0) {
+    const int count = static_cast<int>(std::min<int64_t>(size, INT_MAX));
+    if (MPI_File_write_at(tiff_file->fh,
+                          offset,
+                          const_cast<char*>(buffer),
+                          count,
+                          MPI_BYTE,
+                          &status) != MPI_SUCCESS) {
+      return SP_WriteError;
+    }
+    offset += count;
+    buffer += count;
+    size -= count;
+  }
+  return SP_None;
+}
+
+// Parses a TIFF integer of value_size bytes, 2, 4 or 8
+int64_t parse_value(uint8_t *buffer, int value_size, bool big_endian) {
+  uint8_t value[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+  memcpy(big_endian ? value + 8 - value_size : value, buffer, value_size);
+  return parse_int64(value, big_endian);
+}
+
+// Exports the values as TIFF integers of value_size bytes, 2, 4 or 8
+void export_values(const std::vector<int64_t> &values,
+                   int value_size,
+                   bool big_endian,
+                   std::vector<uint8_t> *buffer) {
+  buffer->resize(values.size() * value_size);
+  uint8_t value[8];
+  for (size_t i = 0; i < values.size(); ++i) {
+    export_int64(values[i], value, big_endian);
+    memcpy(&(*buffer)[i * value_size],
+           big_endian ? value + 8 - value_size : value,
+           value_size);
+  }
+}
+
+// Returns true if value fits in an unsigned TIFF integer of value_size bytes
+bool value_fits(int64_t value, int value_size) {
+  return value >= 0
+      && (value_size == 8 || value < (static_cast<int64_t>(1)
+                                      << (8 * value_size)));
+}
+
+// Rounds value up to a multiple of alignment, alignments below 2 leave it
+int64_t align_offset(int64_t value, int64_t alignment) {
+  if (alignment < 2) {
+    return value;
+  }
+  return (value + alignment - 1) / alignment * alignment;
+}
+
 SPTW_ERROR populate_tile_offsets(PTIFF *tiff_file,
                                  int64_t tile_size,
                                  int64_t tile_alignment) {
   MPI_Status status;
   bool big_endian = false;   // Is tiff file big endian?
 
-  // Read endianess of file
-  uint8_t endian_flag[2] = { 0x49, 0x49 };
-  MPI_File_read_at(tiff_file->fh, 0, endian_flag, 2, MPI_BYTE, &status);
-  if (endian_flag[0] == 0x4d) {
+  // Byte order, version and offset to the first directory
+  uint8_t header[16];
+  if (MPI_File_read_at(tiff_file->fh, 0, header, 16, MPI_BYTE, &status)
+      != MPI_SUCCESS) {
+    return SP_BadArg;
+  }
+  if (header[0] == 0x4d) {
     big_endian = true;
   }
 
   // Check tiff version, should be 0x002b for BigTiff
-  uint8_t version_data[2];
-  int16_t version = 0;
-  MPI_File_read_at(tiff_file->fh, 2, version_data, 2, MPI_BYTE, &status);
-
-  version = parse_int16(version_data, big_endian);
-
-  if (version != 0x002b) {
+  if (parse_int16(header + 2, big_endian) != 0x002b) {
     // Wrong Tiff version !
     return SP_BadArg;
   }
+  const int64_t doffset = parse_int64(header + 8, big_endian);
 
-  // Read offset to first directory
-  int64_t doffset = 0;
-  doffset = read_int64(tiff_file, 8, big_endian);
-
-  // Read number of directory entries
-  int64_t entry_count = read_int64(tiff_file, doffset, big_endian);
-  // directory offset + sizeof directory count
-  int64_t entry_offset = doffset + sizeof(int64_t);
+  // Read the whole directory, a count followed by 20 byte entries
+  const int64_t entry_count = read_int64(tiff_file, doffset, big_endian);
+  if (entry_count <= 0 || entry_count > 0xffff) {
+    return SP_BadArg;
+  }
+  std::vector<uint8_t> entries(entry_count * 20);
+  if (MPI_File_read_at(tiff_file->fh,
+                       doffset + sizeof(int64_t),
+                       &entries[0],
+                       static_cast<int>(entries.size()),
+                       MPI_BYTE,
+                       &status) != MPI_SUCCESS) {
+    return SP_BadArg;
+  }
 
   int64_t tile_count = 0;
   const int64_t tile_size_bytes = tile_size * tile_size * tiff_file->band_count
       * tiff_file->band_type_size;
   int64_t first_tile_offset = 0;
+  // Location and value size of the offset and byte count arrays
+  int64_t offsets_location = -1, byte_counts_location = -1;
+  int offset_size = 8, byte_count_size = 8;
 
   for (int64_t i = 0; i < entry_count; ++i) {
-    // Read identifying tag of directory entry
-    uint8_t tag_buffer[2];
-    MPI_File_read_at(tiff_file->fh,
-                     entry_offset,
-                     tag_buffer,
-                     2,
-                     MPI_BYTE,
-                     &status);
-    int16_t entry_tag = parse_int16(tag_buffer, big_endian);
-
-    // Read count of elements in entry
-    int64_t element_count = read_int64(tiff_file, entry_offset+4, big_endian);
-
-    // Read entry data
-    int64_t entry_data = read_int64(tiff_file, entry_offset+12, big_endian);
-
-    // Check if directory type is TIFFTAG_TILEOFFSETS
+    uint8_t *entry = &entries[i * 20];
+    const int16_t entry_tag = parse_int16(entry, big_endian);
+    const int value_size = get_type_size(
+        static_cast<TIFFDataType>(parse_int16(entry + 2, big_endian)));
+    const int64_t element_count = parse_int64(entry + 4, big_endian);
+    // Arrays of up to 8 bytes are stored in the entry itself
+    const int64_t data_location =
+        element_count * value_size <= 8
+        ? doffset + static_cast<int64_t>(sizeof(int64_t)) + i * 20 + 12
+        : parse_int64(entry + 12, big_endian);
+
     if (entry_tag == TIFFTAG_TILEOFFSETS) {
-      // Read location of first_offset
-      int64_t first_offset = read_int64(tiff_file, entry_data, big_endian);
-      first_tile_offset = first_offset;
       tile_count = element_count;
+      offset_size = value_size;
+      offsets_location = data_location;
+      uint8_t first[8];
+      MPI_File_read_at(tiff_file->fh, data_location, first, 8, MPI_BYTE,
+                       &status);
+      first_tile_offset = parse_value(first, value_size, big_endian);
+    } else if (entry_tag == TIFFTAG_TILEBYTECOUNTS) {
+      byte_counts_location = data_location;
+      byte_count_size = value_size;
+    }
+  }
+
+  // libtiff stores the arrays in the smallest type their values fit in,
+  // e.g. SHORT byte counts for a file without allocated tiles
+  if (tile_count == 0
+      || (offset_size != 2 && offset_size != 4 && offset_size != 8)
+      || (byte_count_size != 2 && byte_count_size != 4
+          && byte_count_size != 8)) {
+    return SP_BadArg;
+  }
 
-      for (int64_t j = 1; j < element_count; ++j) {
-        write_int64(tiff_file,
-            entry_data+(sizeof(int64_t)*j),
-            first_offset+(tile_size_bytes*j),
-            big_endian);
+  // Files created with SPARSE_OK have no tile allocated, the tiles are then
+  // placed after everything else in the file. So are aligned tiles, which
+  // take more room than the tiles GDAL may have allocated.
+  if (first_tile_offset == 0 || tile_alignment > 1) {
+    MPI_Offset size = 0;
+    MPI_File_get_size(tiff_file->fh, &size);
+    first_tile_offset = align_offset(size, std::max<int64_t>(tile_alignment,
+                                                             8));
+  }
+  // Each tile starts on an alignment boundary, the byte counts stay exact
+  const int64_t tile_stride = align_offset(tile_size_bytes, tile_alignment);
+  // The arrays are rewritten in place, their values must fit their type
+  if (!value_fits(first_tile_offset + tile_stride * (tile_count - 1),
+                  offset_size)
+      || !value_fits(tile_size_bytes, byte_count_size)) {
+    return SP_BadArg;
+  }
+
+  // Both arrays are built in memory and written at once
+  std::vector<int64_t> values(tile_count);
+  std::vector<uint8_t> buffer;
+  SPTW_ERROR err = SP_None;
+  if (offsets_location >= 0) {
+    for (int64_t j = 0; j < tile_count; ++j) {
+      values[j] = first_tile_offset + tile_stride * j;
+    }
+    export_values(values, offset_size, big_endian, &buffer);
+    err = write_bytes(tiff_file, offsets_location,
+                      reinterpret_cast<char*>(&buffer[0]), buffer.size());
+  }
+  if (err == SP_None && byte_counts_location >= 0) {
+    values.assign(tile_count, tile_size_bytes);
+    export_values(values, byte_count_size, big_endian, &buffer);
+    err = write_bytes(tiff_file, byte_counts_location,
+                      reinterpret_cast<char*>(&buffer[0]), buffer.size());
+  }
+  if (err != SP_None) {
+    return err;
+  }
+
+  // Calculate end of file and write to it
+  char end = 0;
+  const int64_t file_size = (tile_count * tile_stride) + first_tile_offset;
+  return write_bytes(tiff_file, file_size - 1, &end, 1);
+}
+
+
+
+// Tags that describe the layout of the image. create_raster_direct writes
+// them for the full raster instead of copying them from the template.
+bool is_layout_tag(int tag) {
+  switch (tag) {
+    case TIFFTAG_SUBFILETYPE:
+    case TIFFTAG_IMAGEWIDTH:
+    case TIFFTAG_IMAGELENGTH:
+    case TIFFTAG_COMPRESSION:
+    case TIFFTAG_STRIPOFFSETS:
+    case TIFFTAG_ROWSPERSTRIP:
+    case TIFFTAG_STRIPBYTECOUNTS:
+    case TIFFTAG_TILEWIDTH:
+    case TIFFTAG_TILELENGTH:
+    case TIFFTAG_TILEOFFSETS:
+    case TIFFTAG_TILEBYTECOUNTS:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// A directory entry, with its value in the byte order of the file
+struct DirectoryEntry {
+  int tag;
+  int type;
+  int64_t count;
+  std::vector<uint8_t> value;
+};
+
+bool entry_compare(const DirectoryEntry &a, const DirectoryEntry &b) {
+  return a.tag < b.tag;
+}
+
+void add_entry(std::vector<DirectoryEntry> *entries,
+               int tag,
+               TIFFDataType type,
+               const std::vector<int64_t> &values,
+               bool big_endian) {
+  DirectoryEntry entry;
+  entry.tag = tag;
+  entry.type = type;
+  entry.count = values.size();
+  export_values(values, get_type_size(type), big_endian, &entry.value);
+  entries->push_back(entry);
+}
+
+// Stores the offset of every tile, indexed in raster order, when the tiles
+// follow each other every tile_stride bytes from first_tile_offset on in
+// tile_order, or in raster order if tile_order is NULL
+void layout_tile_offsets(int64_t tile_count,
+                         int64_t first_tile_offset,
+                         int64_t tile_stride,
+                         const std::vector<int64_t> *tile_order,
+                         int64_t *offsets) {
+  for (int64_t j = 0; j < tile_count; ++j) {
+    const int64_t tile = tile_order == NULL ? j : (*tile_order)[j];
+    offsets[tile] = first_tile_offset + tile_stride * j;
+  }
+}
+
+// Returns true if tile_order holds every tile index below tile_count once
+bool is_tile_order(const std::vector<int64_t> &tile_order,
+                   int64_t tile_count) {
+  if (static_cast<int64_t>(tile_order.size()) != tile_count) {
+    return false;
+  }
+  std::vector<bool> seen(tile_count, false);
+  for (int64_t j = 0; j < tile_count; ++j) {
+    const int64_t tile = tile_order[j];
+    if (tile < 0 || tile >= tile_count || seen[tile]) {
+      return false;
+    }
+    seen[tile] = true;
+  }
+  return true;
+}
+
+// The value of the Compression tag for compression
+int tiff_compression(SPTW_COMPRESSION compression) {
+  switch (compression) {
+    case SP_Deflate:
+      return COMPRESSION_ADOBE_DEFLATE;
+    case SP_LZW:
+      return COMPRESSION_LZW;
+    case SP_ZSTD:
+      return 50000;  // COMPRESSION_ZSTD, not defined by older libtiffs
+    default:
+      return COMPRESSION_NONE;
+  }
+}
+
+// Packs LZW codes most significant bit first
+struct CodeWriter {
+  explicit CodeWriter(std::vector<uint8_t> *out)
+      : out(out), bits(0), bit_count(0) {}
+  void put(int code, int width) {
+    bits = (bits << width) | code;
+    bit_count += width;
+    while (bit_count >= 8) {
+      out->push_back(static_cast<uint8_t>(bits >> (bit_count - 8)));
+      bit_count -= 8;
+    }
+  }
+  void flush() {
+    if (bit_count > 0) {
+      out->push_back(static_cast<uint8_t>(bits << (8 - bit_count)));
+    }
+    bit_count = 0;
+  }
+  std::vector<uint8_t> *out;
+  uint32_t bits;
+  int bit_count;
+};
+
+// Appends the TIFF LZW encoding of size bytes of data to out. Codes grow
+// from 9 to 12 bits as the table fills, as libtiff writes them, and the
+// table is cleared when it is full.
+void lzw_encode(const uint8_t *data,
+                int64_t size,
+                std::vector<uint8_t> *out) {
+  const int kClear = 256, kEnd = 257, kFirstCode = 258, kMaxCode = 4095;
+  // Maps a prefix code and the byte that follows it to the code of both,
+  // with open addressing
+  const int kHashSize = 9001;
+  std::vector<int32_t> keys(kHashSize, -1);
+  std::vector<int16_t> codes(kHashSize);
+
+  CodeWriter writer(out);
+  int width = 9;
+  int next_code = kFirstCode;
+  writer.put(kClear, width);
+  int prefix = size > 0 ? data[0] : -1;
+  for (int64_t i = 1; i < size; ++i) {
+    const int32_t key = (prefix << 8) | data[i];
+    int h = key % kHashSize;
+    while (keys[h] != -1 && keys[h] != key) {
+      h = h + 1 == kHashSize ? 0 : h + 1;
+    }
+    if (keys[h] == key) {
+      prefix = codes[h];
+      continue;
+    }
+    writer.put(prefix, width);
+    keys[h] = key;
+    codes[h] = static_cast<int16_t>(next_code++);
+    if (next_code == kMaxCode - 1) {
+      writer.put(kClear, width);
+      std::fill(keys.begin(), keys.end(), -1);
+      width = 9;
+      next_code = kFirstCode;
+    } else if (next_code > (1 << width) - 1) {
+      ++width;
+    }
+    prefix = data[i];
+  }
+  if (prefix >= 0) {
+    writer.put(prefix, width);
+    // Decoders add a table entry for the last code as well
+    if (++next_code == kMaxCode - 1) {
+      writer.put(kClear, width);
+      width = 9;
+    } else if (next_code > (1 << width) - 1) {
+      ++width;
+    }
+  }
+  writer.put(kEnd, width);
+  writer.flush();
+}
+
+// Appends the compressed size bytes of tile to out, false on error
+bool compress_tile(SPTW_COMPRESSION compression,
+                   int level,
+                   const uint8_t *tile,
+                   int64_t size,
+                   std::vector<uint8_t> *out) {
+  const size_t start = out->size();
+  switch (compression) {
+    case SP_Deflate: {
+      uLongf compressed_size = compressBound(size);
+      out->resize(start + compressed_size);
+      if (compress2(&(*out)[start], &compressed_size, tile, size,
+                    level < 0 ? Z_DEFAULT_COMPRESSION : level) != Z_OK) {
+        return false;
       }
-    } else if (entry_tag == TIFFTAG_TILEBYTECOUNTS) {
-      for (int64_t j = 1; j < element_count; ++j) {
-        write_int64(tiff_file,
-                    entry_data+(sizeof(int64_t)*j),
-                    tile_size_bytes,
-                    big_endian);
+      out->resize(start + compressed_size);
+      return true;
+    }
+    case SP_LZW:
+      lzw_encode(tile, size, out);
+      return true;
+#ifdef PRB_HAVE_ZSTD
+    case SP_ZSTD: {
+      out->resize(start + ZSTD_compressBound(size));
+      const size_t compressed_size = ZSTD_compress(&(*out)[start],
+                                                   out->size() - start,
+                                                   tile,
+                                                   size,
+                                                   level < 0 ? 9 : level);
+      if (ZSTD_isError(compressed_size)) {
+        return false;
+      }
+      out->resize(start + compressed_size);
+      return true;
+    }
+#endif
+    default:
+      return false;
+  }
+}
+
+// Returns true if sptw was built with compression
+bool compression_supported(SPTW_COMPRESSION compression) {
+#ifndef PRB_HAVE_ZSTD
+  if (compression == SP_ZSTD) {
+    return false;
+  }
+#endif
+  return compression >= SP_Uncompressed && compression <= SP_ZSTD;
+}
+
+// GeoTIFF tags, which only the full resolution image carries
+bool is_geotiff_tag(int tag) {
+  switch (tag) {
+    case 33550:  // ModelPixelScaleTag
+    case 33922:  // ModelTiepointTag
+    case 34264:  // ModelTransformationTag
+    case 34735:  // GeoKeyDirectoryTag
+    case 34736:  // GeoDoubleParamsTag
+    case 34737:  // GeoAsciiParamsTag
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Size of a dimension of image level, level 0 being the full resolution.
+// Each overview level halves the one before it, rounding up.
+int64_t level_size(int64_t size, int level) {
+  return (size + (static_cast<int64_t>(1) << level) - 1) >> level;
+}
+
+int64_t level_tile_count(int64_t x_size,
+                         int64_t y_size,
+                         int64_t tile_size,
+                         int level) {
+  return ((level_size(x_size, level) + tile_size - 1) / tile_size)
+      * ((level_size(y_size, level) + tile_size - 1) / tile_size);
+}
+
+// Byte offset of the first tile of image level when the tiles of all the
+// images are stored from first_tile_offset on, every tile_stride bytes. As
+// in Cloud Optimized GeoTIFFs the smallest overview comes first and the
+// full resolution last.
+int64_t level_first_tile_offset(int64_t first_tile_offset,
+                                int64_t x_size,
+                                int64_t y_size,
+                                int64_t tile_size,
+                                int64_t tile_stride,
+                                int overview_count,
+                                int level) {
+  int64_t offset = first_tile_offset;
+  for (int l = overview_count; l > level; --l) {
+    offset += level_tile_count(x_size, y_size, tile_size, l) * tile_stride;
+  }
+  return offset;
+}
+
+int cog_overview_count(int64_t x_size, int64_t y_size, int64_t tile_size) {
+  int count = 0;
+  while (tile_size > 0
+         && (level_size(x_size, count) > tile_size
+             || level_size(y_size, count) > tile_size)) {
+    ++count;
+  }
+  return count;
+}
+
+// Builds everything in front of the tiles of a tiled BigTIFF of x_size by
+// y_size pixels of pixel_size bytes: the header, the directory of the full
+// resolution image followed by those of overview_count overviews, the
+// values that do not fit in their entries and the tile offset and byte count
+// arrays. Tags other than the layout tags, such as the GeoTIFF keys, are
+// copied from the template, a BigTIFF with the band count, pixel type and
+// georeferencing of the raster. The overviews get the same tags but the
+// GeoTIFF ones. The tiles are stored from first_tile_offset on, as laid out
+// by level_first_tile_offset and layout_tile_offsets, each at a multiple of
+// tile_alignment bytes. Compressed tiles are placed as they are written, so
+// their offsets and byte counts are left 0 and only the locations of the
+// two arrays of the full resolution are returned.
+SPTW_ERROR build_direct_header(const std::vector<uint8_t> &template_bytes,
+                               int64_t x_size,
+                               int64_t y_size,
+                               int64_t tile_size,
+                               int64_t pixel_size,
+                               int64_t tile_alignment,
+                               int compression,
+                               int overview_count,
+                               const std::vector<int64_t> *tile_order,
+                               std::vector<uint8_t> *header,
+                               int64_t *first_tile_offset,
+                               int64_t *tile_offsets_location,
+                               int64_t *tile_byte_counts_location) {
+  const int64_t template_size = template_bytes.size();
+  if (template_size < 16 || overview_count < 0) {
+    return SP_BadArg;
+  }
+  uint8_t *tmpl = const_cast<uint8_t*>(&template_bytes[0]);
+  const bool big_endian = tmpl[0] == 0x4d;
+  if (parse_int16(tmpl + 2, big_endian) != 0x002b) {
+    return SP_BadArg;
+  }
+  const int64_t doffset = parse_int64(tmpl + 8, big_endian);
+  if (doffset < 16 || doffset > template_size - 8) {
+    return SP_BadArg;
+  }
+  const int64_t template_count = parse_int64(tmpl + doffset, big_endian);
+  if (template_count <= 0
+      || template_count > (template_size - doffset - 8) / 20) {
+    return SP_BadArg;
+  }
+
+  std::vector<DirectoryEntry> template_entries;
+  for (int64_t i = 0; i < template_count; ++i) {
+    uint8_t *template_entry = tmpl + doffset + 8 + i * 20;
+    DirectoryEntry entry;
+    entry.tag = static_cast<uint16_t>(parse_int16(template_entry,
+                                                  big_endian));
+    entry.type = static_cast<uint16_t>(parse_int16(template_entry + 2,
+                                                   big_endian));
+    entry.count = parse_int64(template_entry + 4, big_endian);
+    if (is_layout_tag(entry.tag)) {
+      continue;
+    }
+    const int type_size = get_type_size(
+        static_cast<TIFFDataType>(entry.type));
+    if (type_size == 0 || entry.count < 0 || entry.count > template_size) {
+      return SP_BadArg;
+    }
+    const int64_t value_size = entry.count * type_size;
+    const uint8_t *value = template_entry + 12;
+    if (value_size > 8) {
+      const int64_t value_offset = parse_int64(template_entry + 12,
+                                               big_endian);
+      if (value_offset < 0 || value_offset > template_size - value_size) {
+        return SP_BadArg;
       }
+      value = tmpl + value_offset;
+    }
+    entry.value.assign(value, value + value_size);
+    template_entries.push_back(entry);
+  }
+
+  const int64_t tile_size_bytes = tile_size * tile_size * pixel_size;
+  const int64_t tile_stride = align_offset(tile_size_bytes, tile_alignment);
+  const bool compressed = compression != COMPRESSION_NONE;
+
+  // One directory per image, the full resolution first and then the
+  // overviews from the largest to the smallest
+  std::vector<std::vector<DirectoryEntry> > directories(overview_count + 1);
+  for (int level = 0; level <= overview_count; ++level) {
+    std::vector<DirectoryEntry> &entries = directories[level];
+    for (size_t i = 0; i < template_entries.size(); ++i) {
+      if (level == 0 || !is_geotiff_tag(template_entries[i].tag)) {
+        entries.push_back(template_entries[i]);
+      }
+    }
+    const int64_t tile_count = level_tile_count(x_size, y_size, tile_size,
+                                                level);
+    if (level > 0) {
+      add_entry(&entries, TIFFTAG_SUBFILETYPE, TIFF_LONG,
+                std::vector<int64_t>(1, FILETYPE_REDUCEDIMAGE), big_endian);
+    }
+    add_entry(&entries, TIFFTAG_IMAGEWIDTH, TIFF_LONG,
+              std::vector<int64_t>(1, level_size(x_size, level)),
+              big_endian);
+    add_entry(&entries, TIFFTAG_IMAGELENGTH, TIFF_LONG,
+              std::vector<int64_t>(1, level_size(y_size, level)),
+              big_endian);
+    add_entry(&entries, TIFFTAG_COMPRESSION, TIFF_SHORT,
+              std::vector<int64_t>(1, compression), big_endian);
+    add_entry(&entries, TIFFTAG_TILEWIDTH, TIFF_LONG,
+              std::vector<int64_t>(1, tile_size), big_endian);
+    add_entry(&entries, TIFFTAG_TILELENGTH, TIFF_LONG,
+              std::vector<int64_t>(1, tile_size), big_endian);
+    // The offsets are filled in once the size of the header is known
+    add_entry(&entries, TIFFTAG_TILEOFFSETS, TIFF_LONG8,
+              std::vector<int64_t>(tile_count, 0), big_endian);
+    add_entry(&entries, TIFFTAG_TILEBYTECOUNTS, TIFF_LONG8,
+              std::vector<int64_t>(tile_count,
+                                   compressed ? 0 : tile_size_bytes),
+              big_endian);
+    std::sort(entries.begin(), entries.end(), entry_compare);
+  }
+
+  // Each directory is followed by its values that do not fit in their
+  // entries, each at an 8 byte boundary
+  std::vector<int64_t> directory_offsets(overview_count + 1);
+  std::vector<std::vector<int64_t> > value_offsets(overview_count + 1);
+  int64_t header_size = 16;
+  for (int level = 0; level <= overview_count; ++level) {
+    const std::vector<DirectoryEntry> &entries = directories[level];
+    directory_offsets[level] = header_size;
+    header_size += 8 + entries.size() * 20 + 8;
+    value_offsets[level].assign(entries.size(), -1);
+    for (size_t i = 0; i < entries.size(); ++i) {
+      if (entries[i].value.size() > 8) {
+        value_offsets[level][i] = header_size;
+        header_size += (entries[i].value.size() + 7) / 8 * 8;
+      }
+    }
+  }
+  header_size = align_offset(header_size, tile_alignment);
+  *first_tile_offset = header_size;
+
+  header->assign(header_size, 0);
+  uint8_t *out = &(*header)[0];
+  out[0] = out[1] = big_endian ? 0x4d : 0x49;
+  export_int16(0x002b, out + 2, big_endian);
+  export_int16(8, out + 4, big_endian);
+  export_int64(directory_offsets[0], out + 8, big_endian);
+  for (int level = 0; level <= overview_count; ++level) {
+    std::vector<DirectoryEntry> &entries = directories[level];
+    const int64_t directory_offset = directory_offsets[level];
+    const int64_t tile_count = level_tile_count(x_size, y_size, tile_size,
+                                                level);
+    // Rank layouts only apply to the full resolution
+    std::vector<int64_t> offsets(tile_count);
+    layout_tile_offsets(tile_count,
+                        level_first_tile_offset(header_size, x_size, y_size,
+                                                tile_size, tile_stride,
+                                                overview_count, level),
+                        tile_stride,
+                        level == 0 ? tile_order : NULL,
+                        &offsets[0]);
+
+    export_int64(entries.size(), out + directory_offset, big_endian);
+    for (size_t i = 0; i < entries.size(); ++i) {
+      DirectoryEntry &entry = entries[i];
+      if (entry.tag == TIFFTAG_TILEOFFSETS && !compressed) {
+        export_values(offsets, 8, big_endian, &entry.value);
+      }
+      uint8_t *directory_entry = out + directory_offset + 8 + i * 20;
+      // One tile arrays are stored in their entries
+      const int64_t value_location = value_offsets[level][i] < 0
+          ? directory_offset + 8 + i * 20 + 12 : value_offsets[level][i];
+      if (level == 0 && entry.tag == TIFFTAG_TILEOFFSETS) {
+        *tile_offsets_location = value_location;
+      } else if (level == 0 && entry.tag == TIFFTAG_TILEBYTECOUNTS) {
+        *tile_byte_counts_location = value_location;
+      }
+      export_int16(entry.tag, directory_entry, big_endian);
+      export_int16(entry.type, directory_entry + 2, big_endian);
+      export_int64(entry.count, directory_entry + 4, big_endian);
+      if (entry.value.empty()) {
+        continue;
+      }
+      if (value_offsets[level][i] < 0) {
+        memcpy(directory_entry + 12, &entry.value[0], entry.value.size());
+      } else {
+        export_int64(value_offsets[level][i], directory_entry + 12,
+                     big_endian);
+        memcpy(out + value_offsets[level][i], &entry.value[0],
+               entry.value.size());
+      }
+    }
+    // Each directory links to the next one, the offset after the last
+    // directory stays 0
+    if (level < overview_count) {
+      export_int64(directory_offsets[level + 1],
+                   out + directory_offset + 8 + entries.size() * 20,
+                   big_endian);
     }
-    entry_offset += 20;
   }
 
-  // Calculate end of file and write to it
-  uint8_t buffer[10];
-  buffer[0] = 0;
-  int64_t file_size = (tile_count * tile_size_bytes) + first_tile_offset;
-  MPI_File_write_at(tiff_file->fh, file_size-1, buffer, 1, MPI_BYTE, &status);
   return SP_None;
 }
 
+SPTW_ERROR create_raster_direct(string filename,
+                                int64_t x_size,
+                                int64_t y_size,
+                                int band_count,
+                                GDALDataType band_type,
+                                double *geotransform,
+                                string projection_srs,
+                                int64_t tile_size,
+                                int64_t tile_alignment,
+                                SPTW_COMPRESSION compression,
+                                int compression_level,
+                                GDALColorTable *color_table,
+                                RasterLayout *layout,
+                                const std::vector<int64_t> *tile_order,
+                                MPI_Info info,
+                                int overview_count,
+                                string nodata) {
+  // Image and tile dimensions are stored as LONGs, tile dimensions must be
+  // multiples of 16
+  if (x_size <= 0 || y_size <= 0
+      || x_size > UINT32_MAX || y_size > UINT32_MAX
+      || tile_size <= 0 || tile_size % 16 != 0 || band_count <= 0
+      || !compression_supported(compression)) {
+    return SP_BadArg;
+  }
+  // Compressed tiles are packed in the order they are written, overviews
+  // are stored before the full resolution so their tiles can not be
+  const bool compressed = compression != SP_Uncompressed;
+  if (overview_count < 0 || (compressed && overview_count > 0)) {
+    return SP_BadArg;
+  }
+  if (compressed) {
+    tile_alignment = 0;
+    tile_order = NULL;
+  }
+  const int64_t tile_count = ((x_size + tile_size - 1) / tile_size)
+      * ((y_size + tile_size - 1) / tile_size);
+  if (tile_order != NULL && !is_tile_order(*tile_order, tile_count)) {
+    return SP_BadArg;
+  }
+
+  // GDAL encodes the GeoTIFF keys of a one pixel template in memory
+  const char *template_name = "/vsimem/sptw_direct_template.tif";
+  GDALAllRegister();
+  GDALDriver *gtiff_driver = GetGDALDriverManager()->GetDriverByName("GTiff");
+  if (gtiff_driver == NULL) {
+    return SP_CreateError;
+  }
+
+  char **options = NULL;
+  options = CSLSetNameValue(options, "BIGTIFF", "YES");
+  options = CSLSetNameValue(options, "INTERLEAVE", "PIXEL");
+  options = CSLSetNameValue(options, "COMPRESS", "NONE");
+  options = CSLSetNameValue(options, "TILED", "YES");
+  options = CSLSetNameValue(options, "BLOCKXSIZE", "16");
+  options = CSLSetNameValue(options, "BLOCKYSIZE", "16");
+
+  GDALDataset *ds = gtiff_driver->Create(template_name,
+                                         1,
+                                         1,
+                                         band_count,
+                                         band_type,
+                                         options);
+  CSLDestroy(options);
+  if (ds == NULL) {
+    return SP_CreateError;
+  }
+
+  if (ds->SetProjection(projection_srs.c_str()) != CE_None) {
+    GDALClose((GDALDatasetH) ds);
+    VSIUnlink(template_name);
+    return SP_BadArg;
+  }
+  ds->SetGeoTransform(geotransform);
+  if (color_table != NULL) {
+    ds->GetRasterBand(1)->SetColorTable(color_table);
+  }
+  // GDAL stores the nodata value in a GDAL_NODATA tag, which is copied with
+  // the other tags
+  for (int i = 1; i <= band_count && !nodata.empty(); ++i) {
+    ds->GetRasterBand(i)->SetNoDataValue(strtod(nodata.c_str(), NULL));
+  }
+  GDALClose((GDALDatasetH) ds);
+
+  vsi_l_offset template_size = 0;
+  GByte *template_data = VSIGetMemFileBuffer(template_name,
+                                             &template_size,
+                                             FALSE);
+  std::vector<uint8_t> template_bytes;
+  if (template_data != NULL) {
+    template_bytes.assign(template_data, template_data + template_size);
+  }
+  VSIUnlink(template_name);
+
+  const int band_type_size = GDALGetDataTypeSize(band_type) / 8;
+  std::vector<uint8_t> header;
+  int64_t first_tile_offset = 0;
+  int64_t tile_offsets_location = 0, tile_byte_counts_location = 0;
+  SPTW_ERROR err = build_direct_header(template_bytes,
+                                       x_size,
+                                       y_size,
+                                       tile_size,
+                                       band_type_size * band_count,
+                                       tile_alignment,
+                                       tiff_compression(compression),
+                                       overview_count,
+                                       tile_order,
+                                       &header,
+                                       &first_tile_offset,
+                                       &tile_offsets_location,
+                                       &tile_byte_counts_location);
+  if (err != SP_None) {
+    return err;
+  }
+
+  // Write everything in front of the tiles at once. The tiles are left to
+  // the processes, the file is only extended over them. It is created with
+  // MPI-IO so that hints that only apply at creation, such as
+  // striping_factor and striping_unit, take effect. Compressed tiles are
+  // appended as they are written.
+  const int64_t tile_stride = align_offset(tile_size * tile_size
+                                           * band_type_size * band_count,
+                                           tile_alignment);
+  const int64_t file_size = compressed ? first_tile_offset
+      : level_first_tile_offset(first_tile_offset, x_size, y_size, tile_size,
+                                tile_stride, overview_count, 0)
+      + tile_count * tile_stride;
+  char *c_filename = strdup(filename.c_str());
+  // MPI_MODE_CREATE does not truncate an existing file
+  MPI_File_delete(c_filename, MPI_INFO_NULL);
+  PTIFF file = PTIFF();
+  const int rc = MPI_File_open(MPI_COMM_SELF,
+                               c_filename,
+                               MPI_MODE_CREATE | MPI_MODE_WRONLY,
+                               info,
+                               &(file.fh));
+  free(c_filename);
+  if (rc != MPI_SUCCESS) {
+    return SP_CreateError;
+  }
+  err = write_bytes(&file,
+                    0,
+                    reinterpret_cast<char*>(&header[0]),
+                    header.size());
+  if (err == SP_None && MPI_File_set_size(file.fh, file_size) != MPI_SUCCESS) {
+    err = SP_WriteError;
+  }
+  if (MPI_File_close(&(file.fh)) != MPI_SUCCESS && err == SP_None) {
+    err = SP_WriteError;
+  }
+  if (err != SP_None) {
+    return err;
+  }
 
+  layout->x_size = x_size;
+  layout->y_size = y_size;
+  layout->band_count = band_count;
+  layout->band_type = band_type;
+  layout->tile_size = tile_size;
+  layout->tile_alignment = tile_alignment;
+  layout->first_tile_offset = first_tile_offset;
+  layout->compression = compression;
+  layout->compression_level = compression_level;
+  layout->tile_offsets_location = tile_offsets_location;
+  layout->tile_byte_counts_location = tile_byte_counts_location;
+  layout->overview_count = overview_count;
+  return SP_None;
+}
 
 SPTW_ERROR create_raster(string filename,
                          int64_t x_size,
@@ -362,7 +1125,39 @@ SPTW_ERROR create_tiled_raster(string filename,
   return SP_None;
 }
 
-PTIFF* open_raster(string filename) {
+// Opens the file of ptiff with MPI-IO, collectively
+bool open_file(PTIFF *ptiff, string filename, MPI_Info info) {
+  char *c_filename = strdup(filename.c_str());
+  int rc = MPI_File_open(MPI_COMM_WORLD,
+                         c_filename,
+                         MPI_MODE_RDWR,
+                         info,
+                         &(ptiff->fh));
+
+  if (rc != MPI_SUCCESS) {
+    char *errstr = static_cast<char*>(malloc(5000));
+    int errlen = 0;
+    MPI_Error_string(rc, errstr, &errlen);
+    fprintf(stderr,
+            "MPI_File: Error opening file: %s: %s\n",
+            c_filename,
+            errstr);
+
+    free(c_filename);
+    free(errstr);
+    return false;
+  }
+
+  MPI_File_set_atomicity(ptiff->fh, 0);
+
+  if (c_filename != NULL) {
+    free(c_filename);
+  }
+
+  return true;
+}
+
+PTIFF* open_raster(string filename, MPI_Info info) {
   PTIFF *ptiff = new PTIFF();
   char *c_filename = strdup(filename.c_str());
 
@@ -437,39 +1232,264 @@ PTIFF* open_raster(string filename) {
 
   TIFFClose(tiffds);
 
-  c_filename = strdup(filename.c_str());
-  int rc = MPI_File_open(MPI_COMM_WORLD,
-                         c_filename,
-                         MPI_MODE_RDWR,
-                         MPI_INFO_NULL,
-                         &(ptiff->fh));
+  if (!open_file(ptiff, filename, info)) {
+    return NULL;
+  }
 
-  if (rc != MPI_SUCCESS) {
-    char *errstr = static_cast<char*>(malloc(5000));
-    int errlen = 0;
-    MPI_Error_string(rc, errstr, &errlen);
-    fprintf(stderr,
-            "MPI_File: Error opening file: %s: %s\n",
-            c_filename,
-            errstr);
+  return ptiff;
+}
 
-    free(c_filename);
-    free(errstr);
+PTIFF* open_raster(string filename,
+                   const RasterLayout &layout,
+                   const std::vector<int64_t> *tile_order,
+                   MPI_Info info) {
+  PTIFF *ptiff = new PTIFF();
+  ptiff->x_size = layout.x_size;
+  ptiff->y_size = layout.y_size;
+  ptiff->band_count = layout.band_count;
+  ptiff->band_type = layout.band_type;
+  ptiff->band_type_size = GDALGetDataTypeSize(ptiff->band_type)/8;
+  ptiff->first_strip_offset = layout.first_tile_offset;
+  ptiff->block_x_size = layout.tile_size;
+  ptiff->block_y_size = layout.tile_size;
+  ptiff->tiles_across = (ptiff->x_size
+                         + ptiff->block_x_size - 1) / ptiff->block_x_size;
+  ptiff->tiles_down = (ptiff->y_size
+                       + ptiff->block_y_size - 1) / ptiff->block_y_size;
+
+  // The tiles follow the header, in the order the file was created with
+  const int64_t tile_count = ptiff->tiles_across * ptiff->tiles_down;
+  const int64_t tile_size_bytes = ptiff->block_x_size * ptiff->block_y_size
+      * ptiff->band_type_size * ptiff->band_count;
+  if (tile_order != NULL
+      && static_cast<int64_t>(tile_order->size()) != tile_count) {
+    delete ptiff;
     return NULL;
   }
+  ptiff->tile_offsets = new int64_t[tile_count];
+  ptiff->compression = layout.compression;
+  ptiff->compression_level = layout.compression_level;
+  ptiff->tile_offsets_location = layout.tile_offsets_location;
+  ptiff->tile_byte_counts_location = layout.tile_byte_counts_location;
+  ptiff->next_tile_offset = layout.first_tile_offset;
+  if (layout.compression != SP_Uncompressed) {
+    // Filled in as this process writes its tiles
+    std::fill(ptiff->tile_offsets, ptiff->tile_offsets + tile_count, 0);
+    ptiff->tile_byte_counts = new int64_t[tile_count]();
+  } else {
+    const int64_t tile_stride = align_offset(tile_size_bytes,
+                                             layout.tile_alignment);
+    layout_tile_offsets(tile_count,
+                        level_first_tile_offset(layout.first_tile_offset,
+                                                layout.x_size,
+                                                layout.y_size,
+                                                layout.tile_size,
+                                                tile_stride,
+                                                layout.overview_count,
+                                                0),
+                        tile_stride, tile_order, ptiff->tile_offsets);
+  }
 
-  MPI_File_set_atomicity(ptiff->fh, 0);
-
-  if (c_filename != NULL) {
-    free(c_filename);
+  if (!open_file(ptiff, filename, info)) {
+    delete[] ptiff->tile_byte_counts;
+    delete[] ptiff->tile_offsets;
+    delete ptiff;
+    return NULL;
   }
 
   return ptiff;
 }
 
+PTIFF* open_overview(PTIFF *ptiff, const RasterLayout &layout, int level) {
+  if (level < 1 || level > layout.overview_count
+      || layout.compression != SP_Uncompressed) {
+    return NULL;
+  }
+  PTIFF *overview = new PTIFF();
+  overview->fh = ptiff->fh;
+  overview->shared_file = true;
+  overview->overview_level = level;
+  overview->x_size = level_size(layout.x_size, level);
+  overview->y_size = level_size(layout.y_size, level);
+  overview->band_count = layout.band_count;
+  overview->band_type = layout.band_type;
+  overview->band_type_size = ptiff->band_type_size;
+  overview->block_x_size = layout.tile_size;
+  overview->block_y_size = layout.tile_size;
+  overview->tiles_across = (overview->x_size + layout.tile_size - 1)
+      / layout.tile_size;
+  overview->tiles_down = (overview->y_size + layout.tile_size - 1)
+      / layout.tile_size;
+
+  const int64_t tile_count = overview->tiles_across * overview->tiles_down;
+  const int64_t tile_stride = align_offset(
+      layout.tile_size * layout.tile_size * overview->band_type_size
+      * overview->band_count, layout.tile_alignment);
+  overview->first_strip_offset = level_first_tile_offset(
+      layout.first_tile_offset, layout.x_size, layout.y_size,
+      layout.tile_size, tile_stride, layout.overview_count, level);
+  overview->tile_offsets = new int64_t[tile_count];
+  layout_tile_offsets(tile_count, overview->first_strip_offset, tile_stride,
+                      NULL, overview->tile_offsets);
+  return overview;
+}
+
+// Whether tile (tile_x, tile_y) was left unallocated with skip_tile
+bool tile_skipped(const PTIFF *ptiff, int64_t tile_x, int64_t tile_y) {
+  return ptiff->skipped_tiles != NULL
+      && ptiff->skipped_tiles[tile_y * ptiff->tiles_across + tile_x] != 0;
+}
+
+// Finds the tile offset and byte count arrays of the directory of image
+// level in the BigTIFF header, false on error. Arrays of one value are
+// stored in their entries.
+bool locate_tile_arrays(PTIFF *ptiff,
+                        int level,
+                        bool big_endian,
+                        int64_t *offsets_location,
+                        int64_t *byte_counts_location) {
+  const int64_t kEntrySize = 20;
+  int64_t directory = read_int64(ptiff, 8, big_endian);
+  for (int l = 0; l < level && directory > 0; ++l) {
+    const int64_t entry_count = read_int64(ptiff, directory, big_endian);
+    directory = read_int64(ptiff, directory + 8 + entry_count * kEntrySize,
+                           big_endian);
+  }
+  if (directory <= 0) {
+    return false;
+  }
+  const int64_t entry_count = read_int64(ptiff, directory, big_endian);
+  if (entry_count <= 0 || entry_count * kEntrySize > INT_MAX) {
+    return false;
+  }
+  std::vector<uint8_t> entries(entry_count * kEntrySize);
+  if (MPI_File_read_at(ptiff->fh, directory + 8, &entries[0],
+                       static_cast<int>(entries.size()), MPI_BYTE,
+                       MPI_STATUS_IGNORE) != MPI_SUCCESS) {
+    return false;
+  }
+  *offsets_location = 0;
+  *byte_counts_location = 0;
+  for (int64_t i = 0; i < entry_count; ++i) {
+    uint8_t *entry = &entries[i * kEntrySize];
+    const int tag = static_cast<uint16_t>(parse_int16(entry, big_endian));
+    const int64_t location = parse_int64(entry + 4, big_endian) == 1
+        ? directory + 8 + i * kEntrySize + 12
+        : parse_int64(entry + 12, big_endian);
+    if (tag == TIFFTAG_TILEOFFSETS) {
+      *offsets_location = location;
+    } else if (tag == TIFFTAG_TILEBYTECOUNTS) {
+      *byte_counts_location = location;
+    }
+  }
+  return *offsets_location > 0 && *byte_counts_location > 0;
+}
+
+// Writes the tile offset and byte count arrays. Each process only knows
+// the compressed tiles it wrote, the others are 0, so the arrays are summed
+// on rank 0. Every process knows the uncompressed ones, their minimum clears
+// the tiles any process skipped. Rank 0 writes the arrays with collective
+// writes, the other processes take part with nothing to write.
+SPTW_ERROR write_tile_arrays(PTIFF *ptiff) {
+  int rank = 0;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  const int64_t tile_count = ptiff->tiles_across * ptiff->tiles_down;
+  const int64_t tile_size_bytes = ptiff->block_x_size * ptiff->block_y_size
+      * ptiff->band_type_size * ptiff->band_count;
+  const bool compressed = ptiff->compression != SP_Uncompressed;
+  // Values are reduced and written in pieces, MPI counts are ints
+  const int64_t kPieceCount = 1 << 24;
+
+  uint8_t byte_order = 0;
+  if (rank == 0) {
+    MPI_File_read_at(ptiff->fh, 0, &byte_order, 1, MPI_BYTE,
+                     MPI_STATUS_IGNORE);
+  }
+  const bool big_endian = byte_order == 0x4d;
+
+  const int64_t *arrays[2] = { ptiff->tile_offsets, ptiff->tile_byte_counts };
+  int64_t locations[2] = { ptiff->tile_offsets_location,
+                           ptiff->tile_byte_counts_location };
+  SPTW_ERROR err = SP_None;
+  // Only the arrays of the full resolution are part of the layout
+  if (rank == 0 && ptiff->overview_level > 0
+      && !locate_tile_arrays(ptiff, ptiff->overview_level, big_endian,
+                             &locations[0], &locations[1])) {
+    err = SP_ReadError;
+  }
+  for (int a = 0; a < 2; ++a) {
+    for (int64_t start = 0; start < tile_count; start += kPieceCount) {
+      const int count = static_cast<int>(std::min(kPieceCount,
+                                                   tile_count - start));
+      std::vector<long long> local(count, 0);
+      for (int i = 0; i < count; ++i) {
+        const int64_t t = start + i;
+        if (compressed) {
+          local[i] = arrays[a][t];
+        } else if (ptiff->skipped_tiles == NULL
+                   || ptiff->skipped_tiles[t] == 0) {
+          local[i] = a == 0 ? ptiff->tile_offsets[t] : tile_size_bytes;
+        }
+      }
+      std::vector<long long> total(rank == 0 ? count : 0);
+      MPI_Reduce(&local[0], rank == 0 ? &total[0] : NULL, count,
+                 MPI_LONG_LONG, compressed ? MPI_SUM : MPI_MIN, 0,
+                 MPI_COMM_WORLD);
+
+      std::vector<uint8_t> buffer;
+      if (rank == 0 && err == SP_None) {
+        export_values(std::vector<int64_t>(total.begin(), total.end()), 8,
+                      big_endian, &buffer);
+      }
+      if (MPI_File_write_at_all(ptiff->fh,
+                                locations[a] + start * 8,
+                                buffer.empty() ? NULL : &buffer[0],
+                                static_cast<int>(buffer.size()),
+                                MPI_BYTE,
+                                MPI_STATUS_IGNORE) != MPI_SUCCESS) {
+        err = SP_WriteError;
+      }
+    }
+  }
+  return err;
+}
+
 SPTW_ERROR close_raster(PTIFF *ptiff) {
-  MPI_File_close(&(ptiff->fh));
+  SPTW_ERROR err = SP_None;
+  if (ptiff->compression != SP_Uncompressed) {
+    err = write_tile_arrays(ptiff);
+  } else if (ptiff->tile_offsets_location > 0 || ptiff->overview_level > 0) {
+    // The arrays are rewritten only if a process skipped tiles
+    int skipped = ptiff->skipped_tiles != NULL ? 1 : 0;
+    int any_skipped = 0;
+    MPI_Allreduce(&skipped, &any_skipped, 1, MPI_INT, MPI_MAX,
+                  MPI_COMM_WORLD);
+    if (any_skipped != 0) {
+      err = write_tile_arrays(ptiff);
+    }
+  }
+  // Overviews use the file of their full resolution PTIFF
+  if (!ptiff->shared_file) {
+    MPI_File_close(&(ptiff->fh));
+  }
+  delete[] ptiff->skipped_tiles;
+  delete[] ptiff->tile_byte_counts;
+  delete[] ptiff->tile_offsets;
   delete ptiff;
+  return err;
+}
+
+SPTW_ERROR skip_tile(PTIFF *ptiff, int64_t tile_x, int64_t tile_y) {
+  if (tile_x < 0 || tile_y < 0 || tile_x >= ptiff->tiles_across
+      || tile_y >= ptiff->tiles_down
+      || (ptiff->tile_offsets_location <= 0 && ptiff->overview_level == 0)) {
+    return SP_BadArg;
+  }
+  if (ptiff->skipped_tiles == NULL) {
+    ptiff->skipped_tiles = new uint8_t[ptiff->tiles_across
+                                       * ptiff->tiles_down]();
+  }
+  ptiff->skipped_tiles[tile_y * ptiff->tiles_across + tile_x] = 1;
   return SP_None;
 }
 
@@ -550,8 +1570,7 @@ SPTW_ERROR write_subset(PTIFF *tiff_file,
                         void *data,
                         int64_t buffer_ul_x,
                         int64_t buffer_ul_y,
-                        int64_t buffer_lr_x,
-                        int64_t buffer_lr_y,
+                        int64_t row_stride,
                         int64_t write_ul_x,
                         int64_t write_ul_y,
                         int64_t write_lr_x,
@@ -559,55 +1578,52 @@ SPTW_ERROR write_subset(PTIFF *tiff_file,
   const double tile_x_beginning = (write_ul_x / tiff_file->block_x_size)
       * tiff_file->block_x_size;
   const double tile_x_end = tile_x_beginning + tiff_file->block_x_size - 1;
-  int count = 0;
-  MPI_Status status;
+  const int64_t pixel_size = static_cast<int64_t>(tiff_file->band_type_size)
+      * tiff_file->band_count;
+  // Size in bytes of a row of the section of buffer being output
+  const int64_t sub_row_size = (write_lr_x - write_ul_x + 1) * pixel_size;
+  SPTW_ERROR err = SP_None;
+
+  if (tile_skipped(tiff_file, write_ul_x / tiff_file->block_x_size,
+                   write_ul_y / tiff_file->block_y_size)) {
+    return SP_None;
+  }
 
   if (write_ul_x == tile_x_beginning
       && write_lr_x == tile_x_end) {
     // Area to be written is same width as tile, write area with single
     // operation
-    count = ((write_lr_x - write_ul_x + 1) * (write_lr_y - write_ul_y + 1)
-             * tiff_file->band_type_size * tiff_file->band_count);
-    // Size in bytes of  a row of the section of buffer being output
-    const int sub_row_size = (write_lr_x - write_ul_x + 1)
-        * tiff_file->band_type_size * tiff_file->band_count;
+    const int64_t count = sub_row_size * (write_lr_y - write_ul_y + 1);
 
     char *buffer = new(std::nothrow) char[count];
-    for (int y = write_ul_y; y <= write_lr_y; ++y) {
-      int pixel_offset = ((y - buffer_ul_y) * (buffer_lr_x - buffer_ul_x + 1)
-                          + (write_ul_x - buffer_ul_x))
-          * tiff_file->band_type_size * tiff_file->band_count;
+    if (buffer == NULL) {
+      return SP_WriteError;
+    }
+    for (int64_t y = write_ul_y; y <= write_lr_y; ++y) {
+      const int64_t pixel_offset = (y - buffer_ul_y) * row_stride
+          + (write_ul_x - buffer_ul_x) * pixel_size;
 
-      memcpy(buffer+((y-write_ul_y)*sub_row_size),
-             static_cast<char*>(data)+pixel_offset,
+      memcpy(buffer + (y - write_ul_y) * sub_row_size,
+             static_cast<char*>(data) + pixel_offset,
              sub_row_size);
     }
-    MPI_File_write_at(tiff_file->fh,
+    err = write_bytes(tiff_file,
                       calculate_file_offset(tiff_file, write_ul_x, write_ul_y),
                       buffer,
-                      count,
-                      MPI_BYTE,
-                      &status);
+                      count);
     delete[] buffer;
   } else {
     // Subset of the buffer must be written row by row
-    count = (write_lr_x - write_ul_x + 1)
-        * tiff_file->band_type_size
-        * tiff_file->band_count;
-
-    for (int y = write_ul_y; y <= write_lr_y; ++y) {
-      int pixel_offset = ((y - buffer_ul_y) * (buffer_lr_x - buffer_ul_x + 1)
-                          + (write_ul_x - buffer_ul_x))
-          * tiff_file->band_type_size * tiff_file->band_count;
-      MPI_File_write_at(tiff_file->fh,
+    for (int64_t y = write_ul_y; y <= write_lr_y && err == SP_None; ++y) {
+      const int64_t pixel_offset = (y - buffer_ul_y) * row_stride
+          + (write_ul_x - buffer_ul_x) * pixel_size;
+      err = write_bytes(tiff_file,
                         calculate_file_offset(tiff_file, write_ul_x, y),
-                        (static_cast<char*>(data)) + pixel_offset,
-                        count,
-                        MPI_BYTE,
-                        &status);
+                        static_cast<char*>(data) + pixel_offset,
+                        sub_row_size);
     }
   }
-  return SP_None;
+  return err;
 }
 
 SPTW_ERROR write_area(PTIFF *ptiff,
@@ -616,6 +1632,18 @@ SPTW_ERROR write_area(PTIFF *ptiff,
                       int64_t ul_y,
                       int64_t lr_x,
                       int64_t lr_y) {
+  const int64_t row_stride = (lr_x - ul_x + 1)
+      * ptiff->band_type_size * ptiff->band_count;
+  return write_area_strided(ptiff, data, row_stride, ul_x, ul_y, lr_x, lr_y);
+}
+
+SPTW_ERROR write_area_strided(PTIFF *ptiff,
+                              void *data,
+                              int64_t row_stride,
+                              int64_t ul_x,
+                              int64_t ul_y,
+                              int64_t lr_x,
+                              int64_t lr_y) {
   std::vector<Area> write_stack;
   Area write_area;
   write_area.ul = librasterblaster::Coordinate(ul_x,
@@ -637,17 +1665,394 @@ SPTW_ERROR write_area(PTIFF *ptiff,
     fill_stack(&write_stack, top, subset);
 
     // Finally write the tile-bound subset
-    write_subset(ptiff,
-                 data,
-                 ul_x,
-                 ul_y,
-                 lr_x,
-                 lr_y,
-                 subset.ul.x,
-                 subset.ul.y,
-                 subset.lr.x,
-                 subset.lr.y);
+    const SPTW_ERROR err = write_subset(ptiff,
+                                        data,
+                                        ul_x,
+                                        ul_y,
+                                        row_stride,
+                                        subset.ul.x,
+                                        subset.ul.y,
+                                        subset.lr.x,
+                                        subset.lr.y);
+    if (err != SP_None) {
+      return err;
+    }
   }
   return SP_None;
 }
+
+SPTW_ERROR read_area_strided(PTIFF *ptiff,
+                             void *data,
+                             int64_t row_stride,
+                             int64_t ul_x,
+                             int64_t ul_y,
+                             int64_t lr_x,
+                             int64_t lr_y) {
+  const int64_t pixel_size = static_cast<int64_t>(ptiff->band_type_size)
+      * ptiff->band_count;
+  if (ul_x < 0 || ul_y < 0 || lr_x >= ptiff->x_size || lr_y >= ptiff->y_size
+      || ptiff->compression != SP_Uncompressed
+      || ptiff->block_x_size * pixel_size > INT_MAX) {
+    return SP_BadArg;
+  }
+
+  // Each tile sub-row is contiguous in the file
+  MPI_Status status;
+  for (int64_t y = ul_y; y <= lr_y; ++y) {
+    for (int64_t tile_x = ul_x / ptiff->block_x_size;
+         tile_x <= lr_x / ptiff->block_x_size; ++tile_x) {
+      const int64_t x = std::max(ul_x, tile_x * ptiff->block_x_size);
+      const int64_t end = std::min(lr_x,
+                                   (tile_x + 1) * ptiff->block_x_size - 1);
+      if (MPI_File_read_at(ptiff->fh,
+                           calculate_file_offset(ptiff, x, y),
+                           static_cast<char*>(data) + (y - ul_y) * row_stride
+                           + (x - ul_x) * pixel_size,
+                           static_cast<int>((end - x + 1) * pixel_size),
+                           MPI_BYTE,
+                           &status) != MPI_SUCCESS) {
+        return SP_ReadError;
+      }
+    }
+  }
+  return SP_None;
+}
+
+SPTW_ERROR sync_raster(PTIFF *ptiff) {
+  // Sync, barrier, sync orders the writes before the reads under the MPI-IO
+  // consistency semantics
+  if (MPI_File_sync(ptiff->fh) != MPI_SUCCESS) {
+    return SP_WriteError;
+  }
+  MPI_Barrier(MPI_COMM_WORLD);
+  if (MPI_File_sync(ptiff->fh) != MPI_SUCCESS) {
+    return SP_WriteError;
+  }
+  return SP_None;
+}
+
+// A sub-row of one tile: contiguous in the file and in the buffer
+struct WritePiece {
+  int64_t file_offset;
+  const char *data;
+  int64_t size;
+
+  bool operator<(const WritePiece &other) const {
+    return file_offset < other.file_offset;
+  }
+};
+
+// Bytes that a rank contributes to one collective write, kept below INT_MAX
+// so that the counts fit MPI ints
+const int64_t kCollectiveRoundBytes = static_cast<int64_t>(256) << 20;
+
+// Writes the pieces with one collective call. The file view is an hindexed
+// type of the pieces, merged where they are adjacent in the file, and the
+// pieces are packed in file order. Ranks without pieces write zero bytes.
+SPTW_ERROR write_round_all(PTIFF *ptiff,
+                           const WritePiece *pieces,
+                           size_t piece_count) {
+  std::vector<int> block_lengths;
+  std::vector<MPI_Aint> displacements;
+  int64_t round_size = 0;
+  for (size_t i = 0; i < piece_count; ++i) {
+    if (!displacements.empty()
+        && displacements.back() + block_lengths.back()
+        == pieces[i].file_offset) {
+      block_lengths.back() += static_cast<int>(pieces[i].size);
+    } else {
+      displacements.push_back(static_cast<MPI_Aint>(pieces[i].file_offset));
+      block_lengths.push_back(static_cast<int>(pieces[i].size));
+    }
+    round_size += pieces[i].size;
+  }
+
+  char *buffer = new(std::nothrow) char[std::max<int64_t>(round_size, 1)];
+  if (buffer == NULL) {
+    return SP_WriteError;
+  }
+  char *position = buffer;
+  for (size_t i = 0; i < piece_count; ++i) {
+    memcpy(position, pieces[i].data, pieces[i].size);
+    position += pieces[i].size;
+  }
+
+  MPI_Datatype file_type = MPI_BYTE;
+  if (!displacements.empty()) {
+    MPI_Type_create_hindexed(static_cast<int>(displacements.size()),
+                             &block_lengths[0],
+                             &displacements[0],
+                             MPI_BYTE,
+                             &file_type);
+    MPI_Type_commit(&file_type);
+  }
+
+  SPTW_ERROR err = SP_None;
+  MPI_Status status;
+  char datarep[] = "native";
+  if (MPI_File_set_view(ptiff->fh, 0, MPI_BYTE, file_type, datarep,
+                        MPI_INFO_NULL) != MPI_SUCCESS
+      || MPI_File_write_at_all(ptiff->fh, 0, buffer,
+                               static_cast<int>(round_size), MPI_BYTE,
+                               &status) != MPI_SUCCESS) {
+    err = SP_WriteError;
+  }
+
+  if (file_type != MPI_BYTE) {
+    MPI_Type_free(&file_type);
+  }
+  delete[] buffer;
+  return err;
+}
+
+SPTW_ERROR write_area_all(PTIFF *ptiff,
+                          void *data,
+                          int64_t row_stride,
+                          int64_t ul_x,
+                          int64_t ul_y,
+                          int64_t lr_x,
+                          int64_t lr_y) {
+  const int64_t pixel_size = static_cast<int64_t>(ptiff->band_type_size)
+      * ptiff->band_count;
+  std::vector<WritePiece> pieces;
+  SPTW_ERROR err = SP_None;
+
+  if (lr_x >= ul_x && lr_y >= ul_y) {
+    // A bad area still takes part in the rounds, with no pieces, so that the
+    // other processes do not wait for it
+    if (ul_x < 0 || ul_y < 0 || lr_x >= ptiff->x_size
+        || lr_y >= ptiff->y_size) {
+      err = SP_BadArg;
+    }
+    for (int64_t tile_x = ul_x / ptiff->block_x_size;
+         err == SP_None && tile_x <= lr_x / ptiff->block_x_size; ++tile_x) {
+      const int64_t x = std::max(ul_x, tile_x * ptiff->block_x_size);
+      const int64_t end = std::min(lr_x,
+                                   (tile_x + 1) * ptiff->block_x_size - 1);
+      for (int64_t y = ul_y; y <= lr_y; ++y) {
+        if (tile_skipped(ptiff, tile_x, y / ptiff->block_y_size)) {
+          continue;
+        }
+        WritePiece piece;
+        piece.file_offset = calculate_file_offset(ptiff, x, y);
+        piece.data = static_cast<const char*>(data) + (y - ul_y) * row_stride
+            + (x - ul_x) * pixel_size;
+        piece.size = (end - x + 1) * pixel_size;
+        pieces.push_back(piece);
+      }
+    }
+    // File views need nondecreasing displacements
+    std::sort(pieces.begin(), pieces.end());
+  }
+
+  // Split the pieces into rounds. Every rank of the file, which is opened on
+  // MPI_COMM_WORLD, must make the same number of collective calls.
+  std::vector<size_t> round_starts(1, 0);
+  int64_t round_size = 0;
+  for (size_t i = 0; i < pieces.size(); ++i) {
+    if (round_size > 0 && round_size + pieces[i].size > kCollectiveRoundBytes) {
+      round_starts.push_back(i);
+      round_size = 0;
+    }
+    round_size += pieces[i].size;
+  }
+  round_starts.push_back(pieces.size());
+
+  int local_rounds = static_cast<int>(round_starts.size()) - 1;
+  int rounds = 0;
+  MPI_Allreduce(&local_rounds, &rounds, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+
+  for (int r = 0; r < rounds; ++r) {
+    size_t first = pieces.size(), last = pieces.size();
+    if (r < local_rounds) {
+      first = round_starts[r];
+      last = round_starts[r + 1];
+    }
+    const SPTW_ERROR round_err = write_round_all(
+        ptiff, pieces.empty() ? NULL : &pieces[0] + first, last - first);
+    if (err == SP_None) {
+      err = round_err;
+    }
+  }
+
+  // Independent writes address the file in bytes
+  char datarep[] = "native";
+  MPI_File_set_view(ptiff->fh, 0, MPI_BYTE, MPI_BYTE, datarep, MPI_INFO_NULL);
+  return err;
+}
+
+SPTW_ERROR write_area_compressed(PTIFF *ptiff,
+                                 void *data,
+                                 int64_t row_stride,
+                                 int64_t ul_x,
+                                 int64_t ul_y,
+                                 int64_t lr_x,
+                                 int64_t lr_y) {
+  const int64_t pixel_size = static_cast<int64_t>(ptiff->band_type_size)
+      * ptiff->band_count;
+  const int64_t tile_width = ptiff->block_x_size;
+  const int64_t tile_height = ptiff->block_y_size;
+  SPTW_ERROR err = SP_None;
+
+  // The compressed tiles of this process, back to back, and the raster order
+  // index and compressed size of each
+  std::vector<uint8_t> compressed;
+  std::vector<int64_t> tiles, sizes;
+  if (lr_x >= ul_x && lr_y >= ul_y) {
+    if (ptiff->compression == SP_Uncompressed
+        || ul_x < 0 || ul_y < 0 || lr_x >= ptiff->x_size
+        || lr_y >= ptiff->y_size
+        || ul_x % tile_width != 0 || ul_y % tile_height != 0
+        || ((lr_x + 1) % tile_width != 0 && lr_x != ptiff->x_size - 1)
+        || ((lr_y + 1) % tile_height != 0 && lr_y != ptiff->y_size - 1)) {
+      err = SP_BadArg;
+    }
+    std::vector<uint8_t> tile(tile_width * tile_height * pixel_size);
+    for (int64_t tile_y = ul_y / tile_height;
+         err == SP_None && tile_y <= lr_y / tile_height; ++tile_y) {
+      for (int64_t tile_x = ul_x / tile_width;
+           err == SP_None && tile_x <= lr_x / tile_width; ++tile_x) {
+        // Skipped tiles keep offset and byte count 0
+        if (tile_skipped(ptiff, tile_x, tile_y)) {
+          continue;
+        }
+        const int64_t x = tile_x * tile_width;
+        const int64_t y = tile_y * tile_height;
+        const int64_t columns = std::min(tile_width, ptiff->x_size - x);
+        const int64_t rows = std::min(tile_height, ptiff->y_size - y);
+        // Tiles on the right and bottom edges are padded with zeros
+        if (columns < tile_width || rows < tile_height) {
+          std::fill(tile.begin(), tile.end(), 0);
+        }
+        for (int64_t row = 0; row < rows; ++row) {
+          memcpy(&tile[row * tile_width * pixel_size],
+                 static_cast<const char*>(data) + (y - ul_y + row) * row_stride
+                 + (x - ul_x) * pixel_size,
+                 columns * pixel_size);
+        }
+        const size_t start = compressed.size();
+        if (!compress_tile(ptiff->compression, ptiff->compression_level,
+                           &tile[0], tile.size(), &compressed)) {
+          err = SP_WriteError;
+        }
+        tiles.push_back(tile_y * ptiff->tiles_across + tile_x);
+        sizes.push_back(compressed.size() - start);
+      }
+    }
+  }
+
+  // Every process stores its tiles after those of the lower ranks
+  int rank = 0;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  long long local_size = err == SP_None ? compressed.size() : 0;
+  long long preceding_size = 0, total_size = 0;
+  MPI_Exscan(&local_size, &preceding_size, 1, MPI_LONG_LONG, MPI_SUM,
+             MPI_COMM_WORLD);
+  MPI_Allreduce(&local_size, &total_size, 1, MPI_LONG_LONG, MPI_SUM,
+                MPI_COMM_WORLD);
+  // MPI_Exscan leaves the result of the first rank undefined
+  if (rank == 0) {
+    preceding_size = 0;
+  }
+  const int64_t first_offset = ptiff->next_tile_offset + preceding_size;
+  ptiff->next_tile_offset += total_size;
+  if (err != SP_None || compressed.empty()) {
+    return err;
+  }
+
+  int64_t offset = first_offset;
+  for (size_t i = 0; i < tiles.size(); ++i) {
+    ptiff->tile_offsets[tiles[i]] = offset;
+    ptiff->tile_byte_counts[tiles[i]] = sizes[i];
+    offset += sizes[i];
+  }
+  return write_bytes(ptiff,
+                     first_offset,
+                     reinterpret_cast<char*>(&compressed[0]),
+                     compressed.size());
+}
+
+SPTW_ERROR write_area_async(PTIFF *ptiff,
+                            void *data,
+                            int64_t row_stride,
+                            int64_t ul_x,
+                            int64_t ul_y,
+                            int64_t lr_x,
+                            int64_t lr_y,
+                            WriteRequest *request) {
+  const int64_t pixel_size = static_cast<int64_t>(ptiff->band_type_size)
+      * ptiff->band_count;
+  if (ul_x < 0 || ul_y < 0 || lr_x >= ptiff->x_size || lr_y >= ptiff->y_size
+      || (lr_x - ul_x + 1) * pixel_size > INT_MAX) {
+    return SP_BadArg;
+  }
+
+  for (int64_t tile_y = ul_y / ptiff->block_y_size;
+       tile_y <= lr_y / ptiff->block_y_size; ++tile_y) {
+    const int64_t y = std::max(ul_y, tile_y * ptiff->block_y_size);
+    const int64_t y_end = std::min(lr_y,
+                                   (tile_y + 1) * ptiff->block_y_size - 1);
+    for (int64_t tile_x = ul_x / ptiff->block_x_size;
+         tile_x <= lr_x / ptiff->block_x_size; ++tile_x) {
+      if (tile_skipped(ptiff, tile_x, tile_y)) {
+        continue;
+      }
+      const int64_t x = std::max(ul_x, tile_x * ptiff->block_x_size);
+      const int64_t x_end = std::min(lr_x,
+                                     (tile_x + 1) * ptiff->block_x_size - 1);
+      const int sub_row_size = static_cast<int>((x_end - x + 1) * pixel_size);
+      char *first = static_cast<char*>(data) + (y - ul_y) * row_stride
+          + (x - ul_x) * pixel_size;
+
+      if (x == tile_x * ptiff->block_x_size
+          && x_end == (tile_x + 1) * ptiff->block_x_size - 1) {
+        // The rows are consecutive in the tile, one request writes them from
+        // the strided buffer
+        MPI_Datatype rows;
+        MPI_Type_create_hvector(static_cast<int>(y_end - y + 1),
+                                sub_row_size,
+                                static_cast<MPI_Aint>(row_stride),
+                                MPI_BYTE,
+                                &rows);
+        MPI_Type_commit(&rows);
+        MPI_Request write;
+        const int rc = MPI_File_iwrite_at(ptiff->fh,
+                                          calculate_file_offset(ptiff, x, y),
+                                          first, 1, rows, &write);
+        // Pending writes keep using a freed datatype until they complete
+        MPI_Type_free(&rows);
+        if (rc != MPI_SUCCESS) {
+          return SP_WriteError;
+        }
+        request->requests.push_back(write);
+        continue;
+      }
+
+      for (int64_t row = y; row <= y_end; ++row) {
+        MPI_Request write;
+        if (MPI_File_iwrite_at(ptiff->fh,
+                               calculate_file_offset(ptiff, x, row),
+                               first + (row - y) * row_stride,
+                               sub_row_size,
+                               MPI_BYTE,
+                               &write) != MPI_SUCCESS) {
+          return SP_WriteError;
+        }
+        request->requests.push_back(write);
+      }
+    }
+  }
+  return SP_None;
+}
+
+SPTW_ERROR wait_write(WriteRequest *request) {
+  if (request->requests.empty()) {
+    return SP_None;
+  }
+  const int rc = MPI_Waitall(static_cast<int>(request->requests.size()),
+                             &request->requests[0],
+                             MPI_STATUSES_IGNORE);
+  request->requests.clear();
+  return rc == MPI_SUCCESS ? SP_None : SP_WriteError;
+}
 }
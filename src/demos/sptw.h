@@ -22,6 +22,7 @@
 #include <gdal_priv.h>
 #include <mpi.h>
 #include <string>
+#include <vector>
 
 #include "src/rasterchunk.h"
 #include "src/std_int.h"
@@ -54,6 +55,17 @@ enum SPTW_ERROR {
   SP_CreateError, /*!< Error creating the file */
   SP_WriteError, /*!< Error Writing to the file */
   SP_BadArg, /*!< A bad argument was provided */
+  SP_ReadError, /*!< Error reading from the file */
+};
+
+/*!
+ * This enum lists the tile compressions supported by create_raster_direct.
+ */
+enum SPTW_COMPRESSION {
+  SP_Uncompressed, /*!< Tiles are stored as they are */
+  SP_Deflate, /*!< Tiles are compressed with zlib */
+  SP_LZW, /*!< Tiles are compressed with TIFF LZW */
+  SP_ZSTD, /*!< Tiles are compressed with Zstandard, if built with it */
 };
 
 /**
@@ -88,8 +100,81 @@ struct PTIFF {
   int64_t tiles_across;
   /* Number of tiles down raster */
   int64_t tiles_down;
+  /*! Compression of the tiles, see write_area_compressed */
+  SPTW_COMPRESSION compression;
+  /*! Compression level, -1 for the default of the compression */
+  int compression_level;
+  /*! Byte count of every compressed tile this process wrote, or NULL */
+  int64_t *tile_byte_counts;
+  /*! Byte offsets of the tile offset and byte count arrays */
+  int64_t tile_offsets_location;
+  int64_t tile_byte_counts_location;
+  /*! Byte offset at which the next compressed tiles are stored, the same on
+   *  every process */
+  int64_t next_tile_offset;
+  /*! True for overviews, whose file handle is that of the full resolution
+   *  PTIFF, see open_overview */
+  bool shared_file;
+  /*! Level of an overview, 0 for the full resolution */
+  int overview_level;
+  /*! Nonzero for every tile this process left unallocated with skip_tile,
+   *  NULL if there are none */
+  uint8_t *skipped_tiles;
+};
+
+/**
+ * @struct WriteRequest sptw.h
+ * @brief WriteRequest holds the pending writes started by write_area_async
+ *
+ */
+struct WriteRequest {
+  /*! One MPI-IO request per tile written whole in width, or per row of a
+   *  tile written in part */
+  std::vector<MPI_Request> requests;
+};
+
+/**
+ * @struct RasterLayout sptw.h
+ * @brief RasterLayout describes a raster written by create_raster_direct, it
+ * is all that is needed to compute where each tile is stored.
+ *
+ */
+struct RasterLayout {
+  /*! Size of the raster in the x dimension */
+  int64_t x_size;
+  /*! Size of the raster in the y dimension */
+  int64_t y_size;
+  /*! Number of bands in the raster */
+  int band_count;
+  /*! Datatype of the band values */
+  GDALDataType band_type;
+  /*! Width and height of each tile */
+  int64_t tile_size;
+  /*! Every tile starts at a multiple of this many bytes, 0 or 1 if the tiles
+   *  are packed */
+  int64_t tile_alignment;
+  /*! Byte offset to the first tile, the tiles of the overviews, from the
+   *  smallest, and then those of the full resolution follow it */
+  int64_t first_tile_offset;
+  /*! Compression of the tiles */
+  SPTW_COMPRESSION compression;
+  /*! Compression level, -1 for the default of the compression */
+  int compression_level;
+  /*! Byte offsets of the tile offset and byte count arrays */
+  int64_t tile_offsets_location;
+  int64_t tile_byte_counts_location;
+  /*! Number of overviews, each half the size of the image before it */
+  int overview_count;
 };
 
+/**
+ * @brief
+ * This function fills the tile offset and byte count arrays of a tiled file
+ * created by GDAL. If tile_alignment is larger than 1 every tile starts at a
+ * multiple of tile_alignment bytes, e.g. the stripe size of the filesystem,
+ * and the tiles are moved to the end of the file.
+ *
+ */
 SPTW_ERROR populate_tile_offsets(PTIFF *tiff_file,
                                  int64_t tile_size,
                                  int64_t tile_alignment);
@@ -110,9 +195,171 @@ SPTW_ERROR create_tiled_raster(string filename,
                                double *geotransform,
                                string projection_srs,
                                int64_t tile_size);
-PTIFF* open_raster(string filename);
+
+/**
+ * @brief
+ * This function creates a tiled BigTIFF without writing it
+ * through GDAL. The header, the image directory with the GeoTIFF keys and the
+ * tile offset and byte count arrays are written with a single sequential
+ * write and the file is extended over its tiles, which are stored in raster
+ * order or in tile_order. GDAL is only used to encode the GeoTIFF keys of a
+ * one pixel template in memory. It is meant to be called by a single
+ * process, the layout it returns is then shared with the others for
+ * open_raster.
+ *
+ * @param filename Path of the file to create
+ * @param x_size Size of the raster in the x dimension
+ * @param y_size Size of the raster in the y dimension
+ * @param band_count Number of bands in the raster
+ * @param band_type Datatype of the band values
+ * @param geotransform The six GDAL geotransform coefficients of the raster
+ * @param projection_srs WKT of the projection of the raster
+ * @param tile_size Width and height of the tiles, a multiple of 16
+ * @param tile_alignment If larger than 1, the first tile and the space
+ *        taken by each tile are rounded up to a multiple of this many bytes,
+ *        e.g. the stripe size of the filesystem, so that no tile straddles
+ *        a stripe boundary it does not have to
+ * @param compression Compression of the tiles. Compressed tiles can only be
+ *        written with write_area_compressed, they are stored in the order
+ *        they are written and tile_alignment and tile_order do not apply.
+ * @param compression_level Level of the compression, -1 for its default
+ * @param color_table Color table of the first band, or NULL
+ * @param layout Receives the layout of the file
+ * @param tile_order If not NULL, the raster order indices of every tile in
+ *        the order the tiles are stored in the file, e.g. so that the tiles
+ *        each process writes are contiguous. The offset table keeps the
+ *        file valid in any order.
+ * @param info MPI-IO hints the file is created with, such as
+ *        striping_factor and striping_unit
+ * @param overview_count Number of overviews, each half the size of the
+ *        image before it, rounded up. The file then follows the Cloud
+ *        Optimized GeoTIFF layout: the directories of the full resolution
+ *        and of the overviews come first, then the tiles of the overviews
+ *        from the smallest and the full resolution tiles last. Overviews
+ *        need uncompressed tiles and are written through open_overview.
+ * @param nodata If not empty, the nodata value of every band. Tiles left
+ *        unallocated with skip_tile read as this value, without it they
+ *        read as 0.
+ *
+ */
+SPTW_ERROR create_raster_direct(string filename,
+                                int64_t x_size,
+                                int64_t y_size,
+                                int band_count,
+                                GDALDataType band_type,
+                                double *geotransform,
+                                string projection_srs,
+                                int64_t tile_size,
+                                int64_t tile_alignment,
+                                SPTW_COMPRESSION compression,
+                                int compression_level,
+                                GDALColorTable *color_table,
+                                RasterLayout *layout,
+                                const std::vector<int64_t> *tile_order = NULL,
+                                MPI_Info info = MPI_INFO_NULL,
+                                int overview_count = 0,
+                                string nodata = "");
+
+/**
+ * @brief
+ * This function returns the number of overviews a Cloud Optimized GeoTIFF
+ * of x_size by y_size pixels has, enough for the smallest to fit in one
+ * tile.
+ *
+ */
+int cog_overview_count(int64_t x_size, int64_t y_size, int64_t tile_size);
+
+PTIFF* open_raster(string filename, MPI_Info info = MPI_INFO_NULL);
+
+/**
+ * @brief
+ * This function opens a raster created by create_raster_direct. The tile
+ * offsets are computed from layout, the file is only opened with MPI-IO.
+ * Every process must call it.
+ *
+ * @param filename Path of the file to open
+ * @param layout The layout returned by create_raster_direct
+ * @param tile_order The tile order the file was created with, or NULL
+ * @param info MPI-IO hints, such as cb_nodes or romio_cb_write
+ *
+ */
+PTIFF* open_raster(string filename,
+                   const RasterLayout &layout,
+                   const std::vector<int64_t> *tile_order = NULL,
+                   MPI_Info info = MPI_INFO_NULL);
+
+/**
+ * @brief
+ * This function opens an overview of a raster opened with
+ * open_raster(filename, layout). The overview shares the file of ptiff and
+ * is written like any other PTIFF. It must be closed with close_raster
+ * before ptiff. It is not collective.
+ *
+ * @param ptiff The full resolution raster
+ * @param layout The layout returned by create_raster_direct
+ * @param level Level of the overview, from 1 to layout.overview_count
+ *
+ * @return Returns NULL if the file has no such overview.
+ */
+PTIFF* open_overview(PTIFF *ptiff, const RasterLayout &layout, int level);
+
+/**
+ * @brief
+ * This function closes the PTIFF. For compressed files, and files whose
+ * tiles were skipped with skip_tile, it first writes the tile offset and
+ * byte count arrays collectively, so every process must call it for files
+ * opened with a layout and for overviews.
+ *
+ */
 SPTW_ERROR close_raster(PTIFF *ptiff);
 
+/**
+ * @brief
+ * This function leaves a tile of a PTIFF opened with a layout, or of an
+ * overview, unallocated, e.g. because it only holds the fill value. The
+ * writes of this process skip the tile and close_raster stores it with
+ * offset and byte count 0, which readers such as GDAL read as the nodata
+ * value given to create_raster_direct, or as 0 without one, so a tile
+ * holding any other fill value must not be skipped from a file created
+ * without it. Only the process that writes the whole tile may skip it, and tiles
+ * that are read back with read_area_strided must not be skipped.
+ *
+ * @param ptiff The open PTIFF file
+ * @param tile_x Column of the tile
+ * @param tile_y Row of the tile
+ *
+ * @return Returns SP_BadArg if the tile does not exist or the tile arrays of
+ *         the file are not known.
+ */
+SPTW_ERROR skip_tile(PTIFF *ptiff, int64_t tile_x, int64_t tile_y);
+
+/**
+ * @brief
+ * This function returns the byte offset in the file of the pixel
+ * (raster_x, raster_y) of a tiled PTIFF, from its tile offsets. Offsets are
+ * computed in 64 bits, so rasters and tiles past 2^31 bytes are addressed.
+ *
+ * @param tiff_file The open PTIFF
+ * @param raster_x y-down x coordinate of the pixel
+ * @param raster_y y-down y coordinate of the pixel
+ *
+ */
+int64_t calculate_file_offset(PTIFF *tiff_file,
+                              const int64_t raster_x,
+                              const int64_t raster_y);
+
+/**
+ * @brief
+ * This function returns the byte offset in the file of the pixel
+ * (chunk_x, chunk_y) of chunk, which is placed in the raster at its
+ * raster_location_. See calculate_file_offset.
+ *
+ */
+int64_t chunk_to_file_offset(PTIFF *tiff_file,
+                             librasterblaster::RasterChunk *chunk,
+                             int64_t chunk_x,
+                             int64_t chunk_y);
+
 /**
  * @brief
  * This function writes the given buffer to the open PTIFF. The
@@ -139,6 +386,190 @@ SPTW_ERROR write_area(PTIFF *ptiff,
                       int64_t ul_y,
                       int64_t lr_x,
                       int64_t lr_y);
+
+/**
+ * @brief
+ * This function writes the given buffer to the open PTIFF, like write_area,
+ * but the rows of the buffer are row_stride bytes apart. This allows writing
+ * a window of a larger buffer without copying it first.
+ *
+ * @param ptiff The open PTIFF file to be written to
+ * @param data buffer containing, row-wise, pixel interleaved data to be
+ *        written to the file
+ * @param row_stride Distance, in bytes, between the starts of consecutive rows
+ *        of data
+ * @param ul_x Upper-left, inclusive, y-down, x coordinate of the area to be
+ *             written
+ * @param ul_y Upper-left, inclusive, y-down, y coordinate of the area to be
+ *             written
+ * @param lr_x Lower-right, inclusive, y-down, x coordinate of the area to be
+ *             written
+ * @param lr_y Lower-right, inclusive, y-down, y coordinate of the area to be
+ *             written
+ *
+ */
+SPTW_ERROR write_area_strided(PTIFF *ptiff,
+                              void *data,
+                              int64_t row_stride,
+                              int64_t ul_x,
+                              int64_t ul_y,
+                              int64_t lr_x,
+                              int64_t lr_y);
+
+/**
+ * @brief
+ * This function reads an area of an uncompressed PTIFF into the given
+ * buffer, the reverse of write_area_strided. It is not collective, so the
+ * processes must synchronize the file themselves to read what others wrote.
+ *
+ * @param ptiff The open PTIFF file to be read from
+ * @param data buffer that receives, row-wise, the pixel interleaved data
+ * @param row_stride Distance, in bytes, between the starts of consecutive rows
+ *        of data
+ * @param ul_x Upper-left, inclusive, y-down, x coordinate of the area to be
+ *             read
+ * @param ul_y Upper-left, inclusive, y-down, y coordinate of the area to be
+ *             read
+ * @param lr_x Lower-right, inclusive, y-down, x coordinate of the area to be
+ *             read
+ * @param lr_y Lower-right, inclusive, y-down, y coordinate of the area to be
+ *             read
+ *
+ */
+SPTW_ERROR read_area_strided(PTIFF *ptiff,
+                             void *data,
+                             int64_t row_stride,
+                             int64_t ul_x,
+                             int64_t ul_y,
+                             int64_t lr_x,
+                             int64_t lr_y);
+
+/**
+ * @brief
+ * This function makes what every process has written to the file of ptiff
+ * visible to read_area_strided on every process. It is collective.
+ *
+ */
+SPTW_ERROR sync_raster(PTIFF *ptiff);
+
+/**
+ * @brief
+ * This function writes the given buffer to the open PTIFF, like
+ * write_area_strided, with collective MPI-IO. The tile sub-rows of the area
+ * are described to MPI-IO as a single file view and written with
+ * MPI_File_write_at_all, so the MPI-IO layer can aggregate the writes of all
+ * processes into large contiguous requests. Areas larger than 256MB are
+ * written in several rounds.
+ *
+ * Every process that opened the file must call this function the same
+ * number of times. A process with nothing to write passes an empty area,
+ * e.g. with lr_x < ul_x. A process whose area is outside of the raster gets
+ * SP_BadArg, but still takes part in the collective calls.
+ *
+ * @param ptiff The open PTIFF file to be written to
+ * @param data buffer containing, row-wise, pixel interleaved data to be
+ *        written to the file
+ * @param row_stride Distance, in bytes, between the starts of consecutive rows
+ *        of data
+ * @param ul_x Upper-left, inclusive, y-down, x coordinate of the area to be
+ *             written
+ * @param ul_y Upper-left, inclusive, y-down, y coordinate of the area to be
+ *             written
+ * @param lr_x Lower-right, inclusive, y-down, x coordinate of the area to be
+ *             written
+ * @param lr_y Lower-right, inclusive, y-down, y coordinate of the area to be
+ *             written
+ *
+ */
+SPTW_ERROR write_area_all(PTIFF *ptiff,
+                          void *data,
+                          int64_t row_stride,
+                          int64_t ul_x,
+                          int64_t ul_y,
+                          int64_t lr_x,
+                          int64_t lr_y);
+
+/**
+ * @brief
+ * This function compresses the tiles of the given area of a compressed
+ * PTIFF and writes them. Each process compresses its own tiles, the
+ * compressed sizes are summed with MPI_Exscan to give every process a
+ * contiguous extent after the tiles written before, and each process writes
+ * its extent with a single write. The tile offset and byte count arrays
+ * are written by close_raster.
+ *
+ * Every process that opened the file must call this function the same
+ * number of times. A process with nothing to write passes an empty area,
+ * e.g. with lr_x < ul_x. The area must be made of whole tiles, except at
+ * the right and bottom edges of the raster, and each tile must be written
+ * once.
+ *
+ * @param ptiff The open PTIFF file to be written to
+ * @param data buffer containing, row-wise, pixel interleaved data to be
+ *        written to the file
+ * @param row_stride Distance, in bytes, between the starts of consecutive rows
+ *        of data
+ * @param ul_x Upper-left, inclusive, y-down, x coordinate of the area to be
+ *             written
+ * @param ul_y Upper-left, inclusive, y-down, y coordinate of the area to be
+ *             written
+ * @param lr_x Lower-right, inclusive, y-down, x coordinate of the area to be
+ *             written
+ * @param lr_y Lower-right, inclusive, y-down, y coordinate of the area to be
+ *             written
+ *
+ */
+SPTW_ERROR write_area_compressed(PTIFF *ptiff,
+                                 void *data,
+                                 int64_t row_stride,
+                                 int64_t ul_x,
+                                 int64_t ul_y,
+                                 int64_t lr_x,
+                                 int64_t lr_y);
+
+/**
+ * @brief
+ * This function starts writing the given buffer to the open PTIFF, like
+ * write_area_strided, with non-blocking MPI-IO and returns without waiting
+ * for the writes. Each tile is written straight from data, through a strided
+ * memory datatype, so data must not be modified or freed until wait_write
+ * has returned.
+ *
+ * @param ptiff The open PTIFF file to be written to
+ * @param data buffer containing, row-wise, pixel interleaved data to be
+ *        written to the file
+ * @param row_stride Distance, in bytes, between the starts of consecutive rows
+ *        of data
+ * @param ul_x Upper-left, inclusive, y-down, x coordinate of the area to be
+ *             written
+ * @param ul_y Upper-left, inclusive, y-down, y coordinate of the area to be
+ *             written
+ * @param lr_x Lower-right, inclusive, y-down, x coordinate of the area to be
+ *             written
+ * @param lr_y Lower-right, inclusive, y-down, y coordinate of the area to be
+ *             written
+ * @param request Receives the started writes, in addition to any it already
+ *        holds. It must be passed to wait_write even if an error is returned.
+ *
+ */
+SPTW_ERROR write_area_async(PTIFF *ptiff,
+                            void *data,
+                            int64_t row_stride,
+                            int64_t ul_x,
+                            int64_t ul_y,
+                            int64_t lr_x,
+                            int64_t lr_y,
+                            WriteRequest *request);
+
+/**
+ * @brief
+ * This function waits for every write held by request and empties it.
+ *
+ * @param request Writes started by write_area_async
+ *
+ * @return Returns SP_WriteError if any of the writes failed.
+ */
+SPTW_ERROR wait_write(WriteRequest *request);
 }
 
 #endif  // SRC_DEMOS_SPTW_H_
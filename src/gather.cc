@@ -0,0 +1,232 @@
+//
+// Copyright 0000 <Nobody>
+// @file
+// @author David Matthew Mattli <dmattli@usgs.gov>
+//
+// @section LICENSE
+//
+// This software is in the public domain, furnished "as is", without
+// technical support, and with no warranty, express or implied, as to
+// its usefulness for any purpose.
+//
+// @section DESCRIPTION
+//
+// Gather kernels that copy source pixels into a destination buffer as
+// directed by a source index map.
+//
+//
+
+#include "src/gather.h"
+
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PRB_X86_GATHER 1
+#include <immintrin.h>
+#endif
+
+#include "src/std_int.h"
+
+namespace librasterblaster {
+/** \cond DOXYHIDE **/
+// Scalar kernel for pixels of PixelSize bytes. memcpy with a constant size
+// compiles to plain loads and stores.
+template <size_t PixelSize>
+void GatherFixed(const int32_t *index_map,
+                 int64_t begin,
+                 int64_t count,
+                 const char *source,
+                 const void *fill_pixel,
+                 char *destination) {
+  for (int64_t i = begin; i < count; ++i) {
+    const int32_t index = index_map[i];
+    const void *pixel = index == kFillIndex
+        ? fill_pixel
+        : source + static_cast<int64_t>(index) * PixelSize;
+    memcpy(destination + i * PixelSize, pixel, PixelSize);
+  }
+}
+
+void GatherGeneric(const int32_t *index_map,
+                   int64_t count,
+                   const char *source,
+                   size_t pixel_size,
+                   const void *fill_pixel,
+                   char *destination) {
+  for (int64_t i = 0; i < count; ++i) {
+    const int32_t index = index_map[i];
+    const void *pixel = index == kFillIndex
+        ? fill_pixel
+        : source + static_cast<int64_t>(index) * pixel_size;
+    memcpy(destination + i * pixel_size, pixel, pixel_size);
+  }
+}
+
+// The vector kernels below load a block of indices, build a mask of the
+// lanes that are not kFillIndex and gather only those lanes. Masked-off lanes
+// keep the fill value and never touch source memory. They return the number
+// of pixels handled, the caller finishes the remainder with the scalar kernel.
+// Each kernel is compiled for its own instruction set with the target
+// attribute, so a default build still carries them and SelectGather picks
+// one for the processor at run time.
+typedef int64_t (*VectorGather)(const int32_t *index_map,
+                                int64_t count,
+                                const char *source,
+                                const void *fill_pixel,
+                                char *destination);
+
+int64_t GatherNone(const int32_t *, int64_t, const char *, const void *,
+                   char *) {
+  return 0;
+}
+
+#ifdef PRB_X86_GATHER
+__attribute__((target("avx2")))
+int64_t Gather32Avx2(const int32_t *index_map,
+                     int64_t count,
+                     const char *source,
+                     const void *fill_pixel,
+                     char *destination) {
+  int64_t i = 0;
+  int32_t fill;
+  memcpy(&fill, fill_pixel, sizeof(fill));
+  const __m256i fill8 = _mm256_set1_epi32(fill);
+  const __m256i fill_index8 = _mm256_set1_epi32(kFillIndex);
+  for (; i + 8 <= count; i += 8) {
+    const __m256i index = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(index_map + i));
+    const __m256i valid = _mm256_cmpgt_epi32(index, fill_index8);
+    const __m256i pixels = _mm256_mask_i32gather_epi32(
+        fill8, reinterpret_cast<const int*>(source), index, valid, 4);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(destination + i * 4),
+                        pixels);
+  }
+  return i;
+}
+
+__attribute__((target("avx512f")))
+int64_t Gather32Avx512(const int32_t *index_map,
+                       int64_t count,
+                       const char *source,
+                       const void *fill_pixel,
+                       char *destination) {
+  int64_t i = 0;
+  int32_t fill;
+  memcpy(&fill, fill_pixel, sizeof(fill));
+  const __m512i fill16 = _mm512_set1_epi32(fill);
+  const __m512i zero16 = _mm512_setzero_si512();
+  for (; i + 16 <= count; i += 16) {
+    const __m512i index = _mm512_loadu_si512(index_map + i);
+    const __mmask16 valid = _mm512_cmpge_epi32_mask(index, zero16);
+    const __m512i pixels = _mm512_mask_i32gather_epi32(fill16, valid, index,
+                                                       source, 4);
+    _mm512_storeu_si512(destination + i * 4, pixels);
+  }
+  // AVX-512F implies AVX2, finish a block of 8 with the narrower kernel
+  return i + Gather32Avx2(index_map + i, count - i, source, fill_pixel,
+                          destination + i * 4);
+}
+
+__attribute__((target("avx2")))
+int64_t Gather64Avx2(const int32_t *index_map,
+                     int64_t count,
+                     const char *source,
+                     const void *fill_pixel,
+                     char *destination) {
+  int64_t i = 0;
+  long long fill;  // NOLINT(runtime/int) matches the intrinsic types
+  memcpy(&fill, fill_pixel, sizeof(fill));
+  const __m256i fill4 = _mm256_set1_epi64x(fill);
+  const __m128i fill_index4 = _mm_set1_epi32(kFillIndex);
+  for (; i + 4 <= count; i += 4) {
+    const __m128i index = _mm_loadu_si128(
+        reinterpret_cast<const __m128i*>(index_map + i));
+    const __m256i valid = _mm256_cvtepi32_epi64(
+        _mm_cmpgt_epi32(index, fill_index4));
+    const __m256i pixels = _mm256_mask_i32gather_epi64(
+        fill4, reinterpret_cast<const long long*>(source),  // NOLINT
+        index, valid, 8);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(destination + i * 8),
+                        pixels);
+  }
+  return i;
+}
+
+__attribute__((target("avx512f")))
+int64_t Gather64Avx512(const int32_t *index_map,
+                       int64_t count,
+                       const char *source,
+                       const void *fill_pixel,
+                       char *destination) {
+  int64_t i = 0;
+  long long fill;  // NOLINT(runtime/int) matches the intrinsic types
+  memcpy(&fill, fill_pixel, sizeof(fill));
+  const __m512i fill8 = _mm512_set1_epi64(fill);
+  const __m256i fill_index8 = _mm256_set1_epi32(kFillIndex);
+  for (; i + 8 <= count; i += 8) {
+    const __m256i index = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(index_map + i));
+    const __mmask8 valid = static_cast<__mmask8>(_mm256_movemask_ps(
+        _mm256_castsi256_ps(_mm256_cmpgt_epi32(index, fill_index8))));
+    const __m512i pixels = _mm512_mask_i32gather_epi64(fill8, valid, index,
+                                                       source, 8);
+    _mm512_storeu_si512(destination + i * 8, pixels);
+  }
+  return i + Gather64Avx2(index_map + i, count - i, source, fill_pixel,
+                          destination + i * 8);
+}
+
+// Returns the widest of the given kernels the processor supports
+VectorGather SelectGather(VectorGather avx512, VectorGather avx2) {
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) {
+    return avx512;
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    return avx2;
+  }
+  return GatherNone;
+}
+
+const VectorGather Gather32 = SelectGather(Gather32Avx512, Gather32Avx2);
+const VectorGather Gather64 = SelectGather(Gather64Avx512, Gather64Avx2);
+#else
+const VectorGather Gather32 = GatherNone;
+const VectorGather Gather64 = GatherNone;
+#endif
+/** \endcond **/
+
+void GatherPixels(const int32_t *index_map,
+                  int64_t count,
+                  const void *source,
+                  size_t pixel_size,
+                  const void *fill_pixel,
+                  void *destination) {
+  const char *in = static_cast<const char*>(source);
+  char *out = static_cast<char*>(destination);
+  int64_t done = 0;
+
+  switch (pixel_size) {
+    case 1:
+      GatherFixed<1>(index_map, 0, count, in, fill_pixel, out);
+      break;
+    case 2:
+      GatherFixed<2>(index_map, 0, count, in, fill_pixel, out);
+      break;
+    case 4:
+      done = Gather32(index_map, count, in, fill_pixel, out);
+      GatherFixed<4>(index_map, done, count, in, fill_pixel, out);
+      break;
+    case 8:
+      done = Gather64(index_map, count, in, fill_pixel, out);
+      GatherFixed<8>(index_map, done, count, in, fill_pixel, out);
+      break;
+    case 16:
+      GatherFixed<16>(index_map, 0, count, in, fill_pixel, out);
+      break;
+    default:
+      GatherGeneric(index_map, count, in, pixel_size, fill_pixel, out);
+      break;
+  }
+}
+}
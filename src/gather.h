@@ -0,0 +1,57 @@
+/*!
+ * Copyright 0000 <Nobody>
+ * @file
+ * @author David Matthew Mattli <dmattli@usgs.gov>
+ *
+ * @section LICENSE
+ *
+ * This software is in the public domain, furnished "as is", without
+ * technical support, and with no warranty, express or implied, as to
+ * its usefulness for any purpose.
+ *
+ * @section DESCRIPTION
+ *
+ * Gather kernels that copy source pixels into a destination buffer as
+ * directed by a source index map.
+ *
+ */
+
+#ifndef SRC_GATHER_H_
+#define SRC_GATHER_H_
+
+#include <cstddef>
+
+#include "src/std_int.h"
+
+namespace librasterblaster {
+/**
+ * @brief Value used in a source index map for pixels that get the fill value.
+ */
+const int32_t kFillIndex = -1;
+
+/**
+ * @brief GatherPixels copies whole pixels from source to destination using
+ * a source index map.
+ *
+ * Destination pixel i is set to source pixel index_map[i], or to fill_pixel
+ * when index_map[i] is kFillIndex. A pixel is pixel_size bytes, i.e. every
+ * band of a pixel-interleaved buffer is copied at once. Pixels of 4 and 8
+ * bytes use AVX2 or AVX-512 masked gathers when the processor supports them,
+ * the kernel is chosen at run time.
+ *
+ * @param index_map Source pixel index for each destination pixel
+ * @param count Number of destination pixels
+ * @param source Source pixel buffer
+ * @param pixel_size Size in bytes of one pixel, all bands included
+ * @param fill_pixel Pixel value, pixel_size bytes, used for fill pixels
+ * @param destination Destination pixel buffer with room for count pixels
+ */
+void GatherPixels(const int32_t *index_map,
+                  int64_t count,
+                  const void *source,
+                  size_t pixel_size,
+                  const void *fill_pixel,
+                  void *destination);
+}
+
+#endif  // SRC_GATHER_H_
@@ -0,0 +1,337 @@
+//
+// Copyright 0000 <Nobody>
+// @file
+// @author David Matthew Mattli <dmattli@usgs.gov>
+//
+// @section LICENSE
+//
+// This software is in the public domain, furnished "as is", without
+// technical support, and with no warranty, express or implied, as to
+// its usefulness for any purpose.
+//
+// @section DESCRIPTION
+//
+// The MappedRaster class reads uncompressed GeoTIFF files through a memory
+// mapping.
+//
+//
+
+#include "src/mappedraster.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <tiffio.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace librasterblaster {
+MappedRaster::MappedRaster()
+    : column_count_(0), row_count_(0), pixel_size_(0), block_width_(0),
+      block_height_(0), blocks_across_(0), mapping_(NULL), mapping_size_(0),
+      sample_size_(0), tiled_(false) {
+}
+
+MappedRaster::~MappedRaster() {
+  if (mapping_ != NULL) {
+    munmap(const_cast<char*>(mapping_), mapping_size_);
+  }
+}
+
+MappedRaster *MappedRaster::Open(std::string filename) {
+  TIFF *tiff = TIFFOpen(filename.c_str(), "r");
+  if (tiff == NULL) {
+    return NULL;
+  }
+
+  uint32_t width = 0, length = 0;
+  uint16_t bits_per_sample = 0, samples_per_pixel = 0;
+  uint16_t compression = 0, planar_config = 0;
+  int ret = 1;
+  ret &= TIFFGetField(tiff, TIFFTAG_IMAGEWIDTH, &width);
+  ret &= TIFFGetField(tiff, TIFFTAG_IMAGELENGTH, &length);
+  ret &= TIFFGetFieldDefaulted(tiff, TIFFTAG_BITSPERSAMPLE, &bits_per_sample);
+  ret &= TIFFGetFieldDefaulted(tiff, TIFFTAG_SAMPLESPERPIXEL,
+                               &samples_per_pixel);
+  ret &= TIFFGetFieldDefaulted(tiff, TIFFTAG_COMPRESSION, &compression);
+  ret &= TIFFGetFieldDefaulted(tiff, TIFFTAG_PLANARCONFIG, &planar_config);
+
+  // Only raw, pixel-interleaved, native byte order samples can be used as
+  // they are stored
+  if (ret != 1
+      || compression != COMPRESSION_NONE
+      || (planar_config != PLANARCONFIG_CONTIG && samples_per_pixel > 1)
+      || bits_per_sample % 8 != 0
+      || TIFFIsByteSwapped(tiff)) {
+    TIFFClose(tiff);
+    return NULL;
+  }
+
+  MappedRaster *raster = new MappedRaster;
+  raster->column_count_ = width;
+  raster->row_count_ = length;
+  raster->sample_size_ = bits_per_sample / 8;
+  raster->pixel_size_ = static_cast<int64_t>(raster->sample_size_)
+      * samples_per_pixel;
+
+  toff_t *offsets = NULL;
+  toff_t *byte_counts = NULL;
+  int64_t block_count = 0;
+  const bool tiled = TIFFIsTiled(tiff);
+  if (tiled) {
+    uint32_t tile_width = 0, tile_length = 0;
+    ret = 1;
+    ret &= TIFFGetField(tiff, TIFFTAG_TILEWIDTH, &tile_width);
+    ret &= TIFFGetField(tiff, TIFFTAG_TILELENGTH, &tile_length);
+    ret &= TIFFGetField(tiff, TIFFTAG_TILEOFFSETS, &offsets);
+    ret &= TIFFGetField(tiff, TIFFTAG_TILEBYTECOUNTS, &byte_counts);
+    raster->block_width_ = tile_width;
+    raster->block_height_ = tile_length;
+  } else {
+    uint32_t rows_per_strip = 0;
+    ret = 1;
+    ret &= TIFFGetFieldDefaulted(tiff, TIFFTAG_ROWSPERSTRIP, &rows_per_strip);
+    ret &= TIFFGetField(tiff, TIFFTAG_STRIPOFFSETS, &offsets);
+    ret &= TIFFGetField(tiff, TIFFTAG_STRIPBYTECOUNTS, &byte_counts);
+    raster->block_width_ = width;
+    raster->block_height_ = std::min(rows_per_strip, length);
+  }
+
+  if (ret != 1 || raster->block_width_ <= 0 || raster->block_height_ <= 0) {
+    TIFFClose(tiff);
+    delete raster;
+    return NULL;
+  }
+  raster->tiled_ = tiled;
+  raster->blocks_across_ = (raster->column_count_ + raster->block_width_ - 1)
+      / raster->block_width_;
+  block_count = raster->blocks_across_
+      * ((raster->row_count_ + raster->block_height_ - 1)
+         / raster->block_height_);
+  raster->block_offsets_.assign(offsets, offsets + block_count);
+  raster->block_byte_counts_.assign(byte_counts, byte_counts + block_count);
+  TIFFClose(tiff);
+
+  if (!raster->Map(filename)) {
+    delete raster;
+    return NULL;
+  }
+  return raster;
+}
+
+MappedRaster *MappedRaster::Open(std::string filename,
+                                 const std::vector<int64_t> &description) {
+  const size_t kFieldCount = 8;
+  if (description.size() < kFieldCount) {
+    return NULL;
+  }
+  const int64_t block_count = description[7];
+  if (block_count < 0
+      || description.size() != kFieldCount + 2 * block_count) {
+    return NULL;
+  }
+
+  MappedRaster *raster = new MappedRaster;
+  raster->column_count_ = description[0];
+  raster->row_count_ = description[1];
+  raster->pixel_size_ = description[2];
+  raster->sample_size_ = static_cast<int>(description[3]);
+  raster->block_width_ = description[4];
+  raster->block_height_ = description[5];
+  raster->tiled_ = description[6] != 0;
+  if (raster->block_width_ <= 0 || raster->block_height_ <= 0
+      || raster->sample_size_ <= 0) {
+    delete raster;
+    return NULL;
+  }
+  raster->blocks_across_ = (raster->column_count_ + raster->block_width_ - 1)
+      / raster->block_width_;
+  if (block_count != raster->blocks_across_
+      * ((raster->row_count_ + raster->block_height_ - 1)
+         / raster->block_height_)) {
+    delete raster;
+    return NULL;
+  }
+  const int64_t *table = &description[kFieldCount];
+  raster->block_offsets_.assign(table, table + block_count);
+  raster->block_byte_counts_.assign(table + block_count,
+                                    table + 2 * block_count);
+
+  if (!raster->Map(filename)) {
+    delete raster;
+    return NULL;
+  }
+  return raster;
+}
+
+void MappedRaster::Describe(std::vector<int64_t> *description) const {
+  description->clear();
+  description->push_back(column_count_);
+  description->push_back(row_count_);
+  description->push_back(pixel_size_);
+  description->push_back(sample_size_);
+  description->push_back(block_width_);
+  description->push_back(block_height_);
+  description->push_back(tiled_ ? 1 : 0);
+  description->push_back(block_offsets_.size());
+  description->insert(description->end(), block_offsets_.begin(),
+                      block_offsets_.end());
+  description->insert(description->end(), block_byte_counts_.begin(),
+                      block_byte_counts_.end());
+}
+
+bool MappedRaster::Map(std::string filename) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0) {
+    close(fd);
+    return false;
+  }
+  mapping_size_ = static_cast<size_t>(file_stat.st_size);
+  void *mapping = mmap(NULL, mapping_size_, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    return false;
+  }
+  mapping_ = static_cast<const char*>(mapping);
+
+  // Every stored block must hold the whole block within the file. Strips
+  // may be shorter only at the bottom of the image.
+  for (size_t i = 0; i < block_offsets_.size(); ++i) {
+    if (block_byte_counts_[i] == 0) {
+      continue;
+    }
+    int64_t block_rows = block_height_;
+    if (!tiled_) {
+      block_rows = std::min(block_rows,
+                            row_count_ - static_cast<int64_t>(i)
+                            * block_height_);
+    }
+    const uint64_t block_size = static_cast<uint64_t>(block_rows)
+        * block_width_ * pixel_size_;
+    if (block_byte_counts_[i] < block_size
+        || block_offsets_[i] + block_size > mapping_size_) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+const char *MappedRaster::PixelAddress(int64_t x, int64_t y) const {
+  const int64_t block = (y / block_height_) * blocks_across_
+      + x / block_width_;
+  if (block_byte_counts_[block] == 0) {
+    return NULL;
+  }
+  return mapping_ + block_offsets_[block]
+      + ((y % block_height_) * block_width_ + x % block_width_) * pixel_size_;
+}
+
+void MappedRaster::SetNoDataValue(double value, GDALDataType type) {
+  const int samples = static_cast<int>(pixel_size_ / sample_size_);
+  missing_pixel_.resize(pixel_size_);
+  GDALCopyWords(&value, GDT_Float64, 0, &missing_pixel_[0], type,
+                sample_size_, samples);
+}
+
+bool MappedRaster::CanAttach(Area area) const {
+  const int64_t ul_x = area.ul.x;
+  const int64_t ul_y = area.ul.y;
+  const int64_t lr_x = area.lr.x;
+  const int64_t lr_y = area.lr.y;
+
+  const char *first = PixelAddress(ul_x, ul_y);
+  if (first == NULL
+      || reinterpret_cast<uintptr_t>(first) % sample_size_ != 0
+      || ul_x / block_width_ != lr_x / block_width_) {
+    return false;
+  }
+
+  // Consecutive blocks down the window must follow each other in the file
+  const int64_t block_size = block_height_ * block_width_ * pixel_size_;
+  for (int64_t y = ul_y / block_height_; y < lr_y / block_height_; ++y) {
+    const int64_t block = y * blocks_across_ + ul_x / block_width_;
+    const int64_t next = block + blocks_across_;
+    if (block_byte_counts_[next] == 0
+        || block_offsets_[next] != block_offsets_[block] + block_size
+        || block_width_ != column_count_) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+PRB_ERROR MappedRaster::ReadRasterChunk(RasterChunk *chunk,
+                                        const BlockResidency *residency) {
+  const int64_t type_size = GDALGetDataTypeSize(chunk->pixel_type_) / 8;
+  const int64_t ul_x = chunk->raster_location_.x;
+  const int64_t ul_y = chunk->raster_location_.y;
+  const int64_t lr_x = ul_x + chunk->column_count_ - 1;
+  const int64_t lr_y = ul_y + chunk->row_count_ - 1;
+
+  if (type_size * chunk->band_count_ != pixel_size_
+      || ul_x < 0 || ul_y < 0 || lr_x >= column_count_ || lr_y >= row_count_
+      || chunk->column_count_ <= 0 || chunk->row_count_ <= 0) {
+    return PRB_BADARG;
+  }
+
+  Area area(ul_x, ul_y, lr_x, lr_y);
+  if (CanAttach(area)) {
+    // The mapping is read-only, chunks used as a source are never written
+    chunk->AttachPixels(const_cast<char*>(PixelAddress(ul_x, ul_y)),
+                        block_width_ * pixel_size_);
+    return PRB_NOERROR;
+  }
+
+  if (chunk->pixels_ == NULL) {
+    return PRB_BADARG;
+  }
+
+  if (residency != NULL
+      && (residency->resident.empty()
+          || residency->block_width != block_width_
+          || residency->block_height != block_height_)) {
+    residency = NULL;
+  }
+
+  // Copy each row one block at a time
+  for (int64_t y = ul_y; y <= lr_y; ++y) {
+    char *row = static_cast<char*>(chunk->Row(y - ul_y));
+    for (int64_t x = ul_x; x <= lr_x;) {
+      const int64_t block_end = std::min(lr_x,
+                                         (x / block_width_ + 1)
+                                         * block_width_ - 1);
+      const size_t size = static_cast<size_t>((block_end - x + 1)
+                                              * pixel_size_);
+      // Blocks outside of the residency are never referenced by the kernels
+      if (residency == NULL
+          || residency->IsResident(x / block_width_, y / block_height_)) {
+        const char *source = PixelAddress(x, y);
+        char *out = row + (x - ul_x) * pixel_size_;
+        if (source != NULL) {
+          memcpy(out, source, size);
+        } else if (missing_pixel_.empty()) {
+          memset(out, 0, size);
+        } else {
+          for (int64_t i = 0; i <= block_end - x; ++i) {
+            memcpy(out + i * pixel_size_, &missing_pixel_[0], pixel_size_);
+          }
+        }
+      }
+      x = block_end + 1;
+    }
+  }
+
+  return PRB_NOERROR;
+}
+}
@@ -0,0 +1,145 @@
+//
+// Copyright 0000 <Nobody>
+// @file
+// @author David Matthew Mattli <dmattli@usgs.gov>
+//
+// @section LICENSE
+//
+// This software is in the public domain, furnished "as is", without
+// technical support, and with no warranty, express or implied, as to
+// its usefulness for any purpose.
+//
+// @section DESCRIPTION
+//
+// The MappedRaster class reads uncompressed GeoTIFF files through a memory
+// mapping.
+//
+//
+
+#ifndef SRC_MAPPEDRASTER_H_
+#define SRC_MAPPEDRASTER_H_
+
+#include <string>
+#include <vector>
+
+#include "src/rasterchunk.h"
+#include "src/std_int.h"
+#include "src/utils.h"
+
+namespace librasterblaster {
+/// A memory-mapped, uncompressed, tiled or striped TIFF file
+/**
+ * MappedRaster reads the tile or strip offsets of a TIFF file once and then
+ * serves RasterChunk reads straight from a read-only mapping of the file,
+ * bypassing GDAL and its block cache. When the requested window lies within
+ * one tile, or within strips that are stored back to back, the chunk is
+ * pointed at the mapping and no pixel is copied. Otherwise the rows of each
+ * tile are copied from the mapping into the chunk buffer.
+ *
+ * Only uncompressed, pixel-interleaved files in the byte order of the host
+ * qualify, which includes the files written by sptw. Chunks that refer to the
+ * mapping must be destroyed before the MappedRaster.
+ */
+class MappedRaster {
+ public:
+  /**
+   * @brief Maps the first image of a TIFF file.
+   *
+   * @param filename Path to the TIFF file
+   *
+   * @return Returns NULL if the file can not be opened or can not be read
+   *         through a mapping, e.g. because it is compressed.
+   */
+  static MappedRaster *Open(std::string filename);
+
+  /**
+   * @brief Maps a file that was opened elsewhere, e.g. by another process,
+   * without reading its header.
+   *
+   * @param filename Path to the TIFF file
+   * @param description What Describe returned for the file
+   *
+   * @return Returns NULL if the file can not be mapped or does not match the
+   *         description.
+   */
+  static MappedRaster *Open(std::string filename,
+                            const std::vector<int64_t> &description);
+
+  /**
+   * @brief Stores the geometry and the tile or strip table of the file in
+   * description, for Open(filename, description).
+   */
+  void Describe(std::vector<int64_t> *description) const;
+
+  /// MappedRaster destructor, unmaps the file
+  ~MappedRaster();
+
+  /**
+   * @brief Reads the pixels of chunk from the file. The chunk is attached to
+   * the mapping when possible, otherwise its buffer is filled. Tiles that are
+   * not stored in the file read as the value set with SetNoDataValue.
+   *
+   * @param chunk Chunk to read, with the band count and pixel type of the
+   *        file
+   * @param residency If not NULL and its blocks are the tiles or strips of
+   *        the file, blocks that are not marked are not copied. Attached
+   *        chunks only fault in the pages they touch anyway.
+   *
+   * @return Returns PRB_BADARG if the chunk does not match the file.
+   */
+  PRB_ERROR ReadRasterChunk(RasterChunk *chunk,
+                            const BlockResidency *residency = NULL);
+
+  /**
+   * @brief Sets the value of every sample of the tiles or strips that are
+   * not stored in the file, like GDAL fills them. The default is zero.
+   *
+   * @param value The nodata value of the file
+   * @param type Type of the samples of the file
+   */
+  void SetNoDataValue(double value, GDALDataType type);
+
+  /**
+   * @brief Returns true if the inclusive area, in raster coordinates, can be
+   * read without copying.
+   */
+  bool CanAttach(Area area) const;
+
+  /// Number of columns
+  int64_t column_count_;
+  /// Number of rows
+  int64_t row_count_;
+  /// Size of a pixel, in bytes, counting every band
+  int64_t pixel_size_;
+  /// Width of a tile, the image width for striped files
+  int64_t block_width_;
+  /// Height of a tile, or rows per strip
+  int64_t block_height_;
+  /// Number of tiles per row of tiles, 1 for striped files
+  int64_t blocks_across_;
+
+ private:
+  MappedRaster();
+  MappedRaster(const MappedRaster&);
+  MappedRaster& operator=(const MappedRaster&);
+
+  /// Maps the file and checks the block table against it, false on error
+  bool Map(std::string filename);
+
+  /// Returns the address of pixel (x, y), or NULL if its block is missing
+  const char *PixelAddress(int64_t x, int64_t y) const;
+
+  const char *mapping_;
+  size_t mapping_size_;
+  int sample_size_;
+  /// Whether the blocks are tiles rather than strips
+  bool tiled_;
+  /// Offset and byte count of every tile or strip
+  std::vector<uint64_t> block_offsets_;
+  std::vector<uint64_t> block_byte_counts_;
+  /// One pixel of the value of missing blocks, empty when it is zero
+  std::vector<char> missing_pixel_;
+};
+}
+
+#endif  // SRC_MAPPEDRASTER_H_
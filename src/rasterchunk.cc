@@ -17,16 +17,62 @@
 //
 
 #include <gdal.h>
+#include <limits.h>
+#include <math.h>
 #include <string.h>
 
+#include <algorithm>
+
+#include "src/chunkpool.h"
 #include "src/reprojection_tools.h"
 #include "src/rasterchunk.h"
 #include "src/utils.h"
 
 namespace librasterblaster {
-RasterChunk* RasterChunk::CreateRasterChunk(GDALDataset *ds, Area chunk_area) {
+/** \cond DOXYHIDE **/
+// Rounds value up to a multiple of step
+static int64_t RoundUp(int64_t value, int64_t step) {
+  return ((value + step - 1) / step) * step;
+}
+/** \endcond **/
+
+RasterDescriptor::RasterDescriptor()
+    : row_count(0), column_count(0), band_count(0), pixel_type(GDT_Unknown),
+      block_width(0), block_height(0), has_nodata(false), nodata(0.0) {
+  for (int i = 0; i < 6; ++i) {
+    geotransform[i] = 0.0;
+  }
+}
+
+RasterDescriptor::RasterDescriptor(GDALDataset *ds)
+    : projection(ds->GetProjectionRef()),
+      row_count(ds->GetRasterYSize()),
+      column_count(ds->GetRasterXSize()),
+      band_count(ds->GetRasterCount()),
+      pixel_type(ds->GetRasterBand(1)->GetRasterDataType()) {
+  ds->GetGeoTransform(geotransform);
+  ds->GetRasterBand(1)->GetBlockSize(&block_width, &block_height);
+  int nodata_set = 0;
+  nodata = ds->GetRasterBand(1)->GetNoDataValue(&nodata_set);
+  has_nodata = nodata_set != 0;
+}
+
+RasterChunk* RasterChunk::CreateRasterChunk(GDALDataset *ds,
+                                            Area chunk_area,
+                                            bool zero_pixels,
+                                            int row_alignment,
+                                            int halo) {
+  return CreateRasterChunk(RasterDescriptor(ds), chunk_area, zero_pixels,
+                           row_alignment, halo);
+}
+
+RasterChunk* RasterChunk::CreateRasterChunk(const RasterDescriptor &raster,
+                                            Area chunk_area,
+                                            bool zero_pixels,
+                                            int row_alignment,
+                                            int halo) {
   RasterChunk *temp = new RasterChunk;
-  double gt[6];
+  const double *gt = raster.geotransform;
 
   if (chunk_area.ul.x == -1.0) {  // Create a chunk with a single value for
                                   // resampling no data area.
@@ -37,68 +83,187 @@ RasterChunk* RasterChunk::CreateRasterChunk(GDALDataset *ds, Area chunk_area) {
               = 0.0;
   }
 
-  ds->GetGeoTransform(gt);
-  ds->GetGeoTransform(temp->geotransform_);
+  memcpy(temp->geotransform_, gt, 6*sizeof(double));
 
-  temp->projection_ = ds->GetProjectionRef();
+  temp->projection_ = raster.projection;
   temp->raster_location_ = chunk_area.ul;
   temp->ul_projected_corner_ = Coordinate(gt[0]+(chunk_area.ul.x*gt[1]),
                                           gt[3]-(chunk_area.ul.y*gt[1]),
                                           UNDEF);
   temp->pixel_size_ = gt[1];
-  temp->row_count_ = chunk_area.lr.y - chunk_area.ul.y + 1;
-  temp->column_count_ = chunk_area.lr.x - chunk_area.ul.x + 1;
-  temp->pixel_type_ = ds->GetRasterBand(1)->GetRasterDataType();
-  temp->band_count_ = ds->GetRasterCount();
+  temp->row_count_ = static_cast<int64_t>(chunk_area.lr.y
+                                          - chunk_area.ul.y + 1);
+  temp->column_count_ = static_cast<int64_t>(chunk_area.lr.x
+                                             - chunk_area.ul.x + 1);
+  temp->pixel_type_ = raster.pixel_type;
+  temp->band_count_ = raster.band_count;
   temp->pixels_ = NULL;
-
-  size_t buffer_size = (temp->row_count_ * temp->column_count_);
-  temp->pixels_ = static_cast<unsigned char*>
-      (calloc(buffer_size, GDALGetDataTypeSize(temp->pixel_type_)/8));
-
-  if (temp->pixels_ == NULL) {
+  temp->halo_ = halo < 0 ? 0 : halo;
+
+  // Pixels are stored pixel-interleaved, every band of a pixel is adjacent.
+  const int64_t pixel_size = static_cast<int64_t>(
+      GDALGetDataTypeSize(temp->pixel_type_)/8) * temp->band_count_;
+  int64_t leading = 0;
+  temp->row_stride_ = RowStride(temp->column_count_,
+                                pixel_size,
+                                row_alignment,
+                                temp->halo_,
+                                &leading);
+  temp->pixel_offset_ = static_cast<size_t>(temp->halo_ * temp->row_stride_
+                                            + leading);
+
+  void *buffer = ChunkBufferPool::Instance()->Acquire(
+      temp->PixelBufferSize(), zero_pixels);
+
+  if (buffer == NULL) {
     fprintf(stderr, "Allocation error!\n");
     delete temp;
     return NULL;
   }
+  temp->pixels_ = static_cast<char*>(buffer) + temp->pixel_offset_;
 
   return temp;
 }
 
 RasterChunk* RasterChunk::CreateRasterChunk(GDALDataset *input_raster,
                                             GDALDataset *output_raster,
-                                            Area output_area) {
+                                            Area output_area,
+                                            bool zero_pixels,
+                                            int row_alignment,
+                                            int halo) {
   // The RasterMinbox function calculates what part of the input raster
   // matches the given output partition.
   Area in_area = librasterblaster::RasterMinbox(output_raster,
                               input_raster,
                               output_area);
-  return CreateRasterChunk(input_raster, in_area);
+  return CreateRasterChunk(input_raster, in_area, zero_pixels, row_alignment,
+                           halo);
 }
 
-RasterChunk::RasterChunk(const RasterChunk &s) {
-  projection_ = s.projection_;
-  raster_location_ = s.raster_location_;
-  ul_projected_corner_ = s.ul_projected_corner_;
-  pixel_size_ = s.pixel_size_;
-  row_count_ = s.row_count_;
-  column_count_ = s.column_count_;
-  pixel_type_ = s.pixel_type_;
-  band_count_ = s.band_count_;
-  memcpy(geotransform_, s.geotransform_, 6*sizeof(double));
+RasterChunk* RasterChunk::CreateRasterChunk(void *pixels,
+                                            int64_t row_count,
+                                            int64_t column_count,
+                                            int band_count,
+                                            GDALDataType pixel_type,
+                                            const double geotransform[6],
+                                            std::string projection,
+                                            int64_t row_stride) {
+  const int64_t pixel_size = static_cast<int64_t>(
+      GDALGetDataTypeSize(pixel_type)/8) * band_count;
+  if (row_stride == 0) {
+    row_stride = column_count * pixel_size;
+  }
 
-  size_t pixel_buffer_size = static_cast<size_t>(row_count_)
-      * static_cast<size_t>(column_count_)
-      * static_cast<size_t>(GDALGetDataTypeSize(pixel_type_)/8)
-      * static_cast<size_t>(band_count_);
+  if (pixels == NULL || row_count <= 0 || column_count <= 0
+      || pixel_size <= 0 || row_stride < column_count * pixel_size) {
+    fprintf(stderr, "Invalid caller buffer for RasterChunk!\n");
+    return NULL;
+  }
 
-  memcpy(pixels_, s.pixels_, pixel_buffer_size);
+  // Chunks are addressed with a single pixel size, as in CreateRasterChunk
+  if (geotransform[1] <= 0.0 || geotransform[2] != 0.0
+      || geotransform[4] != 0.0
+      || fabs(geotransform[5] + geotransform[1]) > 1e-9 * geotransform[1]) {
+    fprintf(stderr, "Only north-up grids with square pixels are supported!\n");
+    return NULL;
+  }
+
+  RasterChunk *temp = new RasterChunk;
+  memcpy(temp->geotransform_, geotransform, 6*sizeof(double));
+  temp->projection_ = projection;
+  temp->raster_location_ = Coordinate(0.0, 0.0, UNDEF);
+  temp->ul_projected_corner_ = Coordinate(geotransform[0], geotransform[3],
+                                          UNDEF);
+  temp->pixel_size_ = geotransform[1];
+  temp->row_count_ = row_count;
+  temp->column_count_ = column_count;
+  temp->pixel_type_ = pixel_type;
+  temp->band_count_ = band_count;
+  temp->AttachPixels(pixels, row_stride);
+
+  return temp;
+}
+
+int64_t RasterChunk::RowStride(int64_t column_count,
+                               int64_t pixel_size,
+                               int row_alignment,
+                               int halo,
+                               int64_t *leading) {
+  // The stride is a multiple of both the alignment and the pixel size, so
+  // rows stay aligned and a row offset is a whole number of pixels.
+  const int64_t alignment = row_alignment < 1 ? 1 : row_alignment;
+  int64_t granularity = alignment;
+  while (granularity % pixel_size != 0) {
+    granularity += alignment;
+  }
+  // The left halo is widened to keep the first pixel of each row aligned
+  *leading = RoundUp(halo * pixel_size, alignment);
+  return RoundUp(*leading + (column_count + halo) * pixel_size, granularity);
+}
+
+size_t RasterChunk::BufferSize(int64_t row_count,
+                               int64_t column_count,
+                               int band_count,
+                               GDALDataType pixel_type,
+                               int row_alignment,
+                               int halo) {
+  const int64_t pixel_size = static_cast<int64_t>(
+      GDALGetDataTypeSize(pixel_type)/8) * band_count;
+  int64_t leading = 0;
+  if (halo < 0) {
+    halo = 0;
+  }
+  return static_cast<size_t>(row_count + 2 * halo)
+      * static_cast<size_t>(RowStride(column_count,
+                                      pixel_size,
+                                      row_alignment,
+                                      halo,
+                                      &leading));
+}
+
+RasterChunk::RasterChunk(const RasterChunk &s) {
+  pixels_ = NULL;
+  owns_pixels_ = true;
+  pixel_offset_ = 0;
+  CopyFrom(s);
+}
+
+RasterChunk::RasterChunk(RasterChunk &&s) {
+  pixels_ = NULL;
+  owns_pixels_ = true;
+  pixel_offset_ = 0;
+  MoveFrom(&s);
 }
 
 RasterChunk& RasterChunk::operator=(const RasterChunk &s) {
   if (this == &s) {
     return *this;
   }
+  CopyFrom(s);
+
+  return *this;
+}
+
+RasterChunk& RasterChunk::operator=(RasterChunk &&s) {
+  if (this == &s) {
+    return *this;
+  }
+  MoveFrom(&s);
+
+  return *this;
+}
+
+void RasterChunk::ReleasePixels() {
+  if (pixels_ != NULL && owns_pixels_) {
+    ChunkBufferPool::Instance()->Release(static_cast<char*>(pixels_)
+                                         - pixel_offset_);
+  }
+  pixels_ = NULL;
+  owns_pixels_ = true;
+  pixel_offset_ = 0;
+}
+
+void RasterChunk::CopyFrom(const RasterChunk &s) {
   projection_ = s.projection_;
   raster_location_ = s.raster_location_;
   ul_projected_corner_ = s.ul_projected_corner_;
@@ -107,16 +272,70 @@ RasterChunk& RasterChunk::operator=(const RasterChunk &s) {
   column_count_ = s.column_count_;
   pixel_type_ = s.pixel_type_;
   band_count_ = s.band_count_;
+  row_stride_ = s.row_stride_;
+  halo_ = s.halo_;
   memcpy(geotransform_, s.geotransform_, 6*sizeof(double));
 
-  size_t pixel_buffer_size = static_cast<size_t>(row_count_)
-      * static_cast<size_t>(column_count_)
-      * static_cast<size_t>(GDALGetDataTypeSize(pixel_type_)/8)
-      * static_cast<size_t>(band_count_);
+  ReleasePixels();
+  if (s.pixels_ == NULL) {
+    return;
+  }
+
+  // The copy keeps the layout, padding and halo included
+  const size_t pixel_buffer_size = PixelBufferSize();
+  char *buffer = static_cast<char*>(
+      ChunkBufferPool::Instance()->Acquire(pixel_buffer_size, false));
+  if (buffer == NULL) {
+    fprintf(stderr, "Allocation error!\n");
+    return;
+  }
+  size_t copy_size = pixel_buffer_size;
+  if (!s.owns_pixels_ && row_count_ > 0) {
+    // Attached pixels may end right after the last pixel of the last row
+    copy_size = static_cast<size_t>(row_count_ - 1) * row_stride_
+        + static_cast<size_t>(column_count_) * band_count_
+        * (GDALGetDataTypeSize(pixel_type_)/8);
+  }
+  memcpy(buffer,
+         static_cast<const char*>(s.pixels_) - s.pixel_offset_,
+         copy_size);
+  pixel_offset_ = s.pixel_offset_;
+  pixels_ = buffer + pixel_offset_;
+}
 
-  memcpy(pixels_, s.pixels_, pixel_buffer_size);
+void RasterChunk::MoveFrom(RasterChunk *s) {
+  projection_.swap(s->projection_);
+  raster_location_ = s->raster_location_;
+  ul_projected_corner_ = s->ul_projected_corner_;
+  pixel_size_ = s->pixel_size_;
+  row_count_ = s->row_count_;
+  column_count_ = s->column_count_;
+  pixel_type_ = s->pixel_type_;
+  band_count_ = s->band_count_;
+  row_stride_ = s->row_stride_;
+  halo_ = s->halo_;
+  memcpy(geotransform_, s->geotransform_, 6*sizeof(double));
+
+  ReleasePixels();
+  pixels_ = s->pixels_;
+  owns_pixels_ = s->owns_pixels_;
+  pixel_offset_ = s->pixel_offset_;
+  s->pixels_ = NULL;
+  s->owns_pixels_ = true;
+  s->pixel_offset_ = 0;
+}
 
-  return *this;
+void RasterChunk::AttachPixels(void *pixels, int64_t row_stride) {
+  ReleasePixels();
+  pixels_ = pixels;
+  owns_pixels_ = false;
+  row_stride_ = row_stride;
+  halo_ = 0;
+}
+
+size_t RasterChunk::PixelBufferSize() const {
+  return static_cast<size_t>(row_count_ + 2 * halo_)
+      * static_cast<size_t>(row_stride_);
 }
 
 bool RasterChunk::operator==(const RasterChunk &s) {
@@ -193,43 +412,165 @@ bool RasterChunk::operator>=(const RasterChunk &s) {
   return false;
 }
 
-PRB_ERROR RasterChunk::ReadRasterChunk(GDALDataset *ds, RasterChunk *chunk) {
-  // Read area of raster
-
-  if (ds == NULL) {
+/** \cond DOXYHIDE **/
+// Reads the inclusive area, in raster coordinates, of ds into the matching
+// pixels of chunk
+static PRB_ERROR ReadChunkArea(GDALDataset *ds,
+                               RasterChunk *chunk,
+                               int64_t ul_x,
+                               int64_t ul_y,
+                               int64_t lr_x,
+                               int64_t lr_y) {
+  const int type_size = GDALGetDataTypeSize(chunk->pixel_type_)/8;
+  const int pixel_space = type_size * chunk->band_count_;
+  const int64_t columns = lr_x - ul_x + 1;
+  const int64_t rows = lr_y - ul_y + 1;
+
+  // GDAL windows are limited to 2^31 - 1 pixels on each side
+  if (columns > INT_MAX || rows > INT_MAX) {
     return PRB_BADARG;
   }
 
+  char *pixels = static_cast<char*>(
+      chunk->Row(ul_y - static_cast<int64_t>(chunk->raster_location_.y)))
+      + (ul_x - static_cast<int64_t>(chunk->raster_location_.x))
+      * pixel_space;
+
   if (ds->RasterIO(GF_Read,
-                   chunk->raster_location_.x,
-                   chunk->raster_location_.y,
-                   chunk->column_count_,
-                   chunk->row_count_,
-                   chunk->pixels_,
-                   chunk->column_count_,
-                   chunk->row_count_,
+                   static_cast<int>(ul_x),
+                   static_cast<int>(ul_y),
+                   static_cast<int>(columns),
+                   static_cast<int>(rows),
+                   pixels,
+                   static_cast<int>(columns),
+                   static_cast<int>(rows),
                    chunk->pixel_type_,
                    chunk->band_count_,
                    NULL,
-                   0, 0, 0) != CE_None) {
+                   pixel_space,
+                   chunk->row_stride_,
+                   type_size) != CE_None) {
     return PRB_IOERROR;
   }
 
   return PRB_NOERROR;
 }
+/** \endcond **/
+
+PRB_ERROR RasterChunk::ReadRasterChunk(GDALDataset *ds, RasterChunk *chunk) {
+  // Read area of raster
+
+  if (ds == NULL) {
+    return PRB_BADARG;
+  }
+
+  const int64_t ul_x = static_cast<int64_t>(chunk->raster_location_.x);
+  const int64_t ul_y = static_cast<int64_t>(chunk->raster_location_.y);
+  return ReadChunkArea(ds,
+                       chunk,
+                       ul_x,
+                       ul_y,
+                       ul_x + chunk->column_count_ - 1,
+                       ul_y + chunk->row_count_ - 1);
+}
+
+PRB_ERROR RasterChunk::ReadRasterChunk(GDALDataset *ds,
+                                       RasterChunk *chunk,
+                                       const BlockResidency &residency) {
+  if (ds == NULL) {
+    return PRB_BADARG;
+  }
+  if (residency.resident.empty()) {
+    return ReadRasterChunk(ds, chunk);
+  }
+
+  const int64_t ul_x = static_cast<int64_t>(chunk->raster_location_.x);
+  const int64_t ul_y = static_cast<int64_t>(chunk->raster_location_.y);
+  const int64_t lr_x = ul_x + chunk->column_count_ - 1;
+  const int64_t lr_y = ul_y + chunk->row_count_ - 1;
+  const int64_t last_block_x = residency.first_block_x
+      + residency.blocks_across - 1;
+
+  // Each run of marked blocks along a row of blocks is read with one call
+  for (int64_t by = residency.first_block_y;
+       by < residency.first_block_y + residency.blocks_down;
+       ++by) {
+    const int64_t y0 = std::max(ul_y, by * residency.block_height);
+    const int64_t y1 = std::min(lr_y, (by + 1) * residency.block_height - 1);
+    if (y0 > y1) {
+      continue;
+    }
+    for (int64_t bx = residency.first_block_x; bx <= last_block_x; ++bx) {
+      if (!residency.IsResident(bx, by)) {
+        continue;
+      }
+      int64_t run_end = bx;
+      while (run_end < last_block_x && residency.IsResident(run_end + 1, by)) {
+        ++run_end;
+      }
+      const int64_t x0 = std::max(ul_x, bx * residency.block_width);
+      const int64_t x1 = std::min(lr_x,
+                                  (run_end + 1) * residency.block_width - 1);
+      bx = run_end;
+      if (x0 > x1) {
+        continue;
+      }
+      const PRB_ERROR err = ReadChunkArea(ds, chunk, x0, y0, x1, y1);
+      if (err != PRB_NOERROR) {
+        return err;
+      }
+    }
+  }
+
+  return PRB_NOERROR;
+}
+
+int64_t BlockResidency::ResidentPixels(Area area) const {
+  const int64_t ul_x = static_cast<int64_t>(area.ul.x);
+  const int64_t ul_y = static_cast<int64_t>(area.ul.y);
+  const int64_t lr_x = static_cast<int64_t>(area.lr.x);
+  const int64_t lr_y = static_cast<int64_t>(area.lr.y);
+  int64_t pixels = 0;
+
+  for (int64_t by = first_block_y; by < first_block_y + blocks_down; ++by) {
+    const int64_t rows = std::min(lr_y, (by + 1) * block_height - 1)
+        - std::max(ul_y, by * block_height) + 1;
+    for (int64_t bx = first_block_x; bx < first_block_x + blocks_across;
+         ++bx) {
+      const int64_t columns = std::min(lr_x, (bx + 1) * block_width - 1)
+          - std::max(ul_x, bx * block_width) + 1;
+      if (rows > 0 && columns > 0 && IsResident(bx, by)) {
+        pixels += rows * columns;
+      }
+    }
+  }
+
+  return pixels;
+}
 
 PRB_ERROR RasterChunk::WriteRasterChunk(GDALDataset *ds, RasterChunk *chunk) {
+  const int type_size = GDALGetDataTypeSize(chunk->pixel_type_)/8;
+  const int pixel_space = type_size * chunk->band_count_;
+
+  // GDAL windows are limited to 2^31 - 1 pixels on each side
+  if (chunk->column_count_ > INT_MAX || chunk->row_count_ > INT_MAX) {
+    return PRB_BADARG;
+  }
+
   if (ds->RasterIO(GF_Write,
                    chunk->raster_location_.x,
                    chunk->raster_location_.y,
-                   chunk->column_count_,
-                   chunk->row_count_,
+                   static_cast<int>(chunk->column_count_),
+                   static_cast<int>(chunk->row_count_),
                    chunk->pixels_,
-                   chunk->column_count_,
-                   chunk->row_count_,
+                   static_cast<int>(chunk->column_count_),
+                   static_cast<int>(chunk->row_count_),
                    chunk->pixel_type_,
                    chunk->band_count_,
-                   NULL, 0, 0, 0) != CE_None) {
+                   NULL,
+                   pixel_space,
+                   chunk->row_stride_,
+                   type_size) != CE_None) {
     // Error!
     fprintf(stderr, "Error writing RasterChunk %p\n", chunk->pixels_);
     return PRB_IOERROR;
@@ -251,4 +592,70 @@ Coordinate RasterChunk::RasterToChunk(Coordinate raster_coordinate) {
                     raster_coordinate.y - raster_location_.y,
                     raster_coordinate.units);
 }
+
+RasterChunkView RasterChunk::View() {
+  return View(Area(0, 0, column_count_ - 1, row_count_ - 1));
+}
+
+RasterChunkView RasterChunk::View(Area chunk_area) {
+  RasterChunkView whole;
+  whole.raster_location_ = raster_location_;
+  whole.row_count_ = row_count_;
+  whole.column_count_ = column_count_;
+  whole.band_count_ = band_count_;
+  whole.pixel_type_ = pixel_type_;
+  whole.pixels_ = pixels_;
+  whole.row_stride_ = row_stride_;
+
+  return whole.Subview(chunk_area);
+}
+
+RasterChunk RasterChunk::Subchunk(Area chunk_area) const {
+  const int64_t ul_x = static_cast<int64_t>(chunk_area.ul.x);
+  const int64_t ul_y = static_cast<int64_t>(chunk_area.ul.y);
+  const int64_t pixel_bytes = (GDALGetDataTypeSize(pixel_type_) / 8)
+      * band_count_;
+
+  RasterChunk part;
+  part.projection_ = projection_;
+  part.raster_location_ = Coordinate(raster_location_.x + ul_x,
+                                     raster_location_.y + ul_y,
+                                     raster_location_.units);
+  part.ul_projected_corner_ =
+      Coordinate(ul_projected_corner_.x + ul_x * pixel_size_,
+                 ul_projected_corner_.y - ul_y * pixel_size_,
+                 ul_projected_corner_.units);
+  part.pixel_size_ = pixel_size_;
+  part.row_count_ = static_cast<int64_t>(chunk_area.lr.y - chunk_area.ul.y + 1);
+  part.column_count_ = static_cast<int64_t>(chunk_area.lr.x
+                                            - chunk_area.ul.x + 1);
+  part.pixel_type_ = pixel_type_;
+  part.band_count_ = band_count_;
+  memcpy(part.geotransform_, geotransform_, 6*sizeof(double));
+  part.geotransform_[0] = part.ul_projected_corner_.x;
+  part.geotransform_[3] = part.ul_projected_corner_.y;
+  if (pixels_ != NULL) {
+    part.AttachPixels(static_cast<char*>(Row(ul_y)) + ul_x * pixel_bytes,
+                      row_stride_);
+  }
+  return part;
+}
+
+RasterChunkView RasterChunkView::Subview(Area view_area) const {
+  RasterChunkView view(*this);
+  const int64_t ul_x = static_cast<int64_t>(view_area.ul.x);
+  const int64_t ul_y = static_cast<int64_t>(view_area.ul.y);
+
+  view.raster_location_ = Coordinate(raster_location_.x + ul_x,
+                                     raster_location_.y + ul_y,
+                                     raster_location_.units);
+  view.column_count_ = static_cast<int64_t>(view_area.lr.x
+                                            - view_area.ul.x + 1);
+  view.row_count_ = static_cast<int64_t>(view_area.lr.y - view_area.ul.y + 1);
+  if (pixels_ != NULL) {
+    view.pixels_ = Pixel(ul_x, ul_y);
+  }
+
+  return view;
+}
 }
@@ -23,11 +23,110 @@
 #include <gdal_priv.h>
 
 #include <string>
+#include <vector>
 
+#include "src/chunkpool.h"
+#include "src/std_int.h"
 #include "src/utils.h"
 
 namespace librasterblaster {
+class RasterChunkView;
+
+/// The storage blocks of a raster that a chunk actually needs
+/**
+ * BlockResidency marks the blocks, in the tile or strip grid of a raster,
+ * that are touched by the source footprints of an output area. RasterMinbox
+ * fills it in the same pass that computes the minbox, and ReadRasterChunk
+ * then reads only the marked blocks. For skewed footprints most of the
+ * minbox is never referenced and is not read.
+ *
+ * The bitmap covers blocks_across by blocks_down blocks, starting at block
+ * (first_block_x, first_block_y) of the raster.
+ */
+struct BlockResidency {
+  /// Creates an empty residency for blocks of the given size
+  BlockResidency(int64_t width = 0, int64_t height = 0)
+      : block_width(width), block_height(height),
+        first_block_x(0), first_block_y(0), blocks_across(0),
+        blocks_down(0) {}
+
+  /**
+   * @brief Returns true if block (block_x, block_y) of the raster is marked.
+   */
+  bool IsResident(int64_t block_x, int64_t block_y) const {
+    block_x -= first_block_x;
+    block_y -= first_block_y;
+    return block_x >= 0 && block_x < blocks_across
+        && block_y >= 0 && block_y < blocks_down
+        && resident[block_y * blocks_across + block_x];
+  }
+
+  /**
+   * @brief Returns the number of pixels of the inclusive area, in raster
+   * coordinates, that lie in marked blocks.
+   */
+  int64_t ResidentPixels(Area area) const;
+
+  /// Width of a block, in pixels
+  int64_t block_width;
+  /// Height of a block, in pixels
+  int64_t block_height;
+  /// Column, in blocks, of the first block of the bitmap
+  int64_t first_block_x;
+  /// Row, in blocks, of the first block of the bitmap
+  int64_t first_block_y;
+  /// Number of blocks across the bitmap
+  int64_t blocks_across;
+  /// Number of blocks down the bitmap
+  int64_t blocks_down;
+  /// One flag per block, row by row
+  std::vector<bool> resident;
+};
+
+/// The metadata of a raster that chunks of it are created from
+/**
+ * RasterDescriptor holds what CreateRasterChunk and RasterMinbox read from a
+ * GDALDataset. It can be read once and then shared, e.g. by broadcasting it
+ * to other processes, so that only one of them opens the file.
+ */
+struct RasterDescriptor {
+  /// Creates an empty descriptor
+  RasterDescriptor();
+  /// Reads the descriptor of a dataset
+  explicit RasterDescriptor(GDALDataset *ds);
+
+  /// Projection of the raster, as WKT
+  std::string projection;
+  /// The six GDAL geotransform coefficients
+  double geotransform[6];
+  /// Number of rows
+  int64_t row_count;
+  /// Number of columns
+  int64_t column_count;
+  /// Number of bands
+  int band_count;
+  /// Type of the band values
+  GDALDataType pixel_type;
+  /// Width of the storage blocks of the first band
+  int block_width;
+  /// Height of the storage blocks of the first band
+  int block_height;
+  /// Whether the first band has a nodata value
+  bool has_nodata;
+  /// The nodata value of the first band
+  double nodata;
+};
+
 /// A class representing an in-memory part of a raster.
+/**
+ * A RasterChunk owns its pixel buffer unless owns_pixels_ is false. Copies
+ * duplicate the pixel values into a new buffer, moves transfer the buffer and
+ * leave the source chunk empty.
+ *
+ * Rows are row_stride_ bytes apart. CreateRasterChunk pads rows so that each
+ * starts on a row_alignment boundary, and can surround the pixels with a halo
+ * of padding pixels that vectorized kernels may read past the edges into.
+ */
 class RasterChunk {
  public:
   /**
@@ -36,9 +135,35 @@ class RasterChunk {
    *
    * @param ds Dataset to create chunk from
    * @param chunk_area The inclusive area that the chunk should represent.
+   * @param zero_pixels If false the pixel buffer is left uninitialized. Pass
+   *                    false when every pixel is overwritten, e.g. by
+   *                    ReadRasterChunk or ReprojectChunk.
+   * @param row_alignment Row starts are aligned to this many bytes. Use 1
+   *                      for rows without padding.
+   * @param halo Number of padding pixels on each side of the chunk.
+   *
+   */
+  static RasterChunk* CreateRasterChunk(GDALDataset *ds,
+                                        Area chunk_area,
+                                        bool zero_pixels = true,
+                                        int row_alignment =
+                                        kChunkBufferAlignment,
+                                        int halo = 0);
+
+  /**
+   * @brief
+   * This function creates a RasterChunk of a raster that is described
+   * instead of opened, otherwise like the function above.
+   *
+   * @param raster Descriptor of the raster to create chunk from
    *
    */
-  static RasterChunk* CreateRasterChunk(GDALDataset *ds, Area chunk_area);
+  static RasterChunk* CreateRasterChunk(const RasterDescriptor &raster,
+                                        Area chunk_area,
+                                        bool zero_pixels = true,
+                                        int row_alignment =
+                                        kChunkBufferAlignment,
+                                        int halo = 0);
 
   /**
    * @brief
@@ -51,21 +176,68 @@ class RasterChunk {
    * @param source Dataset that is used to find the area
    * @param source_area Area that is used to calculate area from 
    *                    destination
+   * @param zero_pixels If false the pixel buffer is left uninitialized.
+   * @param row_alignment Row starts are aligned to this many bytes.
+   * @param halo Number of padding pixels on each side of the chunk.
    *
    *
    */
   static RasterChunk* CreateRasterChunk(GDALDataset *destination,
                                         GDALDataset *source,
-                                        Area source_area);
+                                        Area source_area,
+                                        bool zero_pixels = true,
+                                        int row_alignment =
+                                        kChunkBufferAlignment,
+                                        int halo = 0);
+
+  /**
+   * @brief
+   * This function creates a RasterChunk that refers to pixels owned by the
+   * caller, such as the arrays of a simulation, so that ReprojectChunk can
+   * run on them without going through a file. Nothing is copied, the pixels
+   * must stay valid for the lifetime of the chunk and are not freed by it.
+   *
+   * @param pixels Upper-left pixel. The band_count values of each pixel are
+   *               adjacent, as in every RasterChunk.
+   * @param row_count Number of rows
+   * @param column_count Number of columns
+   * @param band_count Number of bands
+   * @param pixel_type Type of the pixel values
+   * @param geotransform GDAL geotransform of the grid. Only north-up grids
+   *                     with square pixels are supported.
+   * @param projection Spatial reference system of the grid, in any form
+   *                   accepted by OGRSpatialReference::SetFromUserInput()
+   * @param row_stride Distance, in bytes, between the starts of rows. 0 for
+   *                   rows without padding.
+   *
+   * @return Returns NULL if the grid is not supported.
+   */
+  static RasterChunk* CreateRasterChunk(void *pixels,
+                                        int64_t row_count,
+                                        int64_t column_count,
+                                        int band_count,
+                                        GDALDataType pixel_type,
+                                        const double geotransform[6],
+                                        std::string projection,
+                                        int64_t row_stride = 0);
 
   /**
    * @brief
-   * Copy constructor
+   * Copy constructor, the copy owns a new buffer holding the same pixel values
    *
    * @param s Source RasterChunk to be copied
    */
   RasterChunk(const RasterChunk &s);
 
+  /**
+   * @brief
+   * Move constructor, the new chunk takes over the pixel buffer of s and s is
+   * left without pixels.
+   *
+   * @param s Source RasterChunk to be moved from
+   */
+  RasterChunk(RasterChunk &&s);
+
   /**
    * @brief 
    * This function reads the pixel values from the GDALDataset into the
@@ -77,6 +249,7 @@ class RasterChunk {
    */
 
   RasterChunk& operator=(const RasterChunk &s);
+  RasterChunk& operator=(RasterChunk &&s);
 
   /**
    * @brief The comparison operators compare the upper-left corner of the raster
@@ -93,6 +266,21 @@ class RasterChunk {
   bool operator>=(const RasterChunk &s);
 
   static PRB_ERROR ReadRasterChunk(GDALDataset *ds, RasterChunk *chunk);
+  /**
+   * @brief
+   * This function reads the pixels of chunk that lie in the blocks marked in
+   * residency, see RasterMinbox. The other pixels are left as they are, the
+   * reprojection kernels never reference them. A residency without blocks,
+   * as for chunks outside of the projected area, reads the whole chunk.
+   *
+   * @param ds The GDALDataset to read from.
+   * @param chunk The RasterChunk to read into.
+   * @param residency The blocks of ds to read.
+   *
+   */
+  static PRB_ERROR ReadRasterChunk(GDALDataset *ds,
+                                   RasterChunk *chunk,
+                                   const BlockResidency &residency);
   /**
    * @brief
    * This function writes the pixel values from the RasterChunk into the
@@ -106,19 +294,82 @@ class RasterChunk {
   /// RasterChunk constructor
   RasterChunk() {
     this->pixels_ = NULL;
+    this->owns_pixels_ = true;
+    this->row_count_ = this->column_count_ = this->band_count_ = 0;
+    this->row_stride_ = 0;
+    this->halo_ = 0;
+    this->pixel_offset_ = 0;
   }
   /// RasterChunk destructor
   /**
-   * This destructor frees the memory, if any,  allocated at pixels_.
+   * This destructor returns the memory, if any, allocated at pixels_ to the
+   * ChunkBufferPool, unless the chunk does not own it.
    */
   ~RasterChunk() {
-    if (this->pixels_ != NULL) {
-      free(this->pixels_);
-    }
+    ReleasePixels();
   }
   Coordinate ChunkToRaster(Coordinate chunk_coordinate);
   Coordinate RasterToChunk(Coordinate raster_coordinate);
 
+  /**
+   * @brief Returns the size, in bytes, of the pixel buffer, including row
+   * padding and the halo.
+   */
+  size_t PixelBufferSize() const;
+
+  /**
+   * @brief Returns the size, in bytes, of the pixel buffer that
+   * CreateRasterChunk allocates for a chunk with the given layout.
+   */
+  static size_t BufferSize(int64_t row_count,
+                           int64_t column_count,
+                           int band_count,
+                           GDALDataType pixel_type,
+                           int row_alignment,
+                           int halo);
+
+  /**
+   * @brief Returns a pointer to the first pixel of row y. Rows -halo_ to
+   * row_count_ + halo_ - 1 are addressable.
+   */
+  void *Row(int64_t y) const {
+    return static_cast<char*>(pixels_) + y * row_stride_;
+  }
+
+  /**
+   * @brief Makes the chunk refer to pixels it does not own. Any buffer the
+   * chunk owned is released. The caller keeps pixels valid for the lifetime
+   * of the chunk.
+   *
+   * @param pixels Upper-left pixel, laid out like pixels_
+   * @param row_stride Distance, in bytes, between the starts of rows
+   */
+  void AttachPixels(void *pixels, int64_t row_stride);
+
+  /**
+   * @brief Returns a view of the whole chunk.
+   */
+  RasterChunkView View();
+
+  /**
+   * @brief Returns a view of part of the chunk.
+   *
+   * @param chunk_area Inclusive area, in chunk coordinates, that the view
+   *                   should cover. It must lie within the chunk.
+   */
+  RasterChunkView View(Area chunk_area);
+
+  /**
+   * @brief Returns a chunk that refers to part of the pixels of this chunk,
+   * without copying them, so that the reprojection functions can work on it.
+   * Its location and corners are those of the part. This chunk must outlive
+   * the returned one.
+   *
+   * @param chunk_area Inclusive area, in chunk coordinates, that the returned
+   *                   chunk should cover. It must lie within the chunk.
+   */
+  RasterChunk Subchunk(Area chunk_area) const;
+
   std::string projection_;
   /// Location of the chunk, in raster coordinates
   /** 
@@ -138,16 +389,110 @@ class RasterChunk {
    */
   double pixel_size_;  // in meters
   /// Number of rows
-  int row_count_;
+  int64_t row_count_;
   /// Number of columns
-  int column_count_;
+  int64_t column_count_;
   /// Datatype of pixel values
   GDALDataType pixel_type_;
   /// Number of bands
   int band_count_;
+  /// Distance, in bytes, between the starts of consecutive rows
+  int64_t row_stride_;
+  /// Number of padding pixels on each side of the chunk
+  int halo_;
   /// GDAL geotransform
   double geotransform_[6];
   /// Pointer to pixel values
+  /**
+   * The pixel values are stored row-wise and pixel-interleaved: the
+   * band_count_ values of each pixel are adjacent in memory. pixels_ points
+   * at the upper-left pixel, inside the halo if there is one. The buffer is
+   * drawn from the ChunkBufferPool; buffers assigned from elsewhere must have
+   * been allocated with malloc, or owns_pixels_ must be false.
+   */
+  void *pixels_;
+  /// True if the chunk frees pixels_ when it is destroyed
+  bool owns_pixels_;
+
+ private:
+  void ReleasePixels();
+  void CopyFrom(const RasterChunk &s);
+  void MoveFrom(RasterChunk *s);
+  static int64_t RowStride(int64_t column_count,
+                           int64_t pixel_size,
+                           int row_alignment,
+                           int halo,
+                           int64_t *leading);
+
+  /// Distance, in bytes, from the start of the allocation to pixels_
+  size_t pixel_offset_;
+};
+
+/// A non-owning view of a rectangle of RasterChunk pixels
+/**
+ * A RasterChunkView refers to pixels owned by someone else, typically a
+ * RasterChunk, so sub-regions of a large buffer can be passed around without
+ * copying. Rows are row_stride_ bytes apart, which is larger than the row
+ * size when the view is narrower than the buffer it points into. The view
+ * must not outlive the buffer.
+ */
+class RasterChunkView {
+ public:
+  /// RasterChunkView constructor, creates an empty view
+  RasterChunkView()
+      : raster_location_(), row_count_(0), column_count_(0), band_count_(0),
+        pixel_type_(GDT_Unknown), row_stride_(0), pixels_(NULL) {}
+
+  /**
+   * @brief Returns a view of part of this view.
+   *
+   * @param view_area Inclusive area, in view coordinates, that the new view
+   *                  should cover. It must lie within this view.
+   */
+  RasterChunkView Subview(Area view_area) const;
+
+  /**
+   * @brief Returns the size of a pixel, in bytes, counting every band.
+   */
+  size_t PixelSize() const {
+    return static_cast<size_t>(GDALGetDataTypeSize(pixel_type_) / 8)
+        * static_cast<size_t>(band_count_);
+  }
+
+  /**
+   * @brief Returns a pointer to the first pixel of row y.
+   */
+  void *Row(int64_t y) const {
+    return static_cast<char*>(pixels_) + y * row_stride_;
+  }
+
+  /**
+   * @brief Returns a pointer to the pixel at column x of row y.
+   */
+  void *Pixel(int64_t x, int64_t y) const {
+    return static_cast<char*>(Row(y)) + x * static_cast<int64_t>(PixelSize());
+  }
+
+  /**
+   * @brief Returns true if the rows follow each other without gaps.
+   */
+  bool IsContiguous() const {
+    return row_stride_ == column_count_ * static_cast<int64_t>(PixelSize());
+  }
+
+  /// Location of the upper-left pixel, in raster coordinates
+  Coordinate raster_location_;
+  /// Number of rows
+  int64_t row_count_;
+  /// Number of columns
+  int64_t column_count_;
+  /// Number of bands
+  int band_count_;
+  /// Datatype of pixel values
+  GDALDataType pixel_type_;
+  /// Distance, in bytes, between the starts of consecutive rows
+  int64_t row_stride_;
+  /// Pointer to the upper-left pixel
   void *pixels_;
 };
 }
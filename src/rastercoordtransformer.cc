@@ -34,8 +34,8 @@ RasterCoordTransformer::
 RasterCoordTransformer(string source_projection,
                        Coordinate source_ul,
                        double source_pixel_size,
-                       int source_row_count,
-                       int source_column_count,
+                       int64_t source_row_count,
+                       int64_t source_column_count,
                        string destination_projection,
                        Coordinate destination_ul,
                        double destination_pixel_size) {
@@ -51,14 +51,21 @@ RasterCoordTransformer(string source_projection,
 }
 
 RasterCoordTransformer::~RasterCoordTransformer() {
+  OGRCoordinateTransformation *transforms[] = { ctrans, src_to_geo,
+                                                geo_to_src };
+  for (int i = 0; i < 3; ++i) {
+    if (transforms[i] != NULL) {
+      OCTDestroyCoordinateTransformation(transforms[i]);
+    }
+  }
   return;
 }
 
 void RasterCoordTransformer::init(string source_projection,
                                   Coordinate source_ul,
                                   double source_pixel_size,
-                                  int source_row_count,
-                                  int source_column_count,
+                                  int64_t source_row_count,
+                                  int64_t source_column_count,
                                   string destination_projection,
                                   Coordinate destination_ul,
                                   double destination_pixel_size) {
@@ -66,6 +73,7 @@ void RasterCoordTransformer::init(string source_projection,
   source_pixel_size_ = source_pixel_size;
   destination_ul_ = destination_ul;
   destination_pixel_size_ = destination_pixel_size;
+  ctrans = src_to_geo = geo_to_src = NULL;
 
   OGRSpatialReference source_sr, dest_sr, *geo_sr;
   char *source_wkt = strdup(source_projection.c_str());
@@ -188,4 +196,10 @@ Transform(Coordinate source, bool area_check) {
 bool RasterCoordTransformer::ready() {
   return true;
 }
+
+void RasterCoordTransformer::SetCorners(Coordinate source_ul,
+                                        Coordinate destination_ul) {
+  source_ul_ = source_ul;
+  destination_ul_ = destination_ul;
+}
 }
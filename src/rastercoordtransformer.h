@@ -52,8 +52,8 @@ class RasterCoordTransformer {
   RasterCoordTransformer(string source_projection,
                          Coordinate source_ul,
                          double source_pixel_size,
-                         int source_row_count,
-                         int souce_column_count,
+                         int64_t source_row_count,
+                         int64_t souce_column_count,
                          string destination_projection,
                          Coordinate destination_ul,
                          double destination_pixel_size);
@@ -82,12 +82,24 @@ class RasterCoordTransformer {
    */
   bool ready();
 
+  // ! Moves both rasters without rebuilding the projections
+  /*
+    Replaces the upper-left corners, in projected coordinates, of the
+    source and destination rasters. The pixel sizes and projections
+    are kept, so a transformer built once for two raster grids can be
+    pointed at any pair of chunks of those grids.
+   */
+  void SetCorners(Coordinate source_ul, Coordinate destination_ul);
+
  private:
+  RasterCoordTransformer(const RasterCoordTransformer&);
+  RasterCoordTransformer& operator=(const RasterCoordTransformer&);
+
   void init(string source_projection,
             Coordinate source_ul,
             double source_pixel_size,
-            int source_row_count,
-            int source_column_count,
+            int64_t source_row_count,
+            int64_t source_column_count,
             string destination_projection,
             Coordinate destination_ul,
             double destination_pixel_size);
@@ -18,6 +18,9 @@
 #include "src/reprojection_tools.h"
 
 #include <float.h>
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
 
 #include <ogr_api.h>
 #include <ogr_spatialref.h>
@@ -26,11 +29,15 @@
 #include <tiffio.h>
 
 #include <algorithm>
+#include <cmath>
 #include <vector>
 #include <ctime>
 #include <cstdlib>
 #include <sstream>
+#include <thread>
 
+#include "src/chunkpool.h"
+#include "src/gather.h"
 #include "src/rastercoordtransformer.h"
 #include "src/resampler.h"
 #include "src/std_int.h"
@@ -42,6 +49,34 @@ PRB_ERROR CreateOutputRaster(GDALDataset *in,
                              string output_filename,
                              string output_srs,
                              int output_tile_size) {
+  int64_t num_cols = 0, num_rows = 0;
+  double out_t[6];
+  PRB_ERROR result = OutputRasterGeometry(in, output_srs, &num_cols,
+                                          &num_rows, out_t);
+  if (result != PRB_NOERROR) {
+    return result;
+  }
+
+  const double output_pixel_size = out_t[1];
+  Area out_area(out_t[0], out_t[3],
+                out_t[0] + num_cols * output_pixel_size,
+                out_t[3] - num_rows * output_pixel_size);
+  result = CreateOutputRasterFile(in,
+                                  output_filename,
+                                  output_srs,
+                                  num_cols,
+                                  num_rows,
+                                  output_pixel_size,
+                                  out_area,
+                                  output_tile_size);
+  return result;
+}
+
+PRB_ERROR OutputRasterGeometry(GDALDataset *in,
+                               string output_srs,
+                               int64_t *output_columns,
+                               int64_t *output_rows,
+                               double *output_geotransform) {
   OGRSpatialReference in_srs;
   OGRSpatialReference out_srs;
   OGRErr err;
@@ -88,15 +123,15 @@ PRB_ERROR CreateOutputRaster(GDALDataset *in,
   const int64_t num_rows = static_cast<int64_t>(
       0.5 + ((out_area.ul.y - out_area.lr.y) / output_pixel_size));
 
-  PRB_ERROR result = CreateOutputRasterFile(in,
-                                            output_filename,
-                                            output_srs,
-                                            num_cols,
-                                            num_rows,
-                                            output_pixel_size,
-                                            out_area,
-                                            output_tile_size);
-  return result;
+  *output_columns = num_cols;
+  *output_rows = num_rows;
+  output_geotransform[0] = out_area.ul.x;
+  output_geotransform[1] = output_pixel_size;
+  output_geotransform[2] = 0.0;
+  output_geotransform[3] = out_area.ul.y;
+  output_geotransform[4] = 0.0;
+  output_geotransform[5] = -output_pixel_size;
+  return PRB_NOERROR;
 }
 
 PRB_ERROR CreateOutputRaster(GDALDataset *in,
@@ -170,6 +205,14 @@ PRB_ERROR CreateOutputRasterFile(GDALDataset *in,
   double in_transform[6];
   in->GetGeoTransform(in_transform);
 
+  // GDAL limits each dimension, though not the pixel count, to 2^31 - 1
+  if (output_columns > INT_MAX || output_rows > INT_MAX) {
+    fprintf(stderr, "Output raster dimensions %lld x %lld are too large.\n",
+            static_cast<long long>(output_columns),
+            static_cast<long long>(output_rows));
+    return PRB_BADARG;
+  }
+
   GDALAllRegister();
   GDALDriver *driver = GetGDALDriverManager()->GetDriverByName("GTiff");
 
@@ -193,8 +236,8 @@ PRB_ERROR CreateOutputRasterFile(GDALDataset *in,
 
   GDALDataset *output =
       driver->Create(output_filename.c_str(),
-                     output_columns,
-                     output_rows,
+                     static_cast<int>(output_columns),
+                     static_cast<int>(output_rows),
                      in->GetRasterCount(),
                      in->GetRasterBand(1)->GetRasterDataType(),
                      options);
@@ -226,7 +269,8 @@ PRB_ERROR CreateOutputRasterFile(GDALDataset *in,
   output->SetProjection(wkt);
 
 
-  double *data = new double(sizeof(*data) * 4 * in->GetRasterCount());
+  // Enough room for one pixel of every band, even for complex types.
+  double *data = new double[4 * in->GetRasterCount()]();
 
   output->RasterIO(GF_Write,
                    0,
@@ -244,8 +288,8 @@ PRB_ERROR CreateOutputRasterFile(GDALDataset *in,
                    0);
 
   output->RasterIO(GF_Write,
-                   output_columns-1,
-                   output_rows-1,
+                   static_cast<int>(output_columns - 1),
+                   static_cast<int>(output_rows - 1),
                    1,
                    1,
                    data,
@@ -257,7 +301,7 @@ PRB_ERROR CreateOutputRasterFile(GDALDataset *in,
                    0,
                    0,
                    0);
-  delete data;
+  delete[] data;
 
   OGRFree(wkt);
   CSLDestroy(options);
@@ -285,14 +329,24 @@ bool partition_compare(Area a, Area b) {
   return false;
 }
 
+/** \cond DOXYHIDE **/
+// Size, in tiles, of the partitions of BlockPartition
+static void PartitionShape(int partition_size,
+                           int64_t *partition_width,
+                           int64_t *partition_height) {
+  *partition_height = sqrt(partition_size);
+  *partition_width = partition_size / *partition_height;
+}
+/** \endcond **/
+
 std::vector<Area> BlockPartition(int rank,
                                  int process_count,
-                                 int row_count,
-                                 int column_count,
+                                 int64_t row_count,
+                                 int64_t column_count,
                                  int tile_size,
                                  int partition_size) {
-  const int64_t partition_height = sqrt(partition_size);
-  const int64_t partition_width = partition_size / partition_height;
+  int64_t partition_height = 0, partition_width = 0;
+  PartitionShape(partition_size, &partition_width, &partition_height);
 
   const int64_t tiles_down = (row_count + tile_size - 1) / tile_size;
   const int64_t tiles_across = (column_count + tile_size - 1) / tile_size;
@@ -348,6 +402,191 @@ std::vector<Area> BlockPartition(int rank,
   return partitions;
 }
 
+std::vector<int64_t> PartitionTileOrder(int process_count,
+                                        int64_t row_count,
+                                        int64_t column_count,
+                                        int tile_size,
+                                        int partition_size) {
+  int64_t partition_height = 0, partition_width = 0;
+  PartitionShape(partition_size, &partition_width, &partition_height);
+
+  const int64_t tiles_down = (row_count + tile_size - 1) / tile_size;
+  const int64_t tiles_across = (column_count + tile_size - 1) / tile_size;
+  const int64_t partitions_down = (tiles_down + partition_height - 1)
+      / partition_height;
+  const int64_t partitions_across = (tiles_across + partition_width - 1)
+      / partition_width;
+  const int64_t partition_count = partitions_down * partitions_across;
+
+  std::vector<int64_t> order;
+  order.reserve(tiles_down * tiles_across);
+  // Partition i belongs to process i % process_count, as in BlockPartition
+  for (int rank = 0; rank < process_count; ++rank) {
+    for (int64_t i = rank; i < partition_count; i += process_count) {
+      const int64_t ul_x = (i % partitions_across) * partition_width;
+      const int64_t ul_y = (i / partitions_across) * partition_height;
+      const int64_t lr_x = std::min(ul_x + partition_width, tiles_across);
+      const int64_t lr_y = std::min(ul_y + partition_height, tiles_down);
+      for (int64_t y = ul_y; y < lr_y; ++y) {
+        for (int64_t x = ul_x; x < lr_x; ++x) {
+          order.push_back(y * tiles_across + x);
+        }
+      }
+    }
+  }
+  return order;
+}
+
+/** \cond DOXYHIDE **/
+// Fills plan with the largest working set of the partitions of the given
+// size, in tiles
+static void EstimatePartitions(const std::vector<Area> &tile_minboxes,
+                               int64_t row_count,
+                               int64_t column_count,
+                               int tile_size,
+                               int band_count,
+                               GDALDataType pixel_type,
+                               int output_count,
+                               bool index_map,
+                               int row_alignment,
+                               int partition_size,
+                               PartitionPlan *plan) {
+  const int64_t tiles_down = (row_count + tile_size - 1) / tile_size;
+  const int64_t tiles_across = (column_count + tile_size - 1) / tile_size;
+  // Same layout as BlockPartition
+  const int64_t partition_height = sqrt(partition_size);
+  const int64_t partition_width = partition_size / partition_height;
+  plan->partition_size = partition_size;
+  plan->partition_width = static_cast<int>(partition_width);
+  plan->partition_height = static_cast<int>(partition_height);
+  plan->partition_count = ((tiles_down + partition_height - 1)
+                           / partition_height)
+      * ((tiles_across + partition_width - 1) / partition_width);
+  plan->input_bytes = plan->output_bytes = plan->peak_bytes = 0;
+
+  for (int64_t py = 0; py < tiles_down; py += partition_height) {
+    for (int64_t px = 0; px < tiles_across; px += partition_width) {
+      const int64_t output_rows =
+          std::min(row_count - py * tile_size, partition_height * tile_size);
+      const int64_t output_columns =
+          std::min(column_count - px * tile_size, partition_width * tile_size);
+      // The input chunk covers the union of the minboxes of the tiles
+      Area box = TileMinboxUnion(tile_minboxes, column_count, tile_size,
+                                 Area(px * tile_size, py * tile_size,
+                                      px * tile_size + output_columns - 1,
+                                      py * tile_size + output_rows - 1));
+      if (box.ul.x == -1.0) {
+        // No source pixels, CreateRasterChunk makes a single pixel chunk
+        box = Area(0, 0, 0, 0);
+      }
+
+      const int64_t input_rows = box.lr.y - box.ul.y + 1;
+      const int64_t input_columns = box.lr.x - box.ul.x + 1;
+      const int64_t input_bytes = ChunkBufferPool::ClassSize(
+          RasterChunk::BufferSize(input_rows,
+                                  input_columns,
+                                  band_count,
+                                  pixel_type,
+                                  row_alignment,
+                                  0));
+      const int64_t output_bytes = output_count * ChunkBufferPool::ClassSize(
+          RasterChunk::BufferSize(output_rows,
+                                  output_columns,
+                                  band_count,
+                                  pixel_type,
+                                  row_alignment,
+                                  0));
+      int64_t peak_bytes = input_bytes + output_bytes;
+      if (index_map) {
+        peak_bytes += output_rows * output_columns
+            * static_cast<int64_t>(sizeof(int32_t));
+      }
+
+      plan->input_bytes = std::max(plan->input_bytes, input_bytes);
+      plan->output_bytes = std::max(plan->output_bytes, output_bytes);
+      plan->peak_bytes = std::max(plan->peak_bytes, peak_bytes);
+    }
+  }
+}
+/** \endcond **/
+
+PartitionPlan PlanPartitions(const std::vector<Area> &tile_minboxes,
+                             int64_t row_count,
+                             int64_t column_count,
+                             int tile_size,
+                             int process_count,
+                             int band_count,
+                             GDALDataType pixel_type,
+                             int output_count,
+                             bool index_map,
+                             int row_alignment,
+                             int64_t memory_budget) {
+  const int64_t tiles_down = (row_count + tile_size - 1) / tile_size;
+  const int64_t tiles_across = (column_count + tile_size - 1) / tile_size;
+  const int64_t tile_count = tiles_down * tiles_across;
+  PartitionPlan plan, candidate;
+
+  if (static_cast<int64_t>(tile_minboxes.size()) < tile_count) {
+    fprintf(stderr, "PlanPartitions: expected %lld tile minboxes\n",
+            static_cast<long long>(tile_count));
+    plan.partition_size = plan.partition_width = plan.partition_height = 1;
+    plan.partition_count = tile_count;
+    plan.input_bytes = plan.output_bytes = plan.peak_bytes = 0;
+    plan.fits = false;
+    return plan;
+  }
+
+  EstimatePartitions(tile_minboxes, row_count, column_count, tile_size,
+                     band_count, pixel_type, output_count, index_map,
+                     row_alignment, 1, &plan);
+  plan.fits = plan.peak_bytes <= memory_budget;
+  if (!plan.fits) {
+    return plan;
+  }
+
+  for (int64_t size = 2; size <= tile_count && size <= INT32_MAX / 2;
+       size *= 2) {
+    EstimatePartitions(tile_minboxes, row_count, column_count, tile_size,
+                       band_count, pixel_type, output_count, index_map,
+                       row_alignment, static_cast<int>(size), &candidate);
+    if (candidate.partition_count < process_count) {
+      break;
+    }
+    if (candidate.peak_bytes <= memory_budget) {
+      plan = candidate;
+      plan.fits = true;
+    }
+  }
+
+  return plan;
+}
+
+Area TileMinboxUnion(const std::vector<Area> &tile_minboxes,
+                     int64_t column_count,
+                     int tile_size,
+                     Area area) {
+  const int64_t tiles_across = (column_count + tile_size - 1) / tile_size;
+  Area box(DBL_MAX, DBL_MAX, -DBL_MAX, -DBL_MAX);
+  for (int64_t ty = static_cast<int64_t>(area.ul.y) / tile_size;
+       ty <= static_cast<int64_t>(area.lr.y) / tile_size; ++ty) {
+    for (int64_t tx = static_cast<int64_t>(area.ul.x) / tile_size;
+         tx <= static_cast<int64_t>(area.lr.x) / tile_size; ++tx) {
+      const Area &tile = tile_minboxes[ty * tiles_across + tx];
+      if (tile.ul.x == -1.0) {
+        continue;
+      }
+      box.ul.x = std::min(box.ul.x, tile.ul.x);
+      box.ul.y = std::min(box.ul.y, tile.ul.y);
+      box.lr.x = std::max(box.lr.x, tile.lr.x);
+      box.lr.y = std::max(box.lr.y, tile.lr.y);
+    }
+  }
+  if (box.ul.x > box.lr.x) {
+    return Area(-1.0, -1.0, -1.0, -1.0);
+  }
+  return box;
+}
+
 void SearchAndUpdate(Area input_area,
                      string input_srs,
                      string output_srs,
@@ -402,16 +641,18 @@ void SearchAndUpdate(Area input_area,
 Area ProjectedMinbox(Coordinate input_ul_corner,
                      string input_srs,
                      double input_pixel_size,
-                     int input_row_count,
-                     int input_column_count,
+                     int64_t input_row_count,
+                     int64_t input_column_count,
                      string output_srs) {
   // Input area, projected coordinates
   Area ia;
   // Projected Area
   Area output_area;
-  const int buffer = 10;
-  const int row_buffer = buffer > input_row_count ? input_row_count : buffer;
-  const int column_buffer = buffer > input_column_count ? input_column_count : buffer;
+  const int64_t buffer = 10;
+  const int64_t row_buffer =
+      buffer > input_row_count ? input_row_count : buffer;
+  const int64_t column_buffer =
+      buffer > input_column_count ? input_column_count : buffer;
 
   output_area.ul.x = output_area.lr.y = DBL_MAX;
   output_area.ul.y = output_area.lr.x = -DBL_MAX;
@@ -475,46 +716,133 @@ Area ProjectedMinbox(Coordinate input_ul_corner,
   return output_area;
 }
 
+/** \cond DOXYHIDE **/
+// Appends the raster blocks covered by footprint, widened by one pixel on
+// each side, to blocks. The kernels compute the footprints relative to the
+// chunks, the margin absorbs any difference in rounding. Consecutive
+// footprints mostly touch the same blocks, so blocks among the last few
+// appended are not appended again.
+static void MarkFootprintBlocks(const Area &footprint,
+                                int64_t row_count,
+                                int64_t column_count,
+                                const BlockResidency *residency,
+                                std::vector<int64_t> *blocks) {
+  const double min_x = std::min(footprint.ul.x, footprint.lr.x) - 1.0;
+  const double max_x = std::max(footprint.ul.x, footprint.lr.x) + 1.0;
+  const double min_y = std::min(footprint.ul.y, footprint.lr.y) - 1.0;
+  const double max_y = std::max(footprint.ul.y, footprint.lr.y) + 1.0;
+  if (max_x < 0.0 || max_y < 0.0
+      || min_x > column_count - 1 || min_y > row_count - 1) {
+    return;
+  }
+
+  const int64_t blocks_across =
+      (column_count + residency->block_width - 1) / residency->block_width;
+  const int64_t first_x = std::max<int64_t>(0, floor(min_x))
+      / residency->block_width;
+  const int64_t last_x = std::min<int64_t>(column_count - 1, ceil(max_x))
+      / residency->block_width;
+  const int64_t first_y = std::max<int64_t>(0, floor(min_y))
+      / residency->block_height;
+  const int64_t last_y = std::min<int64_t>(row_count - 1, ceil(max_y))
+      / residency->block_height;
+
+  for (int64_t by = first_y; by <= last_y; ++by) {
+    for (int64_t bx = first_x; bx <= last_x; ++bx) {
+      const int64_t block = by * blocks_across + bx;
+      if (blocks->empty() || std::find(blocks->end()
+                                       - std::min<size_t>(blocks->size(), 4),
+                                       blocks->end(), block) == blocks->end()) {
+        blocks->push_back(block);
+      }
+    }
+  }
+}
+
+// Fills residency with the blocks of area, in raster coordinates, that are
+// listed in blocks
+static void BuildResidency(const Area &area,
+                           int64_t column_count,
+                           const std::vector<int64_t> &blocks,
+                           BlockResidency *residency) {
+  residency->resident.clear();
+  residency->blocks_across = residency->blocks_down = 0;
+  if (area.ul.x == -1.0) {
+    return;
+  }
+
+  const int64_t raster_blocks_across =
+      (column_count + residency->block_width - 1) / residency->block_width;
+  residency->first_block_x = static_cast<int64_t>(area.ul.x)
+      / residency->block_width;
+  residency->first_block_y = static_cast<int64_t>(area.ul.y)
+      / residency->block_height;
+  residency->blocks_across = static_cast<int64_t>(area.lr.x)
+      / residency->block_width - residency->first_block_x + 1;
+  residency->blocks_down = static_cast<int64_t>(area.lr.y)
+      / residency->block_height - residency->first_block_y + 1;
+  residency->resident.assign(residency->blocks_across
+                             * residency->blocks_down, false);
+
+  for (size_t i = 0; i < blocks.size(); ++i) {
+    const int64_t bx = blocks[i] % raster_blocks_across
+        - residency->first_block_x;
+    const int64_t by = blocks[i] / raster_blocks_across
+        - residency->first_block_y;
+    if (bx >= 0 && bx < residency->blocks_across
+        && by >= 0 && by < residency->blocks_down) {
+      residency->resident[by * residency->blocks_across + bx] = true;
+    }
+  }
+}
+/** \endcond **/
+
 Area RasterMinbox(GDALDataset *source,
                   GDALDataset *destination,
-                  Area destination_raster_area) {
-  double s_gt[6];
-  double d_gt[6];
-  source->GetGeoTransform(s_gt);
-  destination->GetGeoTransform(d_gt);
+                  Area destination_raster_area,
+                  BlockResidency *residency) {
+  return RasterMinbox(RasterDescriptor(source),
+                      RasterDescriptor(destination),
+                      destination_raster_area,
+                      residency);
+}
+
+Area RasterMinbox(const RasterDescriptor &source,
+                  const RasterDescriptor &destination,
+                  Area destination_raster_area,
+                  BlockResidency *residency) {
+  const double *s_gt = source.geotransform;
+  const double *d_gt = destination.geotransform;
 
   Coordinate s_ul(s_gt[0], s_gt[3], UNDEF);
   Coordinate d_ul(d_gt[0], d_gt[3], UNDEF);
 
-  string s_srs(source->GetProjectionRef());
-  string d_srs(destination->GetProjectionRef());
-
-  return RasterMinbox2(s_srs,
+  return RasterMinbox2(source.projection,
                        s_ul,
                        s_gt[1],
-                       source->GetRasterYSize(),
-                       source->GetRasterXSize(),
-                       d_srs,
+                       source.row_count,
+                       source.column_count,
+                       destination.projection,
                        d_ul,
                        d_gt[1],
-                       destination->GetRasterYSize(),
-                       destination->GetRasterXSize(),
-                       destination_raster_area);
+                       destination.row_count,
+                       destination.column_count,
+                       destination_raster_area,
+                       residency);
 }
 
 Area RasterMinbox2(string source_projection,
                   Coordinate source_ul,
                   double source_pixel_size,
-                  int source_row_count,
-                  int source_column_count,
+                  int64_t source_row_count,
+                  int64_t source_column_count,
                   string destination_projection,
                   Coordinate destination_ul,
                   double destination_pixel_size,
-                  int destination_row_count,
-                  int destination_column_count,
-                  Area destination_raster_area) {
-  Area source_area;
-  Coordinate c;
+                  int64_t destination_row_count,
+                  int64_t destination_column_count,
+                  Area destination_raster_area,
+                  BlockResidency *residency) {
   RasterCoordTransformer rt(source_projection,
                             source_ul,
                             source_pixel_size,
@@ -527,24 +855,47 @@ Area RasterMinbox2(string source_projection,
     return Area(-1.0, -1.0, -1.0, -1.0);
   }
 
+  return RasterMinbox(&rt,
+                      destination_row_count,
+                      destination_column_count,
+                      destination_raster_area,
+                      residency);
+}
+
+Area RasterMinbox(RasterCoordTransformer *transformer,
+                  int64_t destination_row_count,
+                  int64_t destination_column_count,
+                  Area destination_raster_area,
+                  BlockResidency *residency) {
+  if (residency != NULL
+      && (residency->block_width <= 0 || residency->block_height <= 0)) {
+    // Without a block size nothing can be marked, the chunk is read whole
+    residency->resident.clear();
+    residency = NULL;
+  }
+
+  Area source_area;
+  Coordinate c;
   Area temp;
+  // Raster block indices touched by the footprints, see MarkFootprintBlocks
+  std::vector<int64_t> touched_blocks;
   source_area.ul.x = source_area.ul.y = DBL_MAX;
   source_area.lr.y = source_area.lr.x = -DBL_MAX;
   source_area.units = UNDEF;
 
-  int row_space = destination_row_count / 10;
+  int64_t row_space = destination_row_count / 10;
   if (row_space < 3) {
     row_space = destination_row_count;
   }
 
-  int column_space = destination_column_count / 10;
+  int64_t column_space = destination_column_count / 10;
   if (column_space < 3) {
     column_space = destination_column_count;
   }
 
-  for (int y = destination_raster_area.ul.y;
+  for (int64_t y = destination_raster_area.ul.y;
        y <= destination_raster_area.lr.y; ++y) {
-    for (int x = destination_raster_area.ul.x;
+    for (int64_t x = destination_raster_area.ul.x;
          x <= destination_raster_area.lr.x; ++x) {
       if (y > row_space
           && y < destination_column_count - row_space
@@ -555,12 +906,18 @@ Area RasterMinbox2(string source_projection,
       c.x = x;
       c.y = y;
 
-      temp = rt.Transform(c);
+      temp = transformer->Transform(c);
 
       if (temp.ul.x == -1) {
         continue;
       }
 
+      if (residency != NULL) {
+        MarkFootprintBlocks(temp, destination_row_count,
+                            destination_column_count, residency,
+                            &touched_blocks);
+      }
+
       // Check that calculated minbox in within destination raster space.
       if ((temp.ul.x < -0.01) || (temp.ul.x > destination_column_count - 1)
           || (temp.ul.y < 0.0) || (temp.ul.y > destination_row_count - 1)
@@ -573,11 +930,11 @@ Area RasterMinbox2(string source_projection,
                destination_raster_area.ul.y,
                destination_raster_area.lr.x,
                destination_raster_area.lr.y);
-        printf("Source UL: %f %f\n", source_ul.x, source_ul.y);
-        printf("Destin UL: %f %f\n", destination_ul.x, destination_ul.y);
-        printf("Source raster size, columns: %d, rows %d\n",
-               destination_column_count, destination_row_count);
-        printf("Source: %d %d\n", x, y);
+        printf("Source raster size, columns: %lld, rows %lld\n",
+               static_cast<long long>(destination_column_count),
+               static_cast<long long>(destination_row_count));
+        printf("Source: %lld %lld\n", static_cast<long long>(x),
+               static_cast<long long>(y));
         printf("Outside rasterspace: %f %f %f %f\n",
                temp.ul.x, temp.ul.y, temp.lr.x, temp.lr.y);
       }
@@ -640,9 +997,135 @@ Area RasterMinbox2(string source_projection,
     source_area.lr.x = source_area.ul.x;
   }
 
+  if (residency != NULL) {
+    BuildResidency(source_area, destination_column_count, touched_blocks,
+                   residency);
+  }
+
   return source_area;
 }
 
+/** \cond DOXYHIDE **/
+typedef bool (*ReprojectKernel)(RasterChunk*, RasterChunk*, int, double,
+                                RasterCoordTransformer*);
+
+// The dispatch table holds one fully specialized ReprojectChunkType per sample
+// type, resampler and samples per pixel. The samples per pixel index is the
+// position in kKernelBandCounts, the last entry being the generic kernel. Two
+// samples per pixel covers single band complex data.
+const int kKernelBandCounts[] = { 1, 2, 3, 4, 0 };
+const int kKernelBandVariants = 5;
+const int kKernelResamplers = 5;
+
+#define PRB_BAND_KERNELS(C_PIXEL_TYPE, RESAMPLER_POLICY) \
+  { &ReprojectChunkType<C_PIXEL_TYPE, RESAMPLER_POLICY, 1>, \
+    &ReprojectChunkType<C_PIXEL_TYPE, RESAMPLER_POLICY, 2>, \
+    &ReprojectChunkType<C_PIXEL_TYPE, RESAMPLER_POLICY, 3>, \
+    &ReprojectChunkType<C_PIXEL_TYPE, RESAMPLER_POLICY, 4>, \
+    &ReprojectChunkType<C_PIXEL_TYPE, RESAMPLER_POLICY, 0> }
+
+// Entries must be in the order of the RESAMPLER enum
+#define PRB_RESAMPLER_KERNELS(C_PIXEL_TYPE) \
+  { PRB_BAND_KERNELS(C_PIXEL_TYPE, NearestResampler), \
+    PRB_BAND_KERNELS(C_PIXEL_TYPE, MinResampler), \
+    PRB_BAND_KERNELS(C_PIXEL_TYPE, MaxResampler), \
+    PRB_BAND_KERNELS(C_PIXEL_TYPE, MeanResampler), \
+    PRB_BAND_KERNELS(C_PIXEL_TYPE, CountResampler) }
+
+// Entries must be in the order used by KernelTypeIndex
+const ReprojectKernel kReprojectKernels[][kKernelResamplers]
+                                       [kKernelBandVariants] = {
+  PRB_RESAMPLER_KERNELS(uint8_t),
+  PRB_RESAMPLER_KERNELS(uint16_t),
+  PRB_RESAMPLER_KERNELS(int16_t),
+  PRB_RESAMPLER_KERNELS(uint32_t),
+  PRB_RESAMPLER_KERNELS(int32_t),
+  PRB_RESAMPLER_KERNELS(float),
+  PRB_RESAMPLER_KERNELS(double),
+};
+
+typedef bool (*FusedKernel)(RasterChunk*, RasterChunk * const *,
+                            const RESAMPLER*, int, int, double,
+                            RasterCoordTransformer*);
+
+#define PRB_FUSED_KERNELS(C_PIXEL_TYPE) \
+  { &ReprojectChunkFusedType<C_PIXEL_TYPE, 1>, \
+    &ReprojectChunkFusedType<C_PIXEL_TYPE, 2>, \
+    &ReprojectChunkFusedType<C_PIXEL_TYPE, 3>, \
+    &ReprojectChunkFusedType<C_PIXEL_TYPE, 4>, \
+    &ReprojectChunkFusedType<C_PIXEL_TYPE, 0> }
+
+// Entries must be in the order used by KernelTypeIndex
+const FusedKernel kFusedKernels[][kKernelBandVariants] = {
+  PRB_FUSED_KERNELS(uint8_t),
+  PRB_FUSED_KERNELS(uint16_t),
+  PRB_FUSED_KERNELS(int16_t),
+  PRB_FUSED_KERNELS(uint32_t),
+  PRB_FUSED_KERNELS(int32_t),
+  PRB_FUSED_KERNELS(float),
+  PRB_FUSED_KERNELS(double),
+};
+
+#undef PRB_FUSED_KERNELS
+#undef PRB_RESAMPLER_KERNELS
+#undef PRB_BAND_KERNELS
+
+// Complex pixels are handled as interleaved real and imaginary samples of the
+// component type. Returns the type of one sample and sets *components to the
+// number of samples per band.
+GDALDataType KernelSampleType(GDALDataType type, int *components) {
+  *components = 2;
+  switch (type) {
+    case GDT_CInt16:
+      return GDT_Int16;
+    case GDT_CInt32:
+      return GDT_Int32;
+    case GDT_CFloat32:
+      return GDT_Float32;
+    case GDT_CFloat64:
+      return GDT_Float64;
+    default:
+      *components = 1;
+      return type;
+  }
+}
+
+// Only resamplers that are defined component-wise can be used on complex data
+bool ComplexResampler(RESAMPLER resampler) {
+  return resampler == NEAREST || resampler == MEAN;
+}
+
+int KernelTypeIndex(GDALDataType type) {
+  switch (type) {
+    case GDT_Byte:
+      return 0;
+    case GDT_UInt16:
+      return 1;
+    case GDT_Int16:
+      return 2;
+    case GDT_UInt32:
+      return 3;
+    case GDT_Int32:
+      return 4;
+    case GDT_Float32:
+      return 5;
+    case GDT_Float64:
+      return 6;
+    default:
+      return -1;
+  }
+}
+
+int KernelBandIndex(int band_count) {
+  for (int i = 0; i < kKernelBandVariants - 1; ++i) {
+    if (kKernelBandCounts[i] == band_count) {
+      return i;
+    }
+  }
+  return kKernelBandVariants - 1;
+}
+/** \endcond **/
+
 /**
  * \brief This function takes two RasterChunk pointers and performs
  *        reprojection and resampling
@@ -653,40 +1136,547 @@ Area RasterMinbox2(string source_projection,
  *
  * @return Returns a bool indicating success or failure.
  */
+/** \cond DOXYHIDE **/
+// Splits the destinations, which cover the same area, into thread_count
+// bands of rows and calls reproject with the bands of each thread. The
+// threads write disjoint rows and only read the source chunk.
+template <class Function>
+static bool ReprojectRowBands(const std::vector<RasterChunk*> &destinations,
+                              int thread_count,
+                              Function reproject) {
+  const int64_t row_count = destinations[0]->row_count_;
+  thread_count = static_cast<int>(std::min<int64_t>(thread_count, row_count));
+  std::vector<std::vector<RasterChunk> > bands(thread_count);
+  std::vector<char> results(thread_count, 0);
+  std::vector<std::thread> threads;
+
+  for (int t = 0; t < thread_count; ++t) {
+    const int64_t first_row = row_count * t / thread_count;
+    const int64_t last_row = row_count * (t + 1) / thread_count;
+    // Growing the vector would copy the bands, pixels included
+    bands[t].reserve(destinations.size());
+    for (size_t i = 0; i < destinations.size(); ++i) {
+      bands[t].push_back(destinations[i]->Subchunk(
+          Area(0, first_row,
+               destinations[i]->column_count_ - 1, last_row - 1)));
+    }
+  }
+
+  for (int t = 0; t < thread_count; ++t) {
+    threads.push_back(std::thread([&bands, &results, &reproject, t]() {
+      std::vector<RasterChunk*> band_pointers;
+      for (size_t i = 0; i < bands[t].size(); ++i) {
+        band_pointers.push_back(&bands[t][i]);
+      }
+      results[t] = reproject(band_pointers) ? 1 : 0;
+    }));
+  }
+
+  bool ok = true;
+  for (int t = 0; t < thread_count; ++t) {
+    threads[t].join();
+    ok = ok && results[t] != 0;
+  }
+  return ok;
+}
+/** \endcond **/
+
 bool ReprojectChunk(RasterChunk *source,
                     RasterChunk *destination,
                     string fillvalue,
-                    RESAMPLER resampler) {
+                    RESAMPLER resampler,
+                    int thread_count,
+                    RasterCoordTransformer *transformer) {
   if (source->pixel_type_ != destination->pixel_type_) {
     fprintf(stderr, "Source and destination chunks have different types!\n");
     return false;
   }
 
+  if (source->band_count_ != destination->band_count_) {
+    fprintf(stderr,
+            "Source and destination chunks have different band counts!\n");
+    return false;
+  }
+
+  int components = 1;
+  const int type_index =
+      KernelTypeIndex(KernelSampleType(source->pixel_type_, &components));
+  if (type_index < 0) {
+    fprintf(stderr, "Invalid type in ReprojectChunk!\n");
+    return false;
+  }
+
+  if (resampler < 0 || resampler >= kKernelResamplers) {
+    fprintf(stderr, "Invalid resampler in ReprojectChunk!\n");
+    return false;
+  }
+
+  if (components > 1 && !ComplexResampler(resampler)) {
+    fprintf(stderr, "The %s resampler does not support complex types!\n",
+            ResamplerName(resampler));
+    return false;
+  }
+
+  if (thread_count > 1 && destination->row_count_ > 1) {
+    return ReprojectRowBands(
+        std::vector<RasterChunk*>(1, destination),
+        thread_count,
+        [&](const std::vector<RasterChunk*> &bands) {
+          return ReprojectChunk(source, bands[0], fillvalue, resampler, 1);
+        });
+  }
+
+  if (transformer == NULL) {
+    RasterCoordTransformer rt(destination->projection_,
+                              destination->ul_projected_corner_,
+                              destination->pixel_size_,
+                              destination->row_count_,
+                              destination->column_count_,
+                              source->projection_,
+                              source->ul_projected_corner_,
+                              source->pixel_size_);
+    return ReprojectChunk(source, destination, fillvalue, resampler, 1, &rt);
+  }
+  transformer->SetCorners(destination->ul_projected_corner_,
+                          source->ul_projected_corner_);
+
+  // Nearest-neighbor reprojection is split into a transform phase that builds
+  // a source index map and a gather phase that moves the pixels.
+  if (resampler == NEAREST) {
+    std::vector<int32_t> index_map;
+    if (ComputeSourceIndexMap(source, destination, &index_map, transformer)) {
+      return ApplySourceIndexMap(source, destination, index_map, fillvalue);
+    }
+  }
+
   double fvalue = strtod(fillvalue.c_str(), NULL);
 
-  switch (source->pixel_type_) {
+  const int samples_per_pixel = source->band_count_ * components;
+  ReprojectKernel kernel =
+      kReprojectKernels[type_index][resampler]
+                       [KernelBandIndex(samples_per_pixel)];
+  return kernel(source, destination, samples_per_pixel, fvalue, transformer);
+}
+
+bool ReprojectChunkMulti(RasterChunk *source,
+                         const std::vector<RasterChunk*> &destinations,
+                         string fillvalue,
+                         const std::vector<RESAMPLER> &resamplers,
+                         int thread_count) {
+  if (destinations.empty() || destinations.size() != resamplers.size()) {
+    fprintf(stderr,
+            "ReprojectChunkMulti needs one destination per resampler!\n");
+    return false;
+  }
+
+  for (size_t i = 0; i < destinations.size(); ++i) {
+    RasterChunk *destination = destinations[i];
+    if (source->pixel_type_ != destination->pixel_type_
+        || source->band_count_ != destination->band_count_) {
+      fprintf(stderr, "Source and destination chunks have different types!\n");
+      return false;
+    }
+
+    if (destination->row_count_ != destinations[0]->row_count_
+        || destination->column_count_ != destinations[0]->column_count_
+        || destination->raster_location_ != destinations[0]->raster_location_) {
+      fprintf(stderr, "Destination chunks cover different areas!\n");
+      return false;
+    }
+
+    if (resamplers[i] < 0 || resamplers[i] >= kKernelResamplers) {
+      fprintf(stderr, "Invalid resampler in ReprojectChunkMulti!\n");
+      return false;
+    }
+  }
+
+  int components = 1;
+  const int type_index =
+      KernelTypeIndex(KernelSampleType(source->pixel_type_, &components));
+  if (type_index < 0) {
+    fprintf(stderr, "Invalid type in ReprojectChunkMulti!\n");
+    return false;
+  }
+
+  for (size_t i = 0; i < resamplers.size(); ++i) {
+    if (components > 1 && !ComplexResampler(resamplers[i])) {
+      fprintf(stderr, "The %s resampler does not support complex types!\n",
+              ResamplerName(resamplers[i]));
+      return false;
+    }
+  }
+
+  if (thread_count > 1 && destinations[0]->row_count_ > 1) {
+    return ReprojectRowBands(
+        destinations,
+        thread_count,
+        [&](const std::vector<RasterChunk*> &bands) {
+          return ReprojectChunkMulti(source, bands, fillvalue, resamplers, 1);
+        });
+  }
+
+  double fvalue = strtod(fillvalue.c_str(), NULL);
+
+  const int samples_per_pixel = source->band_count_ * components;
+  RasterCoordTransformer rt(destinations[0]->projection_,
+                            destinations[0]->ul_projected_corner_,
+                            destinations[0]->pixel_size_,
+                            destinations[0]->row_count_,
+                            destinations[0]->column_count_,
+                            source->projection_,
+                            source->ul_projected_corner_,
+                            source->pixel_size_);
+  FusedKernel kernel =
+      kFusedKernels[type_index][KernelBandIndex(samples_per_pixel)];
+  return kernel(source,
+                &destinations[0],
+                &resamplers[0],
+                static_cast<int>(resamplers.size()),
+                samples_per_pixel,
+                fvalue,
+                &rt);
+}
+
+bool ComputeSourceIndexMap(RasterChunk *source,
+                           RasterChunk *destination,
+                           std::vector<int32_t> *index_map,
+                           RasterCoordTransformer *transformer) {
+  // Indices count pixels from the upper-left pixel, padded rows included
+  const int64_t pixel_size = (GDALGetDataTypeSize(source->pixel_type_) / 8)
+      * source->band_count_;
+  if (pixel_size == 0 || source->row_stride_ % pixel_size != 0) {
+    return false;
+  }
+  const int64_t source_pitch = source->row_stride_ / pixel_size;
+  const int64_t source_pixel_count =
+      static_cast<int64_t>(source->row_count_) * source_pitch;
+  if (source_pixel_count > INT32_MAX) {
+    return false;
+  }
+
+  if (transformer == NULL) {
+    RasterCoordTransformer rt(destination->projection_,
+                              destination->ul_projected_corner_,
+                              destination->pixel_size_,
+                              destination->row_count_,
+                              destination->column_count_,
+                              source->projection_,
+                              source->ul_projected_corner_,
+                              source->pixel_size_);
+    return ComputeSourceIndexMap(source, destination, index_map, &rt);
+  }
+  transformer->SetCorners(destination->ul_projected_corner_,
+                          source->ul_projected_corner_);
+
+  index_map->resize(static_cast<size_t>(destination->row_count_)
+                    * destination->column_count_);
+  int32_t *map = &(*index_map)[0];
+  Area footprint;
+
+  for (int64_t chunk_y = 0; chunk_y < destination->row_count_; ++chunk_y) {
+    for (int64_t chunk_x = 0; chunk_x < destination->column_count_;
+         ++chunk_x) {
+      if (SourceFootprint(transformer, source, chunk_x, chunk_y,
+                          &footprint)) {
+        *map = static_cast<int32_t>(footprint.ul.x
+                                    + footprint.ul.y * source_pitch);
+      } else {
+        *map = kFillIndex;
+      }
+      ++map;
+    }
+  }
+
+  return true;
+}
+
+/** \cond DOXYHIDE **/
+// Fills pixel, band_count values of pixelType, with the fill value
+template <class pixelType>
+void FillPixel(double fvalue, int band_count, void *pixel) {
+  for (int b = 0; b < band_count; ++b) {
+    static_cast<pixelType*>(pixel)[b] = static_cast<pixelType>(fvalue);
+  }
+}
+/** \endcond **/
+
+bool ApplySourceIndexMap(RasterChunk *source,
+                         RasterChunk *destination,
+                         const std::vector<int32_t> &index_map,
+                         string fillvalue) {
+  const int64_t destination_pixel_count =
+      static_cast<int64_t>(destination->row_count_)
+      * destination->column_count_;
+  if (source->pixel_type_ != destination->pixel_type_
+      || source->band_count_ != destination->band_count_
+      || static_cast<int64_t>(index_map.size()) != destination_pixel_count) {
+    return false;
+  }
+
+  const size_t pixel_size = (GDALGetDataTypeSize(source->pixel_type_) / 8)
+      * source->band_count_;
+  const double fvalue = strtod(fillvalue.c_str(), NULL);
+  std::vector<char> fill_pixel(pixel_size);
+
+  // Complex fill pixels get the fill value in both components
+  int components = 1;
+  const GDALDataType sample_type = KernelSampleType(source->pixel_type_,
+                                                    &components);
+  const int samples = source->band_count_ * components;
+
+  switch (sample_type) {
     case GDT_Byte:
-      GEN_RESAMPLER_CASES(uint8_t);
+      FillPixel<uint8_t>(fvalue, samples, &fill_pixel[0]);
+      break;
     case GDT_UInt16:
-      GEN_RESAMPLER_CASES(uint16_t);
+      FillPixel<uint16_t>(fvalue, samples, &fill_pixel[0]);
+      break;
     case GDT_Int16:
-      GEN_RESAMPLER_CASES(int16_t);
+      FillPixel<int16_t>(fvalue, samples, &fill_pixel[0]);
+      break;
     case GDT_UInt32:
-      GEN_RESAMPLER_CASES(uint32_t);
+      FillPixel<uint32_t>(fvalue, samples, &fill_pixel[0]);
+      break;
     case GDT_Int32:
-      GEN_RESAMPLER_CASES(int32_t);
+      FillPixel<int32_t>(fvalue, samples, &fill_pixel[0]);
+      break;
     case GDT_Float32:
-      GEN_RESAMPLER_CASES(float);
+      FillPixel<float>(fvalue, samples, &fill_pixel[0]);
+      break;
     case GDT_Float64:
-      GEN_RESAMPLER_CASES(double);
-    case GDT_CInt16:
-    case GDT_CInt32:
-    case GDT_CFloat32:
-    case GDT_CFloat64:
+      FillPixel<double>(fvalue, samples, &fill_pixel[0]);
+      break;
     default:
-      fprintf(stderr, "Invalid type in ReprojectChunk!\n");
+      fprintf(stderr, "Invalid type in ApplySourceIndexMap!\n");
       return false;
+  }
+
+  if (destination->row_stride_
+      == static_cast<int64_t>(pixel_size) * destination->column_count_) {
+    GatherPixels(&index_map[0],
+                 destination_pixel_count,
+                 source->pixels_,
+                 pixel_size,
+                 &fill_pixel[0],
+                 destination->pixels_);
+    return true;
+  }
+
+  // Padded destination rows are gathered one at a time
+  for (int64_t y = 0; y < destination->row_count_; ++y) {
+    GatherPixels(&index_map[y * destination->column_count_],
+                 destination->column_count_,
+                 source->pixels_,
+                 pixel_size,
+                 &fill_pixel[0],
+                 destination->Row(y));
+  }
+  return true;
+}
+
+/** \cond DOXYHIDE **/
+// Reduces the pixels of source, samples values of pixelType each, covered by
+// every pixel of destination
+template <class pixelType>
+void DownsampleChunkType(RasterChunk *source,
+                         RasterChunk *destination,
+                         RESAMPLER resampler,
+                         int samples,
+                         double fvalue) {
+  const pixelType fill = static_cast<pixelType>(fvalue);
+  for (int64_t dy = 0; dy < destination->row_count_; ++dy) {
+    pixelType *out = static_cast<pixelType*>(destination->Row(dy));
+    const int64_t y = 2 * (destination->raster_location_.y + dy)
+        - source->raster_location_.y;
+    const int64_t rows = std::min<int64_t>(2, source->row_count_ - y);
+    for (int64_t dx = 0; dx < destination->column_count_; ++dx) {
+      const int64_t x = 2 * (destination->raster_location_.x + dx)
+          - source->raster_location_.x;
+      const int64_t columns = std::min<int64_t>(2, source->column_count_ - x);
+      pixelType *pixel = out + dx * samples;
+
+      // The covered pixels that are not entirely fill
+      const pixelType *inputs[4];
+      int count = 0;
+      for (int64_t r = 0; r < rows; ++r) {
+        for (int64_t c = 0; c < columns; ++c) {
+          const pixelType *input = static_cast<const pixelType*>(
+              source->Row(y + r)) + (x + c) * samples;
+          for (int s = 0; s < samples; ++s) {
+            if (input[s] != fill) {
+              inputs[count++] = input;
+              break;
+            }
+          }
+        }
+      }
+
+      for (int s = 0; s < samples; ++s) {
+        if (count == 0) {
+          pixel[s] = fill;
+          continue;
+        }
+        double value = inputs[0][s];
+        for (int i = 1; i < count; ++i) {
+          switch (resampler) {
+            case MIN:
+              value = std::min(value, static_cast<double>(inputs[i][s]));
+              break;
+            case MAX:
+              value = std::max(value, static_cast<double>(inputs[i][s]));
+              break;
+            case MEAN:
+            case COUNT:
+              value += inputs[i][s];
+              break;
+            default:
+              break;
+          }
+        }
+        if (resampler == COUNT) {
+          pixel[s] = SaturateCount<pixelType>(value);
+        } else if (resampler == MEAN) {
+          // Truncated like the MEAN reprojection kernel, so every level
+          // rounds the same way
+          pixel[s] = static_cast<pixelType>(value / count);
+        } else {
+          pixel[s] = static_cast<pixelType>(value);
+        }
+      }
+    }
+  }
+}
+/** \endcond **/
+
+bool DownsampleChunk(RasterChunk *source,
+                     RasterChunk *destination,
+                     RESAMPLER resampler,
+                     string fillvalue) {
+  if (source->pixel_type_ != destination->pixel_type_
+      || source->band_count_ != destination->band_count_
+      || destination->raster_location_.x < 0
+      || destination->raster_location_.y < 0
+      || 2 * destination->raster_location_.x < source->raster_location_.x
+      || 2 * destination->raster_location_.y < source->raster_location_.y
+      || 2 * (destination->raster_location_.x + destination->column_count_
+              - 1)
+      >= source->raster_location_.x + source->column_count_
+      || 2 * (destination->raster_location_.y + destination->row_count_ - 1)
+      >= source->raster_location_.y + source->row_count_) {
+    return false;
+  }
+
+  int components = 1;
+  const GDALDataType sample_type = KernelSampleType(source->pixel_type_,
+                                                    &components);
+  if (components > 1 && !ComplexResampler(resampler)) {
+    return false;
+  }
+  const int samples = source->band_count_ * components;
+  const double fvalue = strtod(fillvalue.c_str(), NULL);
+
+  switch (sample_type) {
+    case GDT_Byte:
+      DownsampleChunkType<uint8_t>(source, destination, resampler, samples,
+                                   fvalue);
+      break;
+    case GDT_UInt16:
+      DownsampleChunkType<uint16_t>(source, destination, resampler, samples,
+                                    fvalue);
+      break;
+    case GDT_Int16:
+      DownsampleChunkType<int16_t>(source, destination, resampler, samples,
+                                   fvalue);
+      break;
+    case GDT_UInt32:
+      DownsampleChunkType<uint32_t>(source, destination, resampler, samples,
+                                    fvalue);
+      break;
+    case GDT_Int32:
+      DownsampleChunkType<int32_t>(source, destination, resampler, samples,
+                                   fvalue);
+      break;
+    case GDT_Float32:
+      DownsampleChunkType<float>(source, destination, resampler, samples,
+                                 fvalue);
       break;
+    case GDT_Float64:
+      DownsampleChunkType<double>(source, destination, resampler, samples,
+                                  fvalue);
+      break;
+    default:
+      fprintf(stderr, "Invalid type in DownsampleChunk!\n");
+      return false;
+  }
+  return true;
+}
+
+/** \cond DOXYHIDE **/
+// Stores count samples of pixelType holding fvalue in row
+template <class pixelType>
+void FillRow(double fvalue, int64_t count, std::vector<char> *row) {
+  const pixelType fill = static_cast<pixelType>(fvalue);
+  row->resize(count * sizeof(pixelType));
+  for (int64_t i = 0; i < count; ++i) {
+    memcpy(&(*row)[i * sizeof(pixelType)], &fill, sizeof(pixelType));
+  }
+}
+/** \endcond **/
+
+bool AreaIsFill(RasterChunk *chunk, Area area, string fillvalue) {
+  const int64_t ul_x = static_cast<int64_t>(area.ul.x
+                                            - chunk->raster_location_.x);
+  const int64_t ul_y = static_cast<int64_t>(area.ul.y
+                                            - chunk->raster_location_.y);
+  const int64_t lr_x = static_cast<int64_t>(area.lr.x
+                                            - chunk->raster_location_.x);
+  const int64_t lr_y = static_cast<int64_t>(area.lr.y
+                                            - chunk->raster_location_.y);
+  if (ul_x < 0 || ul_y < 0 || lr_x < ul_x || lr_y < ul_y
+      || lr_x >= chunk->column_count_ || lr_y >= chunk->row_count_) {
+    return false;
+  }
+
+  int components = 1;
+  const GDALDataType sample_type = KernelSampleType(chunk->pixel_type_,
+                                                    &components);
+  const int64_t samples = (lr_x - ul_x + 1) * chunk->band_count_ * components;
+  const double fvalue = strtod(fillvalue.c_str(), NULL);
+  std::vector<char> fill_row;
+  switch (sample_type) {
+    case GDT_Byte:
+      FillRow<uint8_t>(fvalue, samples, &fill_row);
+      break;
+    case GDT_UInt16:
+      FillRow<uint16_t>(fvalue, samples, &fill_row);
+      break;
+    case GDT_Int16:
+      FillRow<int16_t>(fvalue, samples, &fill_row);
+      break;
+    case GDT_UInt32:
+      FillRow<uint32_t>(fvalue, samples, &fill_row);
+      break;
+    case GDT_Int32:
+      FillRow<int32_t>(fvalue, samples, &fill_row);
+      break;
+    case GDT_Float32:
+      FillRow<float>(fvalue, samples, &fill_row);
+      break;
+    case GDT_Float64:
+      FillRow<double>(fvalue, samples, &fill_row);
+      break;
+    default:
+      fprintf(stderr, "Invalid type in AreaIsFill!\n");
+      return false;
+  }
+
+  const int64_t offset = static_cast<int64_t>(fill_row.size())
+      / (lr_x - ul_x + 1) * ul_x;
+  for (int64_t y = ul_y; y <= lr_y; ++y) {
+    if (memcmp(static_cast<char*>(chunk->Row(y)) + offset, &fill_row[0],
+               fill_row.size()) != 0) {
+      return false;
+    }
   }
   return true;
 }
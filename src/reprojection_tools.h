@@ -21,6 +21,8 @@
 #include <string>
 #include <vector>
 
+#include "src/gather.h"
+#include "src/rasterchunk.h"
 #include "src/rastercoordtransformer.h"
 #include "src/resampler.h"
 #include "src/std_int.h"
@@ -32,30 +34,6 @@ namespace librasterblaster {
 int simplerandom(int i);
 /** \cond DOXYHIDE **/
 
-#define GEN_RESAMPLER_CASES(C_PIXEL_TYPE)   \
-        switch (resampler) {               \
-        case MIN: \
-          return ReprojectChunkType<C_PIXEL_TYPE>(source, \
-                                                   destination, \
-                                                   static_cast<C_PIXEL_TYPE>(fvalue), \
-                                                   &(Min<C_PIXEL_TYPE>)); \
-          break; \
-        case MAX: \
-          return ReprojectChunkType<C_PIXEL_TYPE>(source, \
-                                                   destination, \
-                                                   static_cast<C_PIXEL_TYPE>(fvalue), \
-                                                   &(Max<C_PIXEL_TYPE>)); \
-          break; \
-    case NEAREST: \
-    default: \
-          return ReprojectChunkType<C_PIXEL_TYPE>(source, \
-                                                   destination, \
-                                                   static_cast<C_PIXEL_TYPE>(fvalue), \
-                                                   NULL); \
-      } \
-      break; \
-
-
 /**
  * @brief Creates an output raster based on a input and a new projection
  * 
@@ -75,6 +53,23 @@ PRB_ERROR CreateOutputRaster(GDALDataset *in,
                              string output_filename,
                              string output_srs,
                              int output_tile_size);
+/**
+ * @brief Computes the grid of the output raster that CreateOutputRaster
+ * creates, without creating it.
+ *
+ * @param in The GDALDataset that represents the input file.
+ * @param output_srs String with a projection specification (WKT, proj4, EPSG) suitable for
+ *        OGRSpatialReference->SetFromUserInput()
+ * @param output_columns Receives the number of columns of the output raster
+ * @param output_rows Receives the number of rows of the output raster
+ * @param output_geotransform Receives the six GDAL geotransform coefficients
+ *        of the output raster
+ */
+PRB_ERROR OutputRasterGeometry(GDALDataset *in,
+                               string output_srs,
+                               int64_t *output_columns,
+                               int64_t *output_rows,
+                               double *output_geotransform);
 /**
  * @brief Creates an output raster based on an input raster, a new projection,
  * and a maximum pixel dimension. This is to be used when the dimensions of the
@@ -106,10 +101,102 @@ bool partition_compare(Area a, Area b);
 /** \endcond **/
 std::vector<Area> BlockPartition(int rank,
                                  int process_count,
-                                 int row_count,
-                                 int column_count,
+                                 int64_t row_count,
+                                 int64_t column_count,
                                  int tile_size,
                                  int partition_size);
+
+/**
+ * @brief Returns the indices, in raster order, of the tiles of a raster in
+ * the order in which BlockPartition hands them to the processes: by process,
+ * then by partition, then in raster order within each partition.
+ *
+ * The parameters are those of BlockPartition, without the rank.
+ */
+std::vector<int64_t> PartitionTileOrder(int process_count,
+                                        int64_t row_count,
+                                        int64_t column_count,
+                                        int tile_size,
+                                        int partition_size);
+
+/// A partition size chosen to fit a memory budget
+struct PartitionPlan {
+  /// Partition size, in tiles, to pass to BlockPartition
+  int partition_size;
+  /// Partition width, in tiles
+  int partition_width;
+  /// Partition height, in tiles
+  int partition_height;
+  /// Number of partitions of the output raster
+  int64_t partition_count;
+  /// Largest input chunk, in bytes
+  int64_t input_bytes;
+  /// Largest set of output chunks, in bytes
+  int64_t output_bytes;
+  /// Largest working set of a partition, in bytes, including pool size
+  /// classes and the nearest-neighbor index map
+  int64_t peak_bytes;
+  /// False if even single-tile partitions exceed the budget
+  bool fits;
+};
+
+/**
+ * @brief PlanPartitions chooses the largest partition size whose working set
+ *        fits in memory_budget bytes.
+ *
+ * Candidate partition sizes are powers of two, laid out as BlockPartition
+ * lays them out. The input chunk of each partition is estimated from the
+ * source minboxes of its tiles, so the partitions near poles and other
+ * distorted areas determine the plan. Partition sizes that would leave some
+ * of the process_count processes without a partition are not considered.
+ *
+ * @param tile_minboxes RasterMinbox of every output tile, row by row
+ * @param row_count Number of rows of the output raster
+ * @param column_count Number of columns of the output raster
+ * @param tile_size Size of the output tiles, in pixels
+ * @param process_count Number of processes that share the partitions
+ * @param band_count Number of bands of the rasters
+ * @param pixel_type Pixel type of the rasters
+ * @param output_count Number of output chunks per partition, one per
+ *        resampler
+ * @param index_map True if the nearest-neighbor index map is used
+ * @param row_alignment Row alignment of the chunks, see CreateRasterChunk
+ * @param memory_budget Bytes available to each process
+ *
+ */
+PartitionPlan PlanPartitions(const std::vector<Area> &tile_minboxes,
+                             int64_t row_count,
+                             int64_t column_count,
+                             int tile_size,
+                             int process_count,
+                             int band_count,
+                             GDALDataType pixel_type,
+                             int output_count,
+                             bool index_map,
+                             int row_alignment,
+                             int64_t memory_budget);
+
+/**
+ * @brief TileMinboxUnion returns the source minbox of an area of whole output
+ *        tiles from the minboxes of the tiles, without transforming a pixel.
+ *
+ * It holds the source pixels that RasterMinbox finds for the area, so the
+ * tile minboxes computed for PlanPartitions also give the input chunk of
+ * each partition.
+ *
+ * @param tile_minboxes RasterMinbox of every output tile, row by row
+ * @param column_count Number of columns of the output raster
+ * @param tile_size Size of the output tiles, in pixels
+ * @param area Inclusive area, in output raster coordinates, e.g. a partition
+ *        from BlockPartition
+ *
+ * @return Returns an area with ul.x of -1 if no tile of area has source
+ *         pixels, like RasterMinbox.
+ */
+Area TileMinboxUnion(const std::vector<Area> &tile_minboxes,
+                     int64_t column_count,
+                     int tile_size,
+                     Area area);
 /** \cond DOXYHIDE **/
 void SearchAndUpdate(Area input_area,
                      string input_srs,
@@ -122,8 +209,8 @@ void SearchAndUpdate(Area input_area,
 Area ProjectedMinbox(Coordinate input_ul_corner,
                      string input_srs,
                      double input_pixel_size,
-                     int input_row_count,
-                     int input_column_count,
+                     int64_t input_row_count,
+                     int64_t input_column_count,
                      string output_srs);
 /**
  * @brief RasterMinbox finds the equivalent minbox in the source raster of the
@@ -133,23 +220,54 @@ Area ProjectedMinbox(Coordinate input_ul_corner,
  * @param destination Dataset which you are providing an area for
  * @param destination_raster_area Area in destination that you want mapped 
  *        to a minbox in source
+ * @param residency If not NULL, receives the blocks of the minbox that the
+ *        pixel footprints touch. Its block size must be set by the caller.
  *
  */
 Area RasterMinbox(GDALDataset *source,
                   GDALDataset *destination,
-                  Area destination_raster_area);
+                  Area destination_raster_area,
+                  BlockResidency *residency = NULL);
+
+/**
+ * @brief RasterMinbox finds the minbox between two described rasters, like
+ *        the function above.
+ */
+Area RasterMinbox(const RasterDescriptor &source,
+                  const RasterDescriptor &destination,
+                  Area destination_raster_area,
+                  BlockResidency *residency = NULL);
 
 Area RasterMinbox2(string source_projection,
                   Coordinate source_ul,
                   double source_pixel_size,
-                  int source_row_count,
-                  int source_column_count,
+                  int64_t source_row_count,
+                  int64_t source_column_count,
                   string destination_projection,
                   Coordinate destination_ul,
                   double destination_pixel_size,
-                  int destination_row_count,
-                  int destination_column_count,
-                  Area destination_raster_area);
+                  int64_t destination_row_count,
+                  int64_t destination_column_count,
+                  Area destination_raster_area,
+                  BlockResidency *residency = NULL);
+
+/**
+ * @brief RasterMinbox finds the minbox with a transformer that was already
+ *        built for the two rasters, see RasterMinbox2.
+ *
+ * @param transformer Transformer from the raster that area is given in to
+ *        the raster that the minbox is in, anchored at their upper-left
+ *        corners
+ * @param destination_row_count Row count of the raster of the minbox
+ * @param destination_column_count Column count of the raster of the minbox
+ * @param destination_raster_area Area to find a minbox for
+ * @param residency As in RasterMinbox
+ */
+Area RasterMinbox(RasterCoordTransformer *transformer,
+                  int64_t destination_row_count,
+                  int64_t destination_column_count,
+                  Area destination_raster_area,
+                  BlockResidency *residency = NULL);
 /**
  * \brief This function takes two RasterChunk pointers and performs
  *        reprojection and resampling
@@ -157,6 +275,12 @@ Area RasterMinbox2(string source_projection,
  * \param destination Pointer to the RasterChunk to reproject to
  * \param fillvalue std::string that will be interpreted to be the fill value
  * \param resampler The resampler that should be used
+ * \param thread_count Number of threads. Each thread reprojects a band of
+ *        rows of destination.
+ * \param transformer If not NULL, a transformer from the raster grid of
+ *        destination to the raster grid of source, which is used instead of
+ *        building one from the projection strings. It is moved to the
+ *        corners of the chunks. Only used when thread_count is 1.
  *
  * @return Returns a bool indicating success or failure.
  */
@@ -164,86 +288,353 @@ Area RasterMinbox2(string source_projection,
 bool ReprojectChunk(RasterChunk *source,
                     RasterChunk *destination,
                     string fillvalue,
-                    RESAMPLER resampler);
+                    RESAMPLER resampler,
+                    int thread_count = 1,
+                    RasterCoordTransformer *transformer = NULL);
+
+/**
+ * \brief ReprojectChunkMulti evaluates several resamplers over a single
+ *        traversal of the output pixel footprints.
+ *
+ * The coordinate transform and the walk over the footprint of each output
+ * pixel are done once; each resampler only adds its reduction. This is
+ * equivalent to calling ReprojectChunk once per resampler.
+ *
+ * \param source Pointer to the RasterChunk to reproject from
+ * \param destinations One RasterChunk per resampler, all with the same
+ *        location, size, type and band count
+ * \param fillvalue std::string that will be interpreted to be the fill value
+ * \param resamplers The resamplers to evaluate, destinations[i] receives the
+ *        result of resamplers[i]
+ * \param thread_count Number of threads, as in ReprojectChunk
+ *
+ * @return Returns a bool indicating success or failure.
+ */
+bool ReprojectChunkMulti(RasterChunk *source,
+                         const std::vector<RasterChunk*> &destinations,
+                         string fillvalue,
+                         const std::vector<RESAMPLER> &resamplers,
+                         int thread_count = 1);
+
+/**
+ * \brief ComputeSourceIndexMap performs the transform phase of nearest-neighbor
+ *        reprojection without moving any pixel values.
+ *
+ * For every pixel of destination, index_map receives the index, in pixels
+ * counted along padded source rows, of the source pixel it takes its value
+ * from, or kFillIndex when it is outside of the projected area. The map only
+ * depends on the geometry of the two chunks, so it can be reused for every
+ * band and for every input that shares the grid of source.
+ *
+ * \param source Pointer to the RasterChunk to reproject from
+ * \param destination Pointer to the RasterChunk to reproject to
+ * \param index_map Vector that is resized and filled with the map
+ * \param transformer Optional transformer, as in ReprojectChunk
+ *
+ * @return Returns false if source has too many pixels to be indexed by an
+ *         int32_t, or if its row stride is not a whole number of pixels.
+ */
+bool ComputeSourceIndexMap(RasterChunk *source,
+                           RasterChunk *destination,
+                           std::vector<int32_t> *index_map,
+                           RasterCoordTransformer *transformer = NULL);
+
+/**
+ * \brief ApplySourceIndexMap fills destination with the source pixels
+ *        selected by index_map, see ComputeSourceIndexMap.
+ *
+ * \param source Pointer to the RasterChunk to copy pixels from
+ * \param destination Pointer to the RasterChunk to copy pixels to
+ * \param index_map Map computed for chunks with the geometry of source and
+ *        destination
+ * \param fillvalue std::string that will be interpreted to be the fill value
+ *
+ * @return Returns a bool indicating success or failure.
+ */
+bool ApplySourceIndexMap(RasterChunk *source,
+                         RasterChunk *destination,
+                         const std::vector<int32_t> &index_map,
+                         string fillvalue);
+
+/**
+ * \brief DownsampleChunk fills destination, a chunk of a grid of half the
+ *        resolution of the grid of source, e.g. an overview.
+ *
+ * Each destination pixel reduces the up to 2 by 2 source pixels it covers,
+ * fewer at the right and bottom edges of the raster. Pixels that only hold
+ * the fill value are left out and destination pixels that cover no other
+ * pixel get it. Of the remaining pixels, in row order, NEAREST keeps the
+ * first one, MIN and MAX the smallest and largest value of each band, COUNT
+ * sums them and MEAN averages them, truncated to integer types like the
+ * reprojection kernels, so that every overview level of a statistic holds
+ * the same statistic.
+ *
+ * \param source Pointer to the RasterChunk to downsample
+ * \param destination Pointer to the RasterChunk to fill, its raster location
+ *        is in the grid of half the resolution
+ * \param resampler The statistic of the pixels of source
+ * \param fillvalue std::string that will be interpreted to be the fill value
+ *
+ * @return Returns false if the chunks have different pixel types or band
+ *         counts or if source does not hold the upper-left pixel covered by
+ *         every destination pixel.
+ */
+bool DownsampleChunk(RasterChunk *source,
+                     RasterChunk *destination,
+                     RESAMPLER resampler,
+                     string fillvalue);
+
+/**
+ * \brief AreaIsFill returns true if every sample of an area of chunk holds
+ *        the fill value, e.g. because the area lies outside of the
+ *        projected globe.
+ *
+ * The rows of the area are compared with memcmp against a row of fill
+ * values, so the scan runs at memory speed and areas with data are
+ * rejected at their first pixel that is not fill.
+ *
+ * \param chunk Pointer to the RasterChunk to scan
+ * \param area Inclusive area, in raster coordinates, within chunk
+ * \param fillvalue std::string that will be interpreted to be the fill value
+ *
+ * @return Returns false if the area is not entirely within chunk.
+ */
+bool AreaIsFill(RasterChunk *chunk, Area area, string fillvalue);
 /** @cond DOXYHIDE **/
-template <class pixelType>
-bool ReprojectChunkType(RasterChunk *source,
-                        RasterChunk *destination,
-                        pixelType fillvalue,
-                        pixelType (*resampler)(RasterChunk*,
-                                               Area)) {
-  Coordinate temp1, temp2;
-  std::vector<char> inraster, outraster;
+/**
+ * SourceFootprint maps the output pixel (chunk_x, chunk_y) of destination to
+ * the area of source it covers, clamped to source. It returns false when the
+ * pixel is outside of the projected area and should get the fill value.
+ */
+inline bool SourceFootprint(RasterCoordTransformer *rt,
+                            const RasterChunk *source,
+                            int64_t chunk_x,
+                            int64_t chunk_y,
+                            Area *footprint) {
+  Coordinate temp1(chunk_x, chunk_y, UNDEF);
+  Area pixelArea = rt->Transform(temp1);
 
+  if (pixelArea.ul.x == -1.0 || (pixelArea.ul.x > source->column_count_ - 1)
+      || (pixelArea.lr.y > source->row_count_ - 1)) {
+    // The pixel is outside of the projected area
+    return false;
+  }
 
-  Area pixelArea;
+  int64_t ul_x = static_cast<int64_t>(pixelArea.ul.x);
+  int64_t ul_y = static_cast<int64_t>(pixelArea.ul.y);
+  int64_t lr_x = static_cast<int64_t>(pixelArea.lr.x);
+  int64_t lr_y = static_cast<int64_t>(pixelArea.lr.y);
 
-  RasterCoordTransformer rt(destination->projection_,
-                            destination->ul_projected_corner_,
-                            destination->pixel_size_,
-                            destination->row_count_,
-                            destination->column_count_,
-                            source->projection_,
-                            source->ul_projected_corner_,
-                            source->pixel_size_);
+  if (ul_x < 0) {
+    ul_x = 0;
+  }
 
+  if (ul_y < 0) {
+    ul_y = 0;
+  }
 
-  for (int chunk_y = 0; chunk_y < destination->row_count_; ++chunk_y)  {
-    for (int chunk_x = 0; chunk_x < destination->column_count_; ++chunk_x) {
-      temp1.x = chunk_x;
-      temp1.y = chunk_y;
+  if (lr_x > (source->column_count_ - 1)) {
+    lr_x = source->column_count_ - 1;
+  }
 
-      pixelArea = rt.Transform(temp1);
+  if (ul_y > (source->row_count_ - 1)) {
+    ul_y = source->row_count_ - 1;
+  }
 
-      if (pixelArea.ul.x == -1.0 || (pixelArea.ul.x > source->column_count_ - 1)
-          || (pixelArea.lr.y > source->row_count_ - 1)) {
-        // The pixel is outside of the projected area
-        reinterpret_cast<pixelType*>(destination->pixels_)
-            [chunk_x + chunk_y * destination->column_count_] = fillvalue;
-        continue;
-      }
+  *footprint = Area(ul_x, ul_y, lr_x, lr_y);
+  return true;
+}
 
-      temp1 = pixelArea.ul;
-      temp2 = pixelArea.lr;
+/**
+ * FootprintIsPoint returns true when a footprint from SourceFootprint does
+ * not enclose an area: it covers a single pixel, or clamping left its lower
+ * right corner above or to the left of its upper left one. Only the upper
+ * left pixel of such a footprint can be read.
+ */
+inline bool FootprintIsPoint(const Area &footprint) {
+  return (footprint.lr.x <= footprint.ul.x && footprint.lr.y <= footprint.ul.y)
+      || footprint.lr.x < footprint.ul.x || footprint.lr.y < footprint.ul.y;
+}
+
+/**
+ * ReprojectChunkType is the reprojection kernel. It is instantiated for every
+ * combination of pixel type, resampler policy and band count (see
+ * resampler.h) and selected at runtime by ReprojectChunk through a dispatch
+ * table, so the resampler is inlined into the pixel loop.
+ *
+ * pixelType is the type of one sample and samples_per_pixel the number of
+ * samples stored per pixel: the band count, or twice the band count for
+ * complex data whose real and imaginary parts are reduced as separate,
+ * interleaved samples. BandCount is samples_per_pixel when it is known at
+ * compile time, or 0 for the generic kernel. rt maps destination pixels to
+ * source pixels and must be anchored at the corners of the two chunks.
+ */
+template <class pixelType,
+          template <typename, int> class Resampler,
+          int BandCount>
+bool ReprojectChunkType(RasterChunk *source,
+                        RasterChunk *destination,
+                        int samples_per_pixel,
+                        double fvalue,
+                        RasterCoordTransformer *rt) {
+  typedef Resampler<pixelType, BandCount> Policy;
 
-      int64_t ul_x = static_cast<int64_t>(temp1.x);
-      int64_t ul_y = static_cast<int64_t>(temp1.y);
-      int64_t lr_x = static_cast<int64_t>(temp2.x);
-      int64_t lr_y = static_cast<int64_t>(temp2.y);
+  const pixelType fillvalue = static_cast<pixelType>(fvalue);
+  const int bands = BandCount > 0 ? BandCount : samples_per_pixel;
+  // Row strides are a whole number of pixels, so of samples too
+  const int64_t source_pitch = source->row_stride_
+      / static_cast<int64_t>(sizeof(pixelType));
+  const pixelType *source_pixels =
+      static_cast<const pixelType*>(source->pixels_);
+  // Scratch space for resamplers that accumulate per band
+  std::vector<double> accumulator(bands);
 
-      if (ul_x < 0) {
-        ul_x = 0;
+  for (int64_t chunk_y = 0; chunk_y < destination->row_count_; ++chunk_y)  {
+    for (int64_t chunk_x = 0; chunk_x < destination->column_count_;
+         ++chunk_x) {
+      // The footprint of each output pixel is computed once and then applied
+      // to every band.
+      pixelType *out = static_cast<pixelType*>(destination->Row(chunk_y))
+          + chunk_x * bands;
+      Area ia;
+      if (!SourceFootprint(rt, source, chunk_x, chunk_y, &ia)) {
+        for (int b = 0; b < bands; ++b) {
+          out[b] = fillvalue;
+        }
+        continue;
       }
 
-      if (ul_y < 0) {
-        ul_y = 0;
+      // Perform resampling...
+      if (!Policy::kReduces
+          || (Policy::kNearestForPoints && FootprintIsPoint(ia))) {
+        // ul/lr do not enclose an area, use NN
+        NearestResampler<pixelType, BandCount>::Reduce(source_pixels,
+                                                       source_pitch,
+                                                       bands,
+                                                       ia,
+                                                       out,
+                                                       NULL);
+        continue;
       }
 
-      if (lr_x > (source->column_count_ - 1)) {
-        lr_x = source->column_count_ - 1;
-      }
+      Policy::Reduce(source_pixels, source_pitch, bands, ia, out,
+                     &accumulator[0]);
+    }
+  }
 
-      if (ul_y > (source->row_count_ - 1)) {
-        ul_y = source->row_count_ - 1;
-      }
+  return true;
+}
 
-      // Perform resampling...
-      int64_t dest_offset = chunk_x + chunk_y * destination->column_count_;
-      int64_t src_offset = ul_x + ul_y * source->column_count_;
+/**
+ * ReprojectChunkFusedType is the kernel behind ReprojectChunkMulti. The
+ * footprint of each output pixel is visited once and its minimum, maximum and
+ * sum are gathered together, each destination then takes the statistic of its
+ * resampler. Points and rt are handled as in ReprojectChunkType.
+ */
+template <class pixelType, int BandCount>
+bool ReprojectChunkFusedType(RasterChunk *source,
+                             RasterChunk * const *destinations,
+                             const RESAMPLER *resamplers,
+                             int statistic_count,
+                             int samples_per_pixel,
+                             double fvalue,
+                             RasterCoordTransformer *rt) {
+  RasterChunk *destination = destinations[0];
+  const pixelType fillvalue = static_cast<pixelType>(fvalue);
+  const int bands = BandCount > 0 ? BandCount : samples_per_pixel;
+  // Row strides are a whole number of pixels, so of samples too
+  const int64_t source_pitch = source->row_stride_
+      / static_cast<int64_t>(sizeof(pixelType));
+  const pixelType *source_pixels =
+      static_cast<const pixelType*>(source->pixels_);
+  std::vector<pixelType> minimum(bands), maximum(bands);
+  std::vector<double> sum(bands);
 
-      if ((resampler == NULL) || ((ul_x <= lr_x) || (lr_y <= ul_x))) {
-        // ul/lr do not enclose an area, use NN
-        if (ul_x + 1 > source->column_count_ || ul_y + 1 > source->row_count_) {
-          // TODO(dmattli) FIX THIS
+  bool reduces = false;
+  for (int s = 0; s < statistic_count; ++s) {
+    if (resamplers[s] == MIN || resamplers[s] == MAX || resamplers[s] == MEAN) {
+      reduces = true;
+    }
+  }
+
+  for (int64_t chunk_y = 0; chunk_y < destination->row_count_; ++chunk_y)  {
+    for (int64_t chunk_x = 0; chunk_x < destination->column_count_;
+         ++chunk_x) {
+      const int64_t out_offset = chunk_x * bands;
+      Area ia;
+      if (!SourceFootprint(rt, source, chunk_x, chunk_y, &ia)) {
+        for (int s = 0; s < statistic_count; ++s) {
+          pixelType *out =
+              static_cast<pixelType*>(destinations[s]->Row(chunk_y))
+              + out_offset;
+          for (int b = 0; b < bands; ++b) {
+            out[b] = fillvalue;
+          }
         }
-            reinterpret_cast<pixelType*>(destination->pixels_)[dest_offset] =
-                reinterpret_cast<pixelType*>(source->pixels_)[src_offset];
         continue;
       }
 
-      Area ia = Area(ul_x, ul_y, lr_x, lr_y);
-      reinterpret_cast<pixelType*>(destination->pixels_)[dest_offset] =
-          resampler(source, ia);
+      const int64_t ul_x = ia.ul.x;
+      const int64_t lr_x = ia.lr.x;
+      const int64_t lr_y = ia.lr.y;
+      // ul/lr do not enclose an area, reducing resamplers use NN
+      const bool point = FootprintIsPoint(ia);
+      const pixelType *nearest = source_pixels
+          + static_cast<int64_t>(ia.ul.y) * source_pitch + ul_x * bands;
+
+      if (reduces && !point) {
+        for (int b = 0; b < bands; ++b) {
+          minimum[b] = maximum[b] = nearest[b];
+          sum[b] = 0.0;
+        }
+        for (int64_t y = ia.ul.y; y <= lr_y; ++y) {
+          const pixelType *row = source_pixels + y * source_pitch;
+          for (int64_t x = ul_x; x <= lr_x; ++x) {
+            const pixelType *pixel = row + x * bands;
+            for (int b = 0; b < bands; ++b) {
+              minimum[b] = pixel[b] < minimum[b] ? pixel[b] : minimum[b];
+              maximum[b] = pixel[b] > maximum[b] ? pixel[b] : maximum[b];
+              sum[b] += pixel[b];
+            }
+          }
+        }
+      }
+
+      const double count = FootprintPixelCount(ia);
+      for (int s = 0; s < statistic_count; ++s) {
+        pixelType *out =
+            static_cast<pixelType*>(destinations[s]->Row(chunk_y))
+            + out_offset;
+        switch (resamplers[s]) {
+          case COUNT:
+            for (int b = 0; b < bands; ++b) {
+              out[b] = SaturateCount<pixelType>(count);
+            }
+            break;
+          case MIN:
+            for (int b = 0; b < bands; ++b) {
+              out[b] = point ? nearest[b] : minimum[b];
+            }
+            break;
+          case MAX:
+            for (int b = 0; b < bands; ++b) {
+              out[b] = point ? nearest[b] : maximum[b];
+            }
+            break;
+          case MEAN:
+            for (int b = 0; b < bands; ++b) {
+              out[b] = point ? nearest[b]
+                  : static_cast<pixelType>(sum[b] / count);
+            }
+            break;
+          case NEAREST:
+          default:
+            for (int b = 0; b < bands; ++b) {
+              out[b] = nearest[b];
+            }
+            break;
+        }
+      }
     }
   }
 
@@ -0,0 +1,368 @@
+//
+// Copyright 0000 <Nobody>
+// @file
+// @author David Matthew Mattli <dmattli@usgs.gov>
+//
+// @section LICENSE
+//
+// This software is in the public domain, furnished "as is", without
+// technical support, and with no warranty, express or implied, as to
+// its usefulness for any purpose.
+//
+// @section DESCRIPTION
+//
+// The Reprojector class keeps the state needed to reproject between two
+// raster grids, so that many areas can be reprojected without setting it up
+// again.
+//
+//
+
+#include "src/reprojector.h"
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "src/reprojection_tools.h"
+
+namespace librasterblaster {
+Reprojector::Reprojector()
+    : input_(NULL), output_(NULL), input_chunk_(NULL), output_chunk_(NULL),
+      resampler_(NEAREST), tile_size_(256), tiles_across_(0), tasks_(NULL),
+      next_task_(0), finished_tasks_(0), tasks_failed_(false),
+      stopping_(false) {
+}
+
+Reprojector::~Reprojector() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  work_ready_.notify_all();
+  for (size_t i = 0; i < workers_.size(); ++i) {
+    workers_[i].join();
+  }
+  for (size_t i = 0; i < transformers_.size(); ++i) {
+    delete transformers_[i];
+  }
+}
+
+Reprojector *Reprojector::Create(GDALDataset *input,
+                                 GDALDataset *output,
+                                 RESAMPLER resampler,
+                                 std::string fillvalue,
+                                 int thread_count,
+                                 int tile_size) {
+  Grid grids[2];
+  GDALDataset *datasets[2] = { input, output };
+  for (int i = 0; i < 2; ++i) {
+    double gt[6];
+    datasets[i]->GetGeoTransform(gt);
+    grids[i].projection = datasets[i]->GetProjectionRef();
+    grids[i].ul = Coordinate(gt[0], gt[3], UNDEF);
+    grids[i].pixel_size = gt[1];
+    grids[i].row_count = datasets[i]->GetRasterYSize();
+    grids[i].column_count = datasets[i]->GetRasterXSize();
+    grids[i].band_count = datasets[i]->GetRasterCount();
+    grids[i].pixel_type = datasets[i]->GetRasterBand(1)->GetRasterDataType();
+  }
+
+  Reprojector *reprojector = new Reprojector;
+  reprojector->input_ = input;
+  reprojector->output_ = output;
+  reprojector->resampler_ = resampler;
+  reprojector->fillvalue_ = fillvalue;
+  reprojector->tile_size_ = std::max(tile_size, 1);
+  if (!reprojector->Init(grids[0], grids[1], thread_count)) {
+    delete reprojector;
+    return NULL;
+  }
+  return reprojector;
+}
+
+Reprojector *Reprojector::Create(RasterChunk *input,
+                                 RasterChunk *output,
+                                 RESAMPLER resampler,
+                                 std::string fillvalue,
+                                 int thread_count,
+                                 int tile_size) {
+  Grid grids[2];
+  RasterChunk *chunks[2] = { input, output };
+  for (int i = 0; i < 2; ++i) {
+    if (chunks[i]->raster_location_.x != 0.0
+        || chunks[i]->raster_location_.y != 0.0) {
+      fprintf(stderr, "Reprojector needs chunks holding whole grids!\n");
+      return NULL;
+    }
+    grids[i].projection = chunks[i]->projection_;
+    grids[i].ul = chunks[i]->ul_projected_corner_;
+    grids[i].pixel_size = chunks[i]->pixel_size_;
+    grids[i].row_count = chunks[i]->row_count_;
+    grids[i].column_count = chunks[i]->column_count_;
+    grids[i].band_count = chunks[i]->band_count_;
+    grids[i].pixel_type = chunks[i]->pixel_type_;
+  }
+
+  Reprojector *reprojector = new Reprojector;
+  reprojector->input_chunk_ = input;
+  reprojector->output_chunk_ = output;
+  reprojector->resampler_ = resampler;
+  reprojector->fillvalue_ = fillvalue;
+  reprojector->tile_size_ = std::max(tile_size, 1);
+  if (!reprojector->Init(grids[0], grids[1], thread_count)) {
+    delete reprojector;
+    return NULL;
+  }
+  return reprojector;
+}
+
+bool Reprojector::Init(const Grid &input, const Grid &output,
+                       int thread_count) {
+  if (input.pixel_type != output.pixel_type
+      || input.band_count != output.band_count) {
+    fprintf(stderr,
+            "Input and output grids have different types or band counts!\n");
+    return false;
+  }
+  input_grid_ = input;
+  output_grid_ = output;
+
+  tiles_across_ = (output.column_count + tile_size_ - 1) / tile_size_;
+  const int64_t tiles_down = (output.row_count + tile_size_ - 1) / tile_size_;
+  tile_minboxes_.resize(tiles_across_ * tiles_down);
+  tile_known_.assign(tiles_across_ * tiles_down, false);
+
+  // The transformers map output pixels to input pixels, as in RasterMinbox
+  thread_count = std::max(thread_count, 1);
+  for (int t = 0; t < thread_count; ++t) {
+    transformers_.push_back(new RasterCoordTransformer(output.projection,
+                                                       output.ul,
+                                                       output.pixel_size,
+                                                       output.row_count,
+                                                       output.column_count,
+                                                       input.projection,
+                                                       input.ul,
+                                                       input.pixel_size));
+    if (!transformers_.back()->ready()) {
+      return false;
+    }
+  }
+
+  if (thread_count > 1) {
+    for (int t = 0; t < thread_count; ++t) {
+      workers_.push_back(std::thread(&Reprojector::WorkerLoop, this, t));
+    }
+  }
+  return true;
+}
+
+Area Reprojector::Minbox(Area output_area) {
+  Area minbox(-1.0, -1.0, -1.0, -1.0);
+  bool found = false;
+  RasterCoordTransformer *rt = transformers_[0];
+  const int64_t first_x = static_cast<int64_t>(output_area.ul.x) / tile_size_;
+  const int64_t first_y = static_cast<int64_t>(output_area.ul.y) / tile_size_;
+  const int64_t last_x = static_cast<int64_t>(output_area.lr.x) / tile_size_;
+  const int64_t last_y = static_cast<int64_t>(output_area.lr.y) / tile_size_;
+
+  for (int64_t ty = first_y; ty <= last_y; ++ty) {
+    for (int64_t tx = first_x; tx <= last_x; ++tx) {
+      const int64_t tile = ty * tiles_across_ + tx;
+      if (!tile_known_[tile]) {
+        Area tile_area(tx * tile_size_, ty * tile_size_,
+                       std::min((tx + 1) * tile_size_,
+                                output_grid_.column_count) - 1,
+                       std::min((ty + 1) * tile_size_,
+                                output_grid_.row_count) - 1);
+        // The kernels move the transformer, the table uses the grid corners
+        rt->SetCorners(output_grid_.ul, input_grid_.ul);
+        tile_minboxes_[tile] = RasterMinbox(rt,
+                                            input_grid_.row_count,
+                                            input_grid_.column_count,
+                                            tile_area);
+        tile_known_[tile] = true;
+      }
+
+      const Area &box = tile_minboxes_[tile];
+      if (box.ul.x == -1.0) {
+        continue;
+      }
+      if (!found) {
+        minbox = box;
+        found = true;
+        continue;
+      }
+      minbox.ul.x = std::min(minbox.ul.x, box.ul.x);
+      minbox.ul.y = std::min(minbox.ul.y, box.ul.y);
+      minbox.lr.x = std::max(minbox.lr.x, box.lr.x);
+      minbox.lr.y = std::max(minbox.lr.y, box.lr.y);
+    }
+  }
+
+  return minbox;
+}
+
+RasterChunk *Reprojector::SourceChunk(Area minbox) {
+  if (input_chunk_ != NULL) {
+    if (minbox.ul.x == -1.0) {
+      // Every output pixel gets the fill value, any input pixel will do
+      minbox = Area(0, 0, 0, 0);
+    }
+    return new RasterChunk(input_chunk_->Subchunk(minbox));
+  }
+
+  RasterChunk *source = RasterChunk::CreateRasterChunk(input_, minbox, false);
+  if (source == NULL) {
+    return NULL;
+  }
+  if (RasterChunk::ReadRasterChunk(input_, source) != PRB_NOERROR) {
+    delete source;
+    return NULL;
+  }
+  return source;
+}
+
+bool Reprojector::Reproject(RasterChunk *destination) {
+  const int64_t ul_x = static_cast<int64_t>(destination->raster_location_.x);
+  const int64_t ul_y = static_cast<int64_t>(destination->raster_location_.y);
+  if (ul_x < 0 || ul_y < 0 || destination->row_count_ <= 0
+      || destination->column_count_ <= 0
+      || ul_x + destination->column_count_ > output_grid_.column_count
+      || ul_y + destination->row_count_ > output_grid_.row_count
+      || destination->pixel_size_ != output_grid_.pixel_size) {
+    fprintf(stderr, "Chunk is not part of the output grid!\n");
+    return false;
+  }
+
+  RasterChunk *source = SourceChunk(
+      Minbox(Area(ul_x, ul_y, ul_x + destination->column_count_ - 1,
+                  ul_y + destination->row_count_ - 1)));
+  if (source == NULL) {
+    fprintf(stderr, "Error reading input chunk!\n");
+    return false;
+  }
+
+  bool ok = true;
+  const int64_t row_bands = std::min<int64_t>(workers_.size(),
+                                              destination->row_count_);
+  if (row_bands <= 1) {
+    ok = ReprojectChunk(source, destination, fillvalue_, resampler_, 1,
+                        transformers_[0]);
+  } else {
+    // Each worker reprojects a band of rows with its own transformer
+    std::vector<RasterChunk> bands;
+    std::vector<std::function<bool(int)> > tasks;
+    bands.reserve(row_bands);
+    for (int64_t b = 0; b < row_bands; ++b) {
+      const int64_t first_row = destination->row_count_ * b / row_bands;
+      const int64_t last_row = destination->row_count_ * (b + 1) / row_bands;
+      bands.push_back(destination->Subchunk(
+          Area(0, first_row, destination->column_count_ - 1, last_row - 1)));
+    }
+    for (int64_t b = 0; b < row_bands; ++b) {
+      RasterChunk *band = &bands[b];
+      tasks.push_back([this, source, band](int worker) {
+        return ReprojectChunk(source, band, fillvalue_, resampler_, 1,
+                              transformers_[worker]);
+      });
+    }
+    ok = RunTasks(tasks);
+  }
+
+  delete source;
+  return ok;
+}
+
+RasterChunk *Reprojector::Reproject(Area output_area) {
+  if (output_area.ul.x < 0 || output_area.ul.y < 0
+      || output_area.lr.x < output_area.ul.x
+      || output_area.lr.y < output_area.ul.y
+      || output_area.lr.x > output_grid_.column_count - 1
+      || output_area.lr.y > output_grid_.row_count - 1) {
+    fprintf(stderr, "Area is outside of the output grid!\n");
+    return NULL;
+  }
+
+  RasterChunk *destination = NULL;
+  if (output_chunk_ != NULL) {
+    destination = new RasterChunk(output_chunk_->Subchunk(output_area));
+  } else {
+    destination = RasterChunk::CreateRasterChunk(output_, output_area, false);
+  }
+  if (destination == NULL) {
+    return NULL;
+  }
+
+  if (!Reproject(destination)) {
+    delete destination;
+    return NULL;
+  }
+  return destination;
+}
+
+bool Reprojector::Reproject() {
+  if (output_chunk_ != NULL) {
+    return Reproject(output_chunk_);
+  }
+
+  for (int64_t y = 0; y < output_grid_.row_count; y += tile_size_) {
+    for (int64_t x = 0; x < output_grid_.column_count; x += tile_size_) {
+      Area tile(x, y,
+                std::min(x + tile_size_, output_grid_.column_count) - 1,
+                std::min(y + tile_size_, output_grid_.row_count) - 1);
+      RasterChunk *chunk = Reproject(tile);
+      if (chunk == NULL) {
+        return false;
+      }
+      PRB_ERROR err = RasterChunk::WriteRasterChunk(output_, chunk);
+      delete chunk;
+      if (err != PRB_NOERROR) {
+        fprintf(stderr, "Error writing output chunk!\n");
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+bool Reprojector::RunTasks(
+    const std::vector<std::function<bool(int)> > &tasks) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  tasks_ = &tasks;
+  next_task_ = 0;
+  finished_tasks_ = 0;
+  tasks_failed_ = false;
+  work_ready_.notify_all();
+  work_done_.wait(lock, [this]() {
+    return finished_tasks_ == tasks_->size();
+  });
+  tasks_ = NULL;
+  return !tasks_failed_;
+}
+
+void Reprojector::WorkerLoop(int worker) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (;;) {
+    work_ready_.wait(lock, [this]() {
+      return stopping_ || (tasks_ != NULL && next_task_ < tasks_->size());
+    });
+    if (stopping_) {
+      return;
+    }
+
+    const std::function<bool(int)> &task = (*tasks_)[next_task_++];
+    lock.unlock();
+    const bool ok = task(worker);
+    lock.lock();
+
+    if (!ok) {
+      tasks_failed_ = true;
+    }
+    if (++finished_tasks_ == tasks_->size()) {
+      work_done_.notify_one();
+    }
+  }
+}
+}
@@ -0,0 +1,189 @@
+//
+// Copyright 0000 <Nobody>
+// @file
+// @author David Matthew Mattli <dmattli@usgs.gov>
+//
+// @section LICENSE
+//
+// This software is in the public domain, furnished "as is", without
+// technical support, and with no warranty, express or implied, as to
+// its usefulness for any purpose.
+//
+// @section DESCRIPTION
+//
+// The Reprojector class keeps the state needed to reproject between two
+// raster grids, so that many areas can be reprojected without setting it up
+// again.
+//
+//
+
+#ifndef SRC_REPROJECTOR_H_
+#define SRC_REPROJECTOR_H_
+
+#include <gdal_priv.h>
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "src/rasterchunk.h"
+#include "src/rastercoordtransformer.h"
+#include "src/resampler.h"
+#include "src/std_int.h"
+#include "src/utils.h"
+
+namespace librasterblaster {
+/// A reprojection session between an input and an output raster grid
+/**
+ * A Reprojector is created once for an input grid, an output grid and a
+ * resampler. It parses the projections once and keeps one
+ * RasterCoordTransformer per thread, a table of the input minboxes of the
+ * output tiles, which is filled as tiles are first used, and a pool of
+ * worker threads. Each call then only reads the input pixels and runs the
+ * kernels. Chunk buffers are recycled through the ChunkBufferPool.
+ *
+ * The grids are either GDAL datasets or whole-grid RasterChunks, such as the
+ * caller-owned arrays of RasterChunk::CreateRasterChunk(void*, ...). The
+ * datasets or chunks must outlive the Reprojector. Calls on one Reprojector
+ * must not overlap.
+ */
+class Reprojector {
+ public:
+  /**
+   * @brief Creates a session that reads from the input dataset.
+   *
+   * @param input Dataset to reproject from
+   * @param output Dataset whose grid is reprojected to. Reproject() writes
+   *        to it, the other calls only use its grid.
+   * @param resampler The resampler that should be used
+   * @param fillvalue std::string that will be interpreted to be the fill value
+   * @param thread_count Number of threads used for each call
+   * @param tile_size Width and height of the output tiles that minboxes are
+   *        cached for. The input read for an area covers the minboxes of
+   *        every tile it overlaps.
+   *
+   * @return Returns NULL if the datasets have different pixel types or band
+   *         counts.
+   */
+  static Reprojector *Create(GDALDataset *input,
+                             GDALDataset *output,
+                             RESAMPLER resampler,
+                             std::string fillvalue,
+                             int thread_count = 1,
+                             int tile_size = 256);
+
+  /**
+   * @brief Creates a session between two in-memory grids.
+   *
+   * @param input Chunk holding the whole input grid
+   * @param output Chunk holding the whole output grid
+   *
+   * The other parameters are as above. Returns NULL if the chunks have
+   * different pixel types or band counts or do not start at raster location
+   * (0, 0).
+   */
+  static Reprojector *Create(RasterChunk *input,
+                             RasterChunk *output,
+                             RESAMPLER resampler,
+                             std::string fillvalue,
+                             int thread_count = 1,
+                             int tile_size = 256);
+
+  /// Reprojector destructor, stops the worker threads
+  ~Reprojector();
+
+  /**
+   * @brief Reprojects the area covered by destination, a chunk of the output
+   * grid, into destination.
+   *
+   * @return Returns false if the input can not be read or the chunk does not
+   *         match the output grid.
+   */
+  bool Reproject(RasterChunk *destination);
+
+  /**
+   * @brief Reprojects an inclusive area of the output grid, in raster
+   * coordinates, into a new chunk. For an in-memory output grid the chunk
+   * refers to the pixels of the output grid.
+   *
+   * @return Returns NULL on error, otherwise a chunk to be deleted by the
+   *         caller.
+   */
+  RasterChunk *Reproject(Area output_area);
+
+  /**
+   * @brief Reprojects the whole output grid. Output datasets are written tile
+   * by tile.
+   *
+   * @return Returns false on error.
+   */
+  bool Reproject();
+
+  /// Number of rows of the output grid
+  int64_t row_count() const { return output_grid_.row_count; }
+  /// Number of columns of the output grid
+  int64_t column_count() const { return output_grid_.column_count; }
+
+ private:
+  /// The geometry of a raster grid
+  struct Grid {
+    std::string projection;
+    Coordinate ul;
+    double pixel_size;
+    int64_t row_count;
+    int64_t column_count;
+    int band_count;
+    GDALDataType pixel_type;
+  };
+
+  Reprojector();
+  Reprojector(const Reprojector&);
+  Reprojector& operator=(const Reprojector&);
+
+  /// Builds the transformers and the worker threads, false on error
+  bool Init(const Grid &input, const Grid &output, int thread_count);
+
+  /// Returns the input minbox of the inclusive output area, from the table
+  Area Minbox(Area output_area);
+
+  /// Returns the input pixels of minbox, NULL on error
+  RasterChunk *SourceChunk(Area minbox);
+
+  /// Runs the tasks on the workers, each called with its worker index
+  bool RunTasks(const std::vector<std::function<bool(int)> > &tasks);
+  void WorkerLoop(int worker);
+
+  GDALDataset *input_;
+  GDALDataset *output_;
+  RasterChunk *input_chunk_;
+  RasterChunk *output_chunk_;
+  Grid input_grid_;
+  Grid output_grid_;
+  RESAMPLER resampler_;
+  std::string fillvalue_;
+  int tile_size_;
+
+  /// One transformer from output to input pixels per worker
+  std::vector<RasterCoordTransformer*> transformers_;
+
+  /// Input minbox of each output tile, valid where tile_known_ is set
+  int64_t tiles_across_;
+  std::vector<Area> tile_minboxes_;
+  std::vector<bool> tile_known_;
+
+  std::vector<std::thread> workers_;
+  std::mutex mutex_;
+  std::condition_variable work_ready_;
+  std::condition_variable work_done_;
+  const std::vector<std::function<bool(int)> > *tasks_;
+  size_t next_task_;
+  size_t finished_tasks_;
+  bool tasks_failed_;
+  bool stopping_;
+};
+}
+
+#endif  // SRC_REPROJECTOR_H_
@@ -20,7 +20,10 @@
 
 #include <gdal.h>
 
+#include <limits>
+
 #include "src/rasterchunk.h"
+#include "src/std_int.h"
 #include "src/utils.h"
 
 namespace librasterblaster {
@@ -33,67 +36,197 @@ enum RESAMPLER {
   MIN,     /** @brief Minimum value */
   MAX,     /** @brief Maximum value */
   MEAN,    /** @brief Arithmetic mean */
+  COUNT,   /** @brief Number of input pixels covered */
 };
 
+/**
+ * @brief Returns the lower-case name of resampler, as accepted by the -r
+ * command-line option.
+ */
+inline const char *ResamplerName(RESAMPLER resampler) {
+  switch (resampler) {
+    case MIN:
+      return "min";
+    case MAX:
+      return "max";
+    case MEAN:
+      return "mean";
+    case COUNT:
+      return "count";
+    case NEAREST:
+    default:
+      return "nearest";
+  }
+}
+
 /** @cond DOXYHIDE */
+// The resamplers below are policies for ReprojectChunkType. They operate on
+// pixel-interleaved chunks: the band values of a pixel are stored next to each
+// other. Reduce() reduces every band of the footprint pixel_area at once and
+// writes one value per band to out. row_pitch is the distance, in values,
+// between the starts of two rows of pixels.
+//
+// BandCount is the number of bands known at compile time, or 0 when it is only
+// known at runtime (bands). Keeping the band loop innermost with a constant
+// trip count lets the compiler unroll and vectorize it.
+//
+// kReduces is false for resamplers that only look at the upper-left pixel of
+// the footprint. kNearestForPoints is true for resamplers that fall back to
+// nearest-neighbor when the footprint does not enclose an area.
 template <typename T>
-T Max(RasterChunk *input,
-      Area pixel_area) {
-  T *pixels = static_cast<T*>(input->pixels_);
-  T temp = pixels[static_cast<int>(pixel_area.ul.y)
-                  * input->column_count_
-                  + static_cast<int>(pixel_area.ul.x)];
-  T temp2 = 0;
-  for (int x = pixel_area.ul.x; x <= pixel_area.lr.x; ++x) {
-    for (int y = pixel_area.ul.y; y <= pixel_area.lr.y; ++y) {
-      temp2 = pixels[y * input->column_count_  + x];
-
-      if (temp2 > temp) {
-        temp = temp2;
+inline T SaturateCount(double count) {
+  const double maximum = static_cast<double>(std::numeric_limits<T>::max());
+  return static_cast<T>(count < maximum ? count : maximum);
+}
+
+// Number of input pixels in a footprint. A footprint that clamping inverted
+// still reads its upper-left pixel and counts as that one pixel, so the count
+// is never below 1.
+inline double FootprintPixelCount(const Area &pixel_area) {
+  const double columns = pixel_area.lr.x - pixel_area.ul.x + 1;
+  const double rows = pixel_area.lr.y - pixel_area.ul.y + 1;
+  return columns < 1 || rows < 1 ? 1.0 : columns * rows;
+}
+
+template <typename T, int BandCount>
+struct NearestResampler {
+  static const bool kReduces = false;
+  static const bool kNearestForPoints = true;
+
+  static inline void Reduce(const T *pixels,
+                            int64_t row_pitch,
+                            int bands,
+                            Area pixel_area,
+                            T *out,
+                            double *) {
+    const int n = BandCount > 0 ? BandCount : bands;
+    const T *pixel = pixels
+        + static_cast<int64_t>(pixel_area.ul.y) * row_pitch
+        + static_cast<int64_t>(pixel_area.ul.x) * n;
+    for (int b = 0; b < n; ++b) {
+      out[b] = pixel[b];
+    }
+  }
+};
+
+template <typename T, int BandCount>
+struct MaxResampler {
+  static const bool kReduces = true;
+  static const bool kNearestForPoints = true;
+
+  static inline void Reduce(const T *pixels,
+                            int64_t row_pitch,
+                            int bands,
+                            Area pixel_area,
+                            T *out,
+                            double *) {
+    const int n = BandCount > 0 ? BandCount : bands;
+    const int64_t ul_x = pixel_area.ul.x;
+    const int64_t lr_x = pixel_area.lr.x;
+    NearestResampler<T, BandCount>::Reduce(pixels, row_pitch, bands,
+                                           pixel_area, out, NULL);
+
+    for (int64_t y = pixel_area.ul.y; y <= pixel_area.lr.y; ++y) {
+      const T *row = pixels + y * row_pitch;
+      for (int64_t x = ul_x; x <= lr_x; ++x) {
+        const T *pixel = row + x * n;
+        for (int b = 0; b < n; ++b) {
+          out[b] = pixel[b] > out[b] ? pixel[b] : out[b];
+        }
       }
     }
   }
+};
 
-  return temp;
-}
+template <typename T, int BandCount>
+struct MinResampler {
+  static const bool kReduces = true;
+  static const bool kNearestForPoints = true;
 
-template <typename T>
-T Min(RasterChunk *input,
-      Area pixel_area) {
-  T *pixels = static_cast<T*>(input->pixels_);
-  T temp = pixels[static_cast<int>(pixel_area.ul.y)
-                  * input->column_count_
-                  + static_cast<int>(pixel_area.ul.x)];
-  T temp2 = 0;
-  for (int x = pixel_area.ul.x; x <= pixel_area.lr.x; ++x) {
-    for (int y = pixel_area.ul.y; y <= pixel_area.lr.y; ++y) {
-      temp2 = pixels[y * input->column_count_  + x];
-
-      if (temp2 < temp) {
-        temp = temp2;
+  static inline void Reduce(const T *pixels,
+                            int64_t row_pitch,
+                            int bands,
+                            Area pixel_area,
+                            T *out,
+                            double *) {
+    const int n = BandCount > 0 ? BandCount : bands;
+    const int64_t ul_x = pixel_area.ul.x;
+    const int64_t lr_x = pixel_area.lr.x;
+    NearestResampler<T, BandCount>::Reduce(pixels, row_pitch, bands,
+                                           pixel_area, out, NULL);
+
+    for (int64_t y = pixel_area.ul.y; y <= pixel_area.lr.y; ++y) {
+      const T *row = pixels + y * row_pitch;
+      for (int64_t x = ul_x; x <= lr_x; ++x) {
+        const T *pixel = row + x * n;
+        for (int b = 0; b < n; ++b) {
+          out[b] = pixel[b] < out[b] ? pixel[b] : out[b];
+        }
       }
     }
   }
+};
 
-  return temp;
-}
+// The sums are kept in double so that small integer types do not
+// overflow. When BandCount is 0 the caller provides scratch space for one
+// double per band in accumulator.
+template <typename T, int BandCount>
+struct MeanResampler {
+  static const bool kReduces = true;
+  static const bool kNearestForPoints = true;
 
-template <typename T>
-T Mean(RasterChunk *input,
-       Area pixel_area) {
-  T temp = 0;
-  T *pixels = static_cast<T*>(input->pixels_);
-  for (int x = pixel_area.ul.x; x <= pixel_area.lr.x; ++x) {
-    for (int y = pixel_area.ul.y; y <= pixel_area.lr.y; ++y) {
-      temp += pixels[y * input->column_count_ + x];
+  static inline void Reduce(const T *pixels,
+                            int64_t row_pitch,
+                            int bands,
+                            Area pixel_area,
+                            T *out,
+                            double *accumulator) {
+    const int n = BandCount > 0 ? BandCount : bands;
+    const int64_t ul_x = pixel_area.ul.x;
+    const int64_t lr_x = pixel_area.lr.x;
+    double local[BandCount > 0 ? BandCount : 1];
+    double *sums = BandCount > 0 ? local : accumulator;
+    for (int b = 0; b < n; ++b) {
+      sums[b] = 0.0;
+    }
+
+    for (int64_t y = pixel_area.ul.y; y <= pixel_area.lr.y; ++y) {
+      const T *row = pixels + y * row_pitch;
+      for (int64_t x = ul_x; x <= lr_x; ++x) {
+        const T *pixel = row + x * n;
+        for (int b = 0; b < n; ++b) {
+          sums[b] += pixel[b];
+        }
+      }
+    }
+
+    const double count = FootprintPixelCount(pixel_area);
+    for (int b = 0; b < n; ++b) {
+      out[b] = static_cast<T>(sums[b] / count);
     }
   }
+};
 
-  temp /= (pixel_area.lr.x - pixel_area.ul.x)
-      * (pixel_area.lr.y - pixel_area.ul.y);
+// Every band gets the number of input pixels in the footprint, saturated to
+// the range of T.
+template <typename T, int BandCount>
+struct CountResampler {
+  static const bool kReduces = true;
+  static const bool kNearestForPoints = false;
 
-  return temp;
-}
+  static inline void Reduce(const T *,
+                            int64_t,
+                            int bands,
+                            Area pixel_area,
+                            T *out,
+                            double *) {
+    const int n = BandCount > 0 ? BandCount : bands;
+    const T count = SaturateCount<T>(FootprintPixelCount(pixel_area));
+    for (int b = 0; b < n; ++b) {
+      out[b] = count;
+    }
+  }
+};
 
 template <typename T>
 T Median(Coordinate input_ul,
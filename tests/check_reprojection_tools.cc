@@ -17,15 +17,46 @@
 
 #include <gtest/gtest.h>
 
+#include <gdal_priv.h>
+#include <cpl_string.h>
+#include <ogr_spatialref.h>
+#include <mpi.h>
+#include <stdlib.h>
+#include <tiffio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <utility>
 #include <vector>
 
+#include "src/chunkpool.h"
+#include "src/gather.h"
+#include "src/mappedraster.h"
 #include "src/utils.h"
 #include "src/reprojection_tools.h"
+#include "src/reprojector.h"
+#include "src/demos/sptw.h"
 
 using librasterblaster::Area;
+using librasterblaster::ApplySourceIndexMap;
+using librasterblaster::AreaIsFill;
 using librasterblaster::BlockPartition;
+using librasterblaster::BlockResidency;
+using librasterblaster::ChunkBufferPool;
+using librasterblaster::ComputeSourceIndexMap;
+using librasterblaster::Coordinate;
+using librasterblaster::DownsampleChunk;
+using librasterblaster::GatherPixels;
+using librasterblaster::MappedRaster;
+using librasterblaster::RasterChunk;
+using librasterblaster::ReprojectChunk;
+using librasterblaster::Reprojector;
 using std::vector;
 
+#define STR_EXPAND(tok) #tok
+#define STR(tok) STR_EXPAND(tok)
+
 TEST(BlockPartition, SmallRasterManyProcesses) {
   const int process_count = 1000;
   const int64_t row_count = 180;
@@ -82,3 +113,1212 @@ TEST(BlockPartition, HugeRasterManyProcesses) {
   SUCCEED();
 }
 
+TEST(BlockPartition, GridBeyondInt32Pixels) {
+  // 8 * 10^10 pixels, far beyond 2^31
+  const int process_count = 16;
+  const int64_t row_count = 200000;
+  const int64_t column_count = 400000;
+  const int64_t tile_size = 4096;
+  const int64_t tiles_across = (column_count + tile_size - 1) / tile_size;
+  const int64_t tiles_down = (row_count + tile_size - 1) / tile_size;
+
+  int64_t tile_count = 0;
+  int64_t max_lr_x = 0, max_lr_y = 0;
+  for (int rank = 0; rank < process_count; ++rank) {
+    std::vector<Area> p = BlockPartition(rank, process_count, row_count,
+                                         column_count, tile_size, 1);
+    for (size_t i = 0; i < p.size(); ++i) {
+      ASSERT_LT(p[i].lr.x, column_count);
+      ASSERT_LT(p[i].lr.y, row_count);
+      max_lr_x = std::max(max_lr_x, static_cast<int64_t>(p[i].lr.x));
+      max_lr_y = std::max(max_lr_y, static_cast<int64_t>(p[i].lr.y));
+    }
+    tile_count += p.size();
+  }
+  ASSERT_EQ(tiles_across * tiles_down, tile_count);
+  ASSERT_EQ(column_count - 1, max_lr_x);
+  ASSERT_EQ(row_count - 1, max_lr_y);
+}
+
+TEST(BlockPartition, TileOrderFollowsProcesses) {
+  const int process_count = 3;
+  const int64_t row_count = 1000;
+  const int64_t column_count = 700;
+  const int tile_size = 64;
+  const int partition_size = 4;
+  const int64_t tiles_across = (column_count + tile_size - 1) / tile_size;
+
+  std::vector<int64_t> order = librasterblaster::PartitionTileOrder(
+      process_count, row_count, column_count, tile_size, partition_size);
+
+  // The tiles of each partition of each process, in turn
+  size_t next = 0;
+  for (int rank = 0; rank < process_count; ++rank) {
+    std::vector<Area> p = BlockPartition(rank, process_count, row_count,
+                                         column_count, tile_size,
+                                         partition_size);
+    for (size_t i = 0; i < p.size(); ++i) {
+      for (int64_t y = p[i].ul.y / tile_size; y <= p[i].lr.y / tile_size;
+           ++y) {
+        for (int64_t x = p[i].ul.x / tile_size; x <= p[i].lr.x / tile_size;
+             ++x) {
+          ASSERT_LT(next, order.size());
+          ASSERT_EQ(y * tiles_across + x, order[next]);
+          ++next;
+        }
+      }
+    }
+  }
+  ASSERT_EQ(order.size(), next);
+
+  std::sort(order.begin(), order.end());
+  for (size_t i = 0; i < order.size(); ++i) {
+    ASSERT_EQ(static_cast<int64_t>(i), order[i]);
+  }
+}
+
+namespace {
+// Creates a chunk of the given size and type in the geographic test grid,
+// rows are packed unless a row stride, in bytes, is given
+void InitTestChunk(RasterChunk *chunk,
+                   int rows,
+                   int columns,
+                   int band_count,
+                   GDALDataType type,
+                   int64_t row_stride = 0) {
+  chunk->projection_ = "+proj=longlat +datum=WGS84";
+  chunk->raster_location_ = Coordinate(0.0, 0.0, librasterblaster::UNDEF);
+  chunk->ul_projected_corner_ = Coordinate(-10.0, 10.0,
+                                           librasterblaster::UNDEF);
+  chunk->pixel_size_ = 1.0;
+  chunk->row_count_ = rows;
+  chunk->column_count_ = columns;
+  chunk->pixel_type_ = type;
+  chunk->band_count_ = band_count;
+  chunk->row_stride_ = row_stride;
+  if (row_stride == 0) {
+    chunk->row_stride_ = static_cast<int64_t>(columns) * band_count
+        * (GDALGetDataTypeSize(type) / 8);
+  }
+  chunk->pixels_ = calloc(static_cast<size_t>(rows), chunk->row_stride_);
+}
+}  // namespace
+
+TEST(ReprojectChunk, MultiBandPixelInterleaved) {
+  const int band_count = 4;
+  RasterChunk source, destination;
+  // Footprints reach a row below their pixel, the source has an extra row
+  // so that the last destination row is not fill
+  InitTestChunk(&source, 9, 8, band_count, GDT_UInt16);
+  InitTestChunk(&destination, 8, 8, band_count, GDT_UInt16);
+
+  uint16_t *in = static_cast<uint16_t*>(source.pixels_);
+  for (int i = 0; i < 9 * 8; ++i) {
+    for (int b = 0; b < band_count; ++b) {
+      in[i * band_count + b] = i * 10 + b;
+    }
+  }
+
+  ASSERT_TRUE(ReprojectChunk(&source, &destination, "65535",
+                             librasterblaster::NEAREST));
+
+  // The grids are the same, so every band of every output pixel is the band
+  // of the input pixel at the same place, and no pixel is fill
+  uint16_t *out = static_cast<uint16_t*>(destination.pixels_);
+  for (int i = 0; i < 8 * 8; ++i) {
+    for (int b = 0; b < band_count; ++b) {
+      ASSERT_NE(65535, out[i * band_count + b]) << "pixel " << i;
+      ASSERT_EQ(in[i * band_count + b], out[i * band_count + b])
+          << "pixel " << i << " band " << b;
+    }
+  }
+}
+
+namespace {
+// Fills an 8x8 source with 10 * row + column and creates a 4x4 destination of
+// twice the pixel size over it. Destination pixel (x, y) covers the source
+// columns 2x to 2x + 2 and rows 2y to 2y + 2, clamped to the source; the
+// last destination row reaches past it and gets the fill value.
+void InitGradientChunks(RasterChunk *source, RasterChunk *destination) {
+  InitTestChunk(source, 8, 8, 1, GDT_Int16);
+  InitTestChunk(destination, 4, 4, 1, GDT_Int16);
+  destination->pixel_size_ = 2.0;
+  int16_t *in = static_cast<int16_t*>(source->pixels_);
+  for (int y = 0; y < 8; ++y) {
+    for (int x = 0; x < 8; ++x) {
+      in[y * 8 + x] = 10 * y + x;
+    }
+  }
+}
+}  // namespace
+
+TEST(ReprojectChunk, ReducesFootprints) {
+  const int resampler_count = 5;
+  const librasterblaster::RESAMPLER resamplers[resampler_count] = {
+    librasterblaster::NEAREST, librasterblaster::MIN, librasterblaster::MAX,
+    librasterblaster::MEAN, librasterblaster::COUNT };
+  // Destination pixels (0, 0), (1, 1) and (3, 0), the last one covers only
+  // the columns 6 and 7. MEAN truncates 16.5 like the integer cast.
+  const int16_t expected[resampler_count][3] = {
+    { 0, 22, 6 }, { 0, 22, 6 }, { 22, 44, 27 }, { 11, 33, 16 }, { 9, 9, 6 } };
+
+  for (int r = 0; r < resampler_count; ++r) {
+    RasterChunk source, destination;
+    InitGradientChunks(&source, &destination);
+    ASSERT_TRUE(ReprojectChunk(&source, &destination, "-1", resamplers[r]));
+
+    int16_t *out = static_cast<int16_t*>(destination.pixels_);
+    ASSERT_EQ(expected[r][0], out[0]) << "resampler " << r;
+    ASSERT_EQ(expected[r][1], out[4 + 1]) << "resampler " << r;
+    ASSERT_EQ(expected[r][2], out[3]) << "resampler " << r;
+    ASSERT_EQ(-1, out[3 * 4]) << "resampler " << r;
+  }
+
+  // Moved half a destination pixel to the right, the footprint of (3, 0) is
+  // clamped to the last source column, 7, of the rows 0 to 2
+  const int16_t edge_expected[resampler_count] = { 7, 7, 27, 17, 3 };
+  for (int r = 0; r < resampler_count; ++r) {
+    RasterChunk source, destination;
+    InitGradientChunks(&source, &destination);
+    destination.ul_projected_corner_.x += 1.0;
+    ASSERT_TRUE(ReprojectChunk(&source, &destination, "-1", resamplers[r]));
+
+    int16_t *out = static_cast<int16_t*>(destination.pixels_);
+    ASSERT_EQ(edge_expected[r], out[3]) << "resampler " << r;
+  }
+
+  // A footprint inverted by clamping counts as its upper-left pixel, not as
+  // a negative count cast to an unsigned type
+  uint8_t count = 0;
+  librasterblaster::CountResampler<uint8_t, 1>::Reduce(NULL, 0, 1,
+                                                       Area(7, 0, 5, 2),
+                                                       &count, NULL);
+  ASSERT_EQ(1, count);
+}
+
+TEST(ReprojectChunk, SourceIndexMapMatchesKernel) {
+  RasterChunk source, mapped, direct;
+  InitTestChunk(&source, 16, 16, 1, GDT_Float32);
+  InitTestChunk(&mapped, 16, 16, 1, GDT_Float32);
+  InitTestChunk(&direct, 16, 16, 1, GDT_Float32);
+
+  float *in = static_cast<float*>(source.pixels_);
+  for (int i = 0; i < 16 * 16; ++i) {
+    in[i] = i * 0.5f;
+  }
+
+  std::vector<int32_t> index_map;
+  ASSERT_TRUE(ComputeSourceIndexMap(&source, &mapped, &index_map));
+  ASSERT_EQ(16u * 16u, index_map.size());
+  ASSERT_TRUE(ApplySourceIndexMap(&source, &mapped, index_map, "-1"));
+  librasterblaster::RasterCoordTransformer rt(direct.projection_,
+                                              direct.ul_projected_corner_,
+                                              direct.pixel_size_,
+                                              direct.row_count_,
+                                              direct.column_count_,
+                                              source.projection_,
+                                              source.ul_projected_corner_,
+                                              source.pixel_size_);
+  ASSERT_TRUE((librasterblaster::ReprojectChunkType<
+               float, librasterblaster::NearestResampler, 1>(&source,
+                                                            &direct,
+                                                            1,
+                                                            -1.0,
+                                                            &rt)));
+
+  float *a = static_cast<float*>(mapped.pixels_);
+  float *b = static_cast<float*>(direct.pixels_);
+  for (int i = 0; i < 16 * 16; ++i) {
+    ASSERT_EQ(b[i], a[i]);
+  }
+}
+
+TEST(GatherPixels, VectorKernelsMatchScalar) {
+  // 37 pixels leave a remainder after every vector block width
+  const int count = 37;
+  const int source_count = 50;
+  std::vector<int32_t> index_map(count);
+  for (int i = 0; i < count; ++i) {
+    index_map[i] = i % 5 == 3
+        ? librasterblaster::kFillIndex
+        : (i * 7) % source_count;
+  }
+
+  const size_t pixel_sizes[] = { 1, 2, 3, 4, 8, 16 };
+  for (size_t s = 0; s < sizeof(pixel_sizes) / sizeof(pixel_sizes[0]); ++s) {
+    const size_t pixel_size = pixel_sizes[s];
+    std::vector<unsigned char> source(source_count * pixel_size);
+    for (size_t i = 0; i < source.size(); ++i) {
+      source[i] = static_cast<unsigned char>(i * 13 + 1);
+    }
+    std::vector<unsigned char> fill(pixel_size, 0xfe);
+    std::vector<unsigned char> out(count * pixel_size, 0);
+
+    GatherPixels(&index_map[0], count, &source[0], pixel_size, &fill[0],
+                 &out[0]);
+
+    for (int i = 0; i < count; ++i) {
+      const unsigned char *expected = index_map[i] < 0
+          ? &fill[0]
+          : &source[index_map[i] * pixel_size];
+      for (size_t b = 0; b < pixel_size; ++b) {
+        ASSERT_EQ(expected[b], out[i * pixel_size + b])
+            << "pixel size " << pixel_size << " pixel " << i;
+      }
+    }
+  }
+}
+
+TEST(ReprojectChunk, MultiMatchesSingleResamplers) {
+  const int resampler_count = 5;
+  const librasterblaster::RESAMPLER resamplers[resampler_count] = {
+    librasterblaster::NEAREST, librasterblaster::MIN, librasterblaster::MAX,
+    librasterblaster::MEAN, librasterblaster::COUNT };
+  RasterChunk source;
+  RasterChunk fused[resampler_count], single[resampler_count];
+  InitTestChunk(&source, 12, 12, 3, GDT_Int16);
+
+  int16_t *in = static_cast<int16_t*>(source.pixels_);
+  for (int i = 0; i < 12 * 12 * 3; ++i) {
+    in[i] = (i * 37) % 101;
+  }
+
+  std::vector<RasterChunk*> destinations;
+  for (int i = 0; i < resampler_count; ++i) {
+    InitTestChunk(&fused[i], 12, 12, 3, GDT_Int16);
+    InitTestChunk(&single[i], 12, 12, 3, GDT_Int16);
+    destinations.push_back(&fused[i]);
+    ASSERT_TRUE(ReprojectChunk(&source, &single[i], "-1", resamplers[i]));
+  }
+
+  ASSERT_TRUE(librasterblaster::ReprojectChunkMulti(
+      &source, destinations, "-1",
+      std::vector<librasterblaster::RESAMPLER>(resamplers,
+                                               resamplers + resampler_count)));
+
+  for (int i = 0; i < resampler_count; ++i) {
+    ASSERT_EQ(0, memcmp(single[i].pixels_, fused[i].pixels_,
+                        12 * 12 * 3 * sizeof(int16_t)));
+  }
+}
+
+TEST(ReprojectChunk, MultiReducesFootprints) {
+  const librasterblaster::RESAMPLER resamplers[3] = {
+    librasterblaster::MIN, librasterblaster::MEAN, librasterblaster::MAX };
+  RasterChunk source, destinations[3];
+  InitGradientChunks(&source, &destinations[0]);
+  std::vector<RasterChunk*> pointers(1, &destinations[0]);
+  for (int i = 1; i < 3; ++i) {
+    InitTestChunk(&destinations[i], 4, 4, 1, GDT_Int16);
+    destinations[i].pixel_size_ = 2.0;
+    pointers.push_back(&destinations[i]);
+  }
+
+  ASSERT_TRUE(librasterblaster::ReprojectChunkMulti(
+      &source, pointers, "-1",
+      std::vector<librasterblaster::RESAMPLER>(resamplers, resamplers + 3)));
+
+  int16_t *minimum = static_cast<int16_t*>(destinations[0].pixels_);
+  int16_t *mean = static_cast<int16_t*>(destinations[1].pixels_);
+  int16_t *maximum = static_cast<int16_t*>(destinations[2].pixels_);
+  // Destination pixel (1, 1) covers the source rows and columns 2 to 4
+  ASSERT_EQ(22, minimum[4 + 1]);
+  ASSERT_EQ(33, mean[4 + 1]);
+  ASSERT_EQ(44, maximum[4 + 1]);
+  // Destination pixel (3, 0) covers the columns 6 and 7 of the rows 0 to 2
+  ASSERT_EQ(6, minimum[3]);
+  ASSERT_EQ(16, mean[3]);
+  ASSERT_EQ(27, maximum[3]);
+}
+
+TEST(ReprojectChunk, ComplexComponentsStayPaired) {
+  RasterChunk source, destination;
+  InitTestChunk(&source, 8, 8, 1, GDT_CFloat32);
+  InitTestChunk(&destination, 8, 8, 1, GDT_CFloat32);
+
+  float *in = static_cast<float*>(source.pixels_);
+  for (int i = 0; i < 8 * 8; ++i) {
+    in[2 * i] = i;
+    in[2 * i + 1] = -i;
+  }
+
+  const librasterblaster::RESAMPLER resamplers[2] = {
+    librasterblaster::NEAREST, librasterblaster::MEAN };
+  for (int r = 0; r < 2; ++r) {
+    ASSERT_TRUE(ReprojectChunk(&source, &destination, "0", resamplers[r]));
+    float *out = static_cast<float*>(destination.pixels_);
+    for (int i = 0; i < 8 * 8; ++i) {
+      ASSERT_EQ(out[2 * i], -out[2 * i + 1]);
+    }
+  }
+
+  ASSERT_FALSE(ReprojectChunk(&source, &destination, "0",
+                              librasterblaster::MIN));
+
+  // A grid of twice the pixel size, destination pixel (1, 1) averages the
+  // source rows and columns 2 to 4 and (3, 0) the columns 6 and 7 of the
+  // rows 0 to 2
+  RasterChunk coarse;
+  InitTestChunk(&coarse, 4, 4, 1, GDT_CFloat32);
+  coarse.pixel_size_ = 2.0;
+  for (int y = 0; y < 8; ++y) {
+    for (int x = 0; x < 8; ++x) {
+      in[2 * (y * 8 + x)] = 10 * y + x;
+      in[2 * (y * 8 + x) + 1] = -2 * (10 * y + x);
+    }
+  }
+  ASSERT_TRUE(ReprojectChunk(&source, &coarse, "0", librasterblaster::MEAN));
+  float *out = static_cast<float*>(coarse.pixels_);
+  ASSERT_FLOAT_EQ(33.0f, out[2 * (4 + 1)]);
+  ASSERT_FLOAT_EQ(-66.0f, out[2 * (4 + 1) + 1]);
+  ASSERT_FLOAT_EQ(16.5f, out[2 * 3]);
+  ASSERT_FLOAT_EQ(-33.0f, out[2 * 3 + 1]);
+}
+
+TEST(ChunkBufferPool, RecyclesBuffersBySizeClass) {
+  ChunkBufferPool *pool = ChunkBufferPool::Instance();
+  // Earlier tests may have left buffers of this class in the pool
+  pool->Clear();
+  ASSERT_EQ(ChunkBufferPool::ClassSize(1), ChunkBufferPool::ClassSize(4096));
+  ASSERT_EQ(static_cast<size_t>(10240), ChunkBufferPool::ClassSize(10000));
+
+  ChunkBufferPool::Statistics before = pool->statistics();
+  unsigned char *first = static_cast<unsigned char*>(pool->Acquire(10000,
+                                                                   false));
+  ASSERT_TRUE(first != NULL);
+  memset(first, 0xff, 10000);
+  pool->Release(first);
+
+  unsigned char *second = static_cast<unsigned char*>(pool->Acquire(9000,
+                                                                    true));
+  ASSERT_EQ(first, second);
+  for (int i = 0; i < 9000; ++i) {
+    ASSERT_EQ(0, second[i]);
+  }
+  pool->Release(second);
+
+  ChunkBufferPool::Statistics after = pool->statistics();
+  ASSERT_EQ(before.hits + 1, after.hits);
+  ASSERT_EQ(before.misses + 1, after.misses);
+}
+
+TEST(RasterChunk, CopyMoveAndView) {
+  RasterChunk source;
+  InitTestChunk(&source, 6, 5, 2, GDT_Int16);
+  int16_t *pixels = static_cast<int16_t*>(source.pixels_);
+  for (int i = 0; i < 6 * 5 * 2; ++i) {
+    pixels[i] = i;
+  }
+
+  RasterChunk copy(source);
+  ASSERT_TRUE(copy.pixels_ != source.pixels_);
+  ASSERT_EQ(0, memcmp(copy.pixels_, source.pixels_, copy.PixelBufferSize()));
+
+  void *buffer = copy.pixels_;
+  RasterChunk moved(std::move(copy));
+  ASSERT_EQ(buffer, moved.pixels_);
+  ASSERT_TRUE(copy.pixels_ == NULL);
+
+  // Rows 2-4, columns 1-3 of a 5 column, 2 band chunk
+  librasterblaster::RasterChunkView view = moved.View(Area(1, 2, 3, 4));
+  ASSERT_EQ(3, view.column_count_);
+  ASSERT_EQ(3, view.row_count_);
+  ASSERT_EQ(static_cast<int64_t>(5 * 2 * sizeof(int16_t)), view.row_stride_);
+  ASSERT_FALSE(view.IsContiguous());
+  ASSERT_EQ(moved.raster_location_.x + 1, view.raster_location_.x);
+  ASSERT_EQ((2 * 5 + 1) * 2, *static_cast<int16_t*>(view.pixels_));
+  ASSERT_EQ((4 * 5 + 3) * 2 + 1,
+            static_cast<int16_t*>(view.Pixel(2, 2))[1]);
+
+  librasterblaster::RasterChunkView inner = view.Subview(Area(1, 1, 1, 1));
+  ASSERT_EQ((3 * 5 + 2) * 2, *static_cast<int16_t*>(inner.pixels_));
+}
+
+TEST(DownsampleChunk, ReducesTwoByTwoPixels) {
+  // 5x3 source, so the last overview column and row cover fewer pixels
+  RasterChunk source, mean, nearest, lower;
+  InitTestChunk(&source, 3, 5, 1, GDT_Int16);
+  InitTestChunk(&mean, 2, 3, 1, GDT_Int16);
+  InitTestChunk(&nearest, 2, 3, 1, GDT_Int16);
+  InitTestChunk(&lower, 1, 3, 1, GDT_Int16);
+  int16_t *in = static_cast<int16_t*>(source.pixels_);
+  for (int i = 0; i < 5 * 3; ++i) {
+    in[i] = i;
+  }
+  // Fill pixels are left out of the statistic
+  in[0] = -1;
+  in[12] = -1;
+  in[13] = -1;
+
+  ASSERT_TRUE(DownsampleChunk(&source, &mean, librasterblaster::MEAN, "-1"));
+  ASSERT_TRUE(DownsampleChunk(&source, &nearest, librasterblaster::NEAREST,
+                              "-1"));
+  int16_t *a = static_cast<int16_t*>(mean.pixels_);
+  int16_t *b = static_cast<int16_t*>(nearest.pixels_);
+  // (1 + 5 + 6) / 3, (2 + 3 + 7 + 8) / 4, (4 + 9) / 2 and (10 + 11) / 2
+  // truncated
+  ASSERT_EQ(4, a[0]);
+  ASSERT_EQ(5, a[1]);
+  ASSERT_EQ(6, a[2]);
+  ASSERT_EQ(10, a[3]);
+  ASSERT_EQ(-1, a[4]);
+  ASSERT_EQ(14, a[5]);
+  ASSERT_EQ(1, b[0]);
+  ASSERT_EQ(2, b[1]);
+  ASSERT_EQ(10, b[3]);
+  ASSERT_EQ(-1, b[4]);
+
+  // A destination row whose source rows are not in the chunk
+  lower.raster_location_ = Coordinate(0.0, 2.0, librasterblaster::UNDEF);
+  ASSERT_FALSE(DownsampleChunk(&source, &lower, librasterblaster::MEAN,
+                               "-1"));
+}
+
+TEST(AreaIsFill, FindsFillOnlyAreas) {
+  RasterChunk chunk;
+  InitTestChunk(&chunk, 8, 8, 2, GDT_Float32, 96);
+  chunk.raster_location_ = Coordinate(16.0, 8.0, librasterblaster::UNDEF);
+  float *pixels = static_cast<float*>(chunk.pixels_);
+  for (int y = 0; y < 8; ++y) {
+    for (int x = 0; x < 16; ++x) {
+      pixels[y * 24 + x] = -9999.0f;
+    }
+  }
+  // The second band of one pixel of the lower right quarter holds data
+  pixels[6 * 24 + 5 * 2 + 1] = 1.0f;
+
+  ASSERT_TRUE(AreaIsFill(&chunk, Area(16, 8, 19, 11), "-9999"));
+  ASSERT_TRUE(AreaIsFill(&chunk, Area(16, 12, 19, 15), "-9999"));
+  ASSERT_FALSE(AreaIsFill(&chunk, Area(20, 12, 23, 15), "-9999"));
+  ASSERT_FALSE(AreaIsFill(&chunk, Area(16, 8, 19, 11), "0"));
+  // Outside of the chunk
+  ASSERT_FALSE(AreaIsFill(&chunk, Area(12, 8, 19, 11), "-9999"));
+}
+
+TEST(ReprojectChunk, PaddedRowsMatchPackedRows) {
+  RasterChunk packed_source, padded_source, packed, padded;
+  InitTestChunk(&packed_source, 10, 10, 3, GDT_Byte);
+  InitTestChunk(&padded_source, 10, 10, 3, GDT_Byte, 192);
+  InitTestChunk(&packed, 10, 10, 3, GDT_Byte);
+  InitTestChunk(&padded, 10, 10, 3, GDT_Byte, 64);
+
+  for (int y = 0; y < 10; ++y) {
+    unsigned char *row = static_cast<unsigned char*>(packed_source.Row(y));
+    for (int i = 0; i < 10 * 3; ++i) {
+      row[i] = static_cast<unsigned char>(y * 30 + i);
+    }
+    memcpy(padded_source.Row(y), row, 10 * 3);
+  }
+
+  const librasterblaster::RESAMPLER resamplers[2] = {
+    librasterblaster::NEAREST, librasterblaster::MEAN };
+  for (int r = 0; r < 2; ++r) {
+    ASSERT_TRUE(ReprojectChunk(&packed_source, &packed, "0", resamplers[r]));
+    ASSERT_TRUE(ReprojectChunk(&padded_source, &padded, "0", resamplers[r]));
+    for (int y = 0; y < 10; ++y) {
+      ASSERT_EQ(0, memcmp(packed.Row(y), padded.Row(y), 10 * 3));
+    }
+  }
+}
+
+TEST(ChunkBufferPool, LargeBuffersUseHugePages) {
+  ChunkBufferPool *pool = ChunkBufferPool::Instance();
+  pool->set_huge_page_threshold(librasterblaster::kHugePageSize);
+
+  void *buffer = pool->Acquire(librasterblaster::kHugePageSize + 1, false);
+  ASSERT_TRUE(buffer != NULL);
+  ASSERT_EQ(0u, reinterpret_cast<uintptr_t>(buffer)
+            % librasterblaster::kHugePageSize);
+  pool->Release(buffer);
+
+  pool->set_huge_page_threshold(static_cast<size_t>(64) << 20);
+}
+
+TEST(PlanPartitions, FitsMemoryBudget) {
+  // 4 x 4 tiles of 100 x 100 pixels, each tile reads the same source area
+  vector<Area> tile_minboxes;
+  for (int ty = 0; ty < 4; ++ty) {
+    for (int tx = 0; tx < 4; ++tx) {
+      tile_minboxes.push_back(Area(tx * 100, ty * 100,
+                                   tx * 100 + 99, ty * 100 + 99));
+    }
+  }
+
+  // Four tile partitions need 2 x 40960 bytes, eight tiles twice that
+  librasterblaster::PartitionPlan plan =
+      librasterblaster::PlanPartitions(tile_minboxes, 400, 400, 100, 1, 1,
+                                       GDT_Byte, 1, false, 1, 100000);
+  ASSERT_TRUE(plan.fits);
+  ASSERT_EQ(4, plan.partition_size);
+  ASSERT_EQ(4, plan.partition_count);
+  ASSERT_EQ(81920, plan.peak_bytes);
+
+  // Every process needs a partition
+  plan = librasterblaster::PlanPartitions(tile_minboxes, 400, 400, 100, 8, 1,
+                                          GDT_Byte, 1, false, 1, 100000);
+  ASSERT_EQ(2, plan.partition_size);
+  ASSERT_EQ(8, plan.partition_count);
+
+  plan = librasterblaster::PlanPartitions(tile_minboxes, 400, 400, 100, 1, 1,
+                                          GDT_Byte, 1, false, 1, 1000);
+  ASSERT_FALSE(plan.fits);
+  ASSERT_EQ(1, plan.partition_size);
+}
+
+TEST(TileMinboxUnion, MatchesRasterMinbox) {
+  // A global 1 degree grid reprojected to a Mollweide grid of 100km pixels
+  librasterblaster::RasterDescriptor input, output;
+  input.projection = "+proj=longlat +datum=WGS84";
+  const double input_transform[6] = { -180.0, 1.0, 0.0, 90.0, 0.0, -1.0 };
+  std::copy(input_transform, input_transform + 6, input.geotransform);
+  input.row_count = 180;
+  input.column_count = 360;
+  output.projection = "+proj=moll +datum=WGS84";
+  const double output_transform[6] = { -18100000.0, 100000.0, 0.0,
+                                       9100000.0, 0.0, -100000.0 };
+  std::copy(output_transform, output_transform + 6, output.geotransform);
+  output.row_count = 182;
+  output.column_count = 362;
+
+  const int tile_size = 32;
+  const int64_t tiles_across = (output.column_count + tile_size - 1)
+      / tile_size;
+  const int64_t tiles_down = (output.row_count + tile_size - 1) / tile_size;
+  vector<Area> tile_minboxes;
+  for (int64_t ty = 0; ty < tiles_down; ++ty) {
+    for (int64_t tx = 0; tx < tiles_across; ++tx) {
+      const Area tile(tx * tile_size, ty * tile_size,
+                      std::min<int64_t>((tx + 1) * tile_size,
+                                        output.column_count) - 1,
+                      std::min<int64_t>((ty + 1) * tile_size,
+                                        output.row_count) - 1);
+      tile_minboxes.push_back(
+          librasterblaster::RasterMinbox(output, input, tile));
+    }
+  }
+
+  // The partitions of four processes, including corners off the globe
+  for (int rank = 0; rank < 4; ++rank) {
+    vector<Area> partitions = BlockPartition(rank, 4, output.row_count,
+                                             output.column_count, tile_size,
+                                             4);
+    for (size_t i = 0; i < partitions.size(); ++i) {
+      const Area expected = librasterblaster::RasterMinbox(output, input,
+                                                           partitions[i]);
+      const Area box = librasterblaster::TileMinboxUnion(
+          tile_minboxes, output.column_count, tile_size, partitions[i]);
+      ASSERT_EQ(expected.ul.x, box.ul.x);
+      ASSERT_EQ(expected.ul.y, box.ul.y);
+      ASSERT_EQ(expected.lr.x, box.lr.x);
+      ASSERT_EQ(expected.lr.y, box.lr.y);
+    }
+  }
+}
+
+TEST(MappedRaster, ReadsTiledGeoTiff) {
+  const std::string filename =
+      STR(__PRB_SRC_DIR__) "/tests/testdata/mapped_test.tif";
+  const int rows = 100;
+  const int cols = 80;
+
+  GDALAllRegister();
+  GDALDriver *driver = GetGDALDriverManager()->GetDriverByName("GTiff");
+  ASSERT_TRUE(driver != NULL);
+  char **options = NULL;
+  options = CSLSetNameValue(options, "TILED", "YES");
+  options = CSLSetNameValue(options, "BLOCKXSIZE", "32");
+  options = CSLSetNameValue(options, "BLOCKYSIZE", "32");
+  options = CSLSetNameValue(options, "INTERLEAVE", "PIXEL");
+  GDALDataset *ds = driver->Create(filename.c_str(), cols, rows, 2,
+                                   GDT_UInt16, options);
+  CSLDestroy(options);
+  ASSERT_TRUE(ds != NULL);
+
+  vector<uint16_t> pixels(rows * cols * 2);
+  for (int y = 0; y < rows; ++y) {
+    for (int x = 0; x < cols; ++x) {
+      pixels[(y * cols + x) * 2] = static_cast<uint16_t>(y * cols + x);
+      pixels[(y * cols + x) * 2 + 1] = static_cast<uint16_t>(y);
+    }
+  }
+  int bands[] = { 1, 2 };
+  ASSERT_EQ(CE_None, ds->RasterIO(GF_Write, 0, 0, cols, rows, &pixels[0],
+                                  cols, rows, GDT_UInt16, 2, bands,
+                                  4, cols * 4, 2));
+
+  // One window within a tile and one crossing tile boundaries
+  const Area windows[] = { Area(33, 1, 42, 20), Area(5, 5, 74, 94) };
+  const bool attached[] = { true, false };
+
+  MappedRaster *mapped = NULL;
+  for (int i = 0; i < 2; ++i) {
+    if (i == 0) {
+      GDALClose(ds);
+      mapped = MappedRaster::Open(filename);
+      ASSERT_TRUE(mapped != NULL);
+      ds = static_cast<GDALDataset*>(GDALOpen(filename.c_str(),
+                                              GA_ReadOnly));
+    }
+    RasterChunk *chunk = RasterChunk::CreateRasterChunk(ds, windows[i],
+                                                        false);
+    ASSERT_EQ(librasterblaster::PRB_NOERROR,
+              mapped->ReadRasterChunk(chunk));
+    ASSERT_EQ(attached[i], mapped->CanAttach(windows[i]));
+    ASSERT_EQ(!attached[i], chunk->owns_pixels_);
+
+    for (int64_t y = 0; y < chunk->row_count_; ++y) {
+      const uint16_t *row = static_cast<const uint16_t*>(chunk->Row(y));
+      for (int64_t x = 0; x < chunk->column_count_; ++x) {
+        const int64_t raster_x = windows[i].ul.x + x;
+        const int64_t raster_y = windows[i].ul.y + y;
+        ASSERT_EQ(static_cast<uint16_t>(raster_y * cols + raster_x),
+                  row[x * 2]);
+        ASSERT_EQ(static_cast<uint16_t>(raster_y), row[x * 2 + 1]);
+      }
+    }
+    delete chunk;
+  }
+
+  // A raster mapped from the description of another reads the same pixels
+  vector<int64_t> description;
+  mapped->Describe(&description);
+  MappedRaster *described = MappedRaster::Open(filename, description);
+  ASSERT_TRUE(described != NULL);
+  const librasterblaster::RasterDescriptor descriptor(ds);
+  ASSERT_EQ(cols, descriptor.column_count);
+  ASSERT_EQ(rows, descriptor.row_count);
+  ASSERT_EQ(32, descriptor.block_width);
+  RasterChunk *chunk = RasterChunk::CreateRasterChunk(descriptor, windows[1],
+                                                      false);
+  RasterChunk *expected = RasterChunk::CreateRasterChunk(ds, windows[1],
+                                                         false);
+  ASSERT_EQ(librasterblaster::PRB_NOERROR, described->ReadRasterChunk(chunk));
+  ASSERT_EQ(librasterblaster::PRB_NOERROR, mapped->ReadRasterChunk(expected));
+  for (int64_t y = 0; y < chunk->row_count_; ++y) {
+    ASSERT_EQ(0, memcmp(chunk->Row(y), expected->Row(y),
+                        chunk->column_count_ * 4));
+  }
+  delete chunk;
+  delete expected;
+  delete described;
+
+  delete mapped;
+  GDALClose(ds);
+  remove(filename.c_str());
+}
+
+TEST(MappedRaster, FillsMissingTilesWithNoData) {
+  const std::string filename =
+      STR(__PRB_SRC_DIR__) "/tests/testdata/mapped_sparse_test.tif";
+  const int rows = 64;
+  const int cols = 64;
+
+  GDALAllRegister();
+  GDALDriver *driver = GetGDALDriverManager()->GetDriverByName("GTiff");
+  ASSERT_TRUE(driver != NULL);
+  char **options = NULL;
+  options = CSLSetNameValue(options, "TILED", "YES");
+  options = CSLSetNameValue(options, "BLOCKXSIZE", "32");
+  options = CSLSetNameValue(options, "BLOCKYSIZE", "32");
+  options = CSLSetNameValue(options, "INTERLEAVE", "PIXEL");
+  options = CSLSetNameValue(options, "SPARSE_OK", "TRUE");
+  GDALDataset *ds = driver->Create(filename.c_str(), cols, rows, 2,
+                                   GDT_Int16, options);
+  CSLDestroy(options);
+  ASSERT_TRUE(ds != NULL);
+  ds->GetRasterBand(1)->SetNoDataValue(-7.0);
+  ds->GetRasterBand(2)->SetNoDataValue(-7.0);
+
+  // Only the upper-left tile is stored
+  vector<int16_t> pixels(32 * 32 * 2, 5);
+  int bands[] = { 1, 2 };
+  ASSERT_EQ(CE_None, ds->RasterIO(GF_Write, 0, 0, 32, 32, &pixels[0],
+                                  32, 32, GDT_Int16, 2, bands,
+                                  4, 32 * 4, 2));
+  GDALClose(ds);
+
+  ds = static_cast<GDALDataset*>(GDALOpen(filename.c_str(), GA_ReadOnly));
+  ASSERT_TRUE(ds != NULL);
+  const librasterblaster::RasterDescriptor descriptor(ds);
+  ASSERT_TRUE(descriptor.has_nodata);
+  MappedRaster *mapped = MappedRaster::Open(filename);
+  ASSERT_TRUE(mapped != NULL);
+  mapped->SetNoDataValue(descriptor.nodata, descriptor.pixel_type);
+
+  // Reads the same pixels as GDAL across the stored and missing tiles
+  const Area window(20, 20, 50, 50);
+  RasterChunk *chunk = RasterChunk::CreateRasterChunk(descriptor, window,
+                                                      false);
+  RasterChunk *expected = RasterChunk::CreateRasterChunk(descriptor, window,
+                                                         false);
+  ASSERT_EQ(librasterblaster::PRB_NOERROR, mapped->ReadRasterChunk(chunk));
+  ASSERT_EQ(CE_None, ds->RasterIO(GF_Read, 20, 20, 31, 31, expected->pixels_,
+                                  31, 31, GDT_Int16, 2, bands, 4,
+                                  expected->row_stride_, 2));
+  for (int64_t y = 0; y < chunk->row_count_; ++y) {
+    ASSERT_EQ(0, memcmp(chunk->Row(y), expected->Row(y),
+                        chunk->column_count_ * 4));
+  }
+  ASSERT_EQ(-7, static_cast<int16_t*>(chunk->Row(30))[60]);
+
+  delete chunk;
+  delete expected;
+  delete mapped;
+  GDALClose(ds);
+  remove(filename.c_str());
+}
+
+namespace {
+// Writes pixels, rows by cols pixels of bands Int16 values, to filename with
+// compression from every process, rank 0 holding all the tiles, and decodes
+// them with GDAL on rank 0. Returns the number of values GDAL decodes
+// differently, or -1 on error, on every process.
+int64_t CompressedRoundTripMismatches(const std::string &filename,
+                                      sptw::SPTW_COMPRESSION compression,
+                                      const vector<int16_t> &pixels,
+                                      int rows,
+                                      int cols,
+                                      int bands) {
+  int rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  double geotransform[6] = { -180.0, 1.0, 0.0, 90.0, 0.0, -1.0 };
+  OGRSpatialReference srs;
+  srs.SetFromUserInput("+proj=longlat +datum=WGS84 +no_defs");
+  char *wkt = NULL;
+  srs.exportToWkt(&wkt);
+  const std::string projection(wkt);
+  CPLFree(wkt);
+
+  sptw::RasterLayout layout;
+  int err = sptw::SP_None;
+  if (rank == 0) {
+    err = sptw::create_raster_direct(filename, cols, rows, bands, GDT_Int16,
+                                     geotransform, projection, 64, 0,
+                                     compression, -1, NULL, &layout);
+  }
+  MPI_Bcast(&err, 1, MPI_INT, 0, MPI_COMM_WORLD);
+  if (err != sptw::SP_None) {
+    return -1;
+  }
+  MPI_Bcast(&layout, sizeof(layout), MPI_BYTE, 0, MPI_COMM_WORLD);
+  sptw::PTIFF *ptiff = sptw::open_raster(filename, layout);
+  if (ptiff == NULL) {
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  }
+  // Rank 0 writes every tile, the others take part with an empty area
+  if (rank == 0) {
+    err = sptw::write_area_compressed(
+        ptiff, const_cast<int16_t*>(&pixels[0]), cols * bands * 2, 0, 0,
+        cols - 1, rows - 1);
+  } else {
+    err = sptw::write_area_compressed(ptiff, NULL, 0, 0, 0, -1, -1);
+  }
+  const int close_err = sptw::close_raster(ptiff);
+  if (err == sptw::SP_None) {
+    err = close_err;
+  }
+  MPI_Allreduce(MPI_IN_PLACE, &err, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+  if (err != sptw::SP_None) {
+    return -1;
+  }
+
+  int64_t mismatches = 0;
+  if (rank == 0) {
+    GDALDataset *ds = static_cast<GDALDataset*>(
+        GDALOpen(filename.c_str(), GA_ReadOnly));
+    vector<int16_t> decoded(pixels.size(), 0);
+    int band_map[] = { 1, 2 };
+    if (ds == NULL || bands > 2
+        || ds->RasterIO(GF_Read, 0, 0, cols, rows, &decoded[0], cols, rows,
+                        GDT_Int16, bands, band_map, bands * 2,
+                        cols * bands * 2, 2) != CE_None) {
+      mismatches = -1;
+    } else {
+      for (size_t i = 0; i < pixels.size(); ++i) {
+        mismatches += pixels[i] != decoded[i];
+      }
+    }
+    if (ds != NULL) {
+      GDALClose(ds);
+    }
+  }
+  MPI_Bcast(&mismatches, 1, MPI_INT64_T, 0, MPI_COMM_WORLD);
+  return mismatches;
+}
+}  // namespace
+
+TEST(WriteAreaCompressed, TilesDecodeWithGDAL) {
+  // Partial tiles at the right and bottom edges, and tiles of 16 KB so the
+  // LZW string table fills up and is cleared
+  const int rows = 100;
+  const int cols = 150;
+  const int bands = 2;
+  std::vector<sptw::SPTW_COMPRESSION> compressions;
+  compressions.push_back(sptw::SP_Deflate);
+  compressions.push_back(sptw::SP_LZW);
+#ifdef PRB_HAVE_ZSTD
+  compressions.push_back(sptw::SP_ZSTD);
+#endif
+  int rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  GDALAllRegister();
+
+  // Runs of equal pixels mixed with noise
+  vector<int16_t> pixels(rows * cols * bands);
+  uint32_t state = 12345;
+  for (size_t i = 0; i < pixels.size(); ++i) {
+    state = state * 1103515245u + 12345u;
+    pixels[i] = (i / 64) % 3 == 0
+        ? static_cast<int16_t>(i / 640)
+        : static_cast<int16_t>(state >> 16);
+  }
+
+  // A temporary file, named on rank 0, outside of the source tree
+  char filename[] = "/tmp/prb_compressed_XXXXXX";
+  if (rank == 0) {
+    const int fd = mkstemp(filename);
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+  MPI_Bcast(filename, sizeof(filename), MPI_CHAR, 0, MPI_COMM_WORLD);
+
+  vector<int64_t> mismatches(compressions.size());
+  for (size_t c = 0; c < compressions.size(); ++c) {
+    mismatches[c] = CompressedRoundTripMismatches(filename, compressions[c],
+                                                  pixels, rows, cols, bands);
+  }
+  if (rank == 0) {
+    unlink(filename);
+  }
+  for (size_t c = 0; c < compressions.size(); ++c) {
+    EXPECT_EQ(0, mismatches[c]) << "compression " << compressions[c];
+  }
+}
+
+TEST(PopulateTileOffsets, FillsTileArraysOfGDALFile) {
+  int rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  // Each process would create its own file, one is enough
+  if (rank != 0) {
+    return;
+  }
+  char filename[] = "/tmp/prb_offsets_XXXXXX";
+  const int fd = mkstemp(filename);
+  ASSERT_GE(fd, 0);
+  close(fd);
+
+  // 4 x 3 tiles of 4096 bytes without any allocated, aligned to 8192 bytes
+  GDALAllRegister();
+  GDALDriver *driver = GetGDALDriverManager()->GetDriverByName("GTiff");
+  ASSERT_TRUE(driver != NULL);
+  char **options = NULL;
+  options = CSLSetNameValue(options, "BIGTIFF", "YES");
+  options = CSLSetNameValue(options, "TILED", "YES");
+  options = CSLSetNameValue(options, "BLOCKXSIZE", "32");
+  options = CSLSetNameValue(options, "BLOCKYSIZE", "32");
+  options = CSLSetNameValue(options, "INTERLEAVE", "PIXEL");
+  options = CSLSetNameValue(options, "SPARSE_OK", "TRUE");
+  GDALDataset *ds = driver->Create(filename, 100, 70, 2, GDT_Int16, options);
+  CSLDestroy(options);
+  ASSERT_TRUE(ds != NULL);
+  GDALClose(ds);
+
+  sptw::PTIFF ptiff = sptw::PTIFF();
+  ptiff.band_count = 2;
+  ptiff.band_type_size = 2;
+  int err = MPI_File_open(MPI_COMM_SELF, filename, MPI_MODE_RDWR,
+                          MPI_INFO_NULL, &ptiff.fh);
+  if (err == MPI_SUCCESS) {
+    err = sptw::populate_tile_offsets(&ptiff, 32, 8192);
+    MPI_File_close(&ptiff.fh);
+  }
+
+  vector<uint64_t> offsets, byte_counts;
+  TIFF *tiff = err == sptw::SP_None ? TIFFOpen(filename, "r") : NULL;
+  if (tiff != NULL) {
+    uint64_t *values = NULL;
+    if (TIFFGetField(tiff, TIFFTAG_TILEOFFSETS, &values) == 1) {
+      offsets.assign(values, values + 12);
+    }
+    if (TIFFGetField(tiff, TIFFTAG_TILEBYTECOUNTS, &values) == 1) {
+      byte_counts.assign(values, values + 12);
+    }
+    TIFFClose(tiff);
+  }
+  FILE *file = fopen(filename, "rb");
+  int64_t file_size = -1;
+  if (file != NULL) {
+    fseek(file, 0, SEEK_END);
+    file_size = ftell(file);
+    fclose(file);
+  }
+  unlink(filename);
+
+  ASSERT_EQ(sptw::SP_None, err);
+  ASSERT_EQ(12u, offsets.size());
+  ASSERT_EQ(12u, byte_counts.size());
+  ASSERT_EQ(0u, offsets[0] % 8192);
+  for (int i = 0; i < 12; ++i) {
+    ASSERT_EQ(offsets[0] + i * 8192u, offsets[i]) << "tile " << i;
+    ASSERT_EQ(4096u, byte_counts[i]) << "tile " << i;
+  }
+  ASSERT_EQ(static_cast<int64_t>(offsets[0] + 12 * 8192), file_size);
+}
+
+TEST(RasterChunk, SizesBeyondInt32) {
+  // No pixels are allocated, only the sizes and offsets are computed
+  const int64_t rows = 60000;
+  const int64_t columns = 3000000000LL;
+  ASSERT_EQ(static_cast<size_t>(rows) * columns * 4 * 8,
+            RasterChunk::BufferSize(rows, columns, 4, GDT_Float64, 1, 0));
+  ASSERT_EQ(static_cast<size_t>(rows + 2) * 96000000128LL,
+            RasterChunk::BufferSize(rows, columns, 4, GDT_Float64, 64, 1));
+
+  librasterblaster::RasterChunkView view;
+  view.row_count_ = rows;
+  view.column_count_ = columns;
+  view.band_count_ = 4;
+  view.pixel_type_ = GDT_Float64;
+  view.row_stride_ = columns * 32;
+  ASSERT_TRUE(view.IsContiguous());
+
+  librasterblaster::RasterChunkView sub =
+      view.Subview(Area(2500000000LL, 50000, columns - 1, rows - 1));
+  ASSERT_EQ(500000000, sub.column_count_);
+  ASSERT_EQ(10000, sub.row_count_);
+  ASSERT_EQ(2500000000.0, sub.raster_location_.x);
+  ASSERT_FALSE(sub.IsContiguous());
+}
+
+TEST(CalculateFileOffset, OffsetsBeyondInt32) {
+  // A PTIFF of 100000 x 50000 pixels of four Float32 bands, 8 * 10^10 bytes
+  // in tiles of 1024 x 1024 stored in raster order after a 4096 byte header.
+  // Only the offsets are computed, no file is opened.
+  sptw::PTIFF ptiff = sptw::PTIFF();
+  ptiff.x_size = 100000;
+  ptiff.y_size = 50000;
+  ptiff.band_count = 4;
+  ptiff.band_type = GDT_Float32;
+  ptiff.band_type_size = 4;
+  ptiff.block_x_size = ptiff.block_y_size = 1024;
+  ptiff.tiles_across = 98;
+  ptiff.tiles_down = 49;
+  vector<int64_t> tile_offsets(98 * 49);
+  for (size_t i = 0; i < tile_offsets.size(); ++i) {
+    tile_offsets[i] = 4096 + static_cast<int64_t>(i) * 1024 * 1024 * 16;
+  }
+  ptiff.tile_offsets = &tile_offsets[0];
+
+  // The last pixel is (671, 847) of tile 48 * 98 + 97
+  ASSERT_EQ(80561306096LL, sptw::calculate_file_offset(&ptiff, 99999, 49999));
+  RasterChunk chunk;
+  chunk.raster_location_ = Coordinate(99000, 49000, librasterblaster::UNDEF);
+  ASSERT_EQ(80561306096LL, sptw::chunk_to_file_offset(&ptiff, &chunk, 999,
+                                                      999));
+
+  // A single tile of 32768 x 32768 pixels, whose last pixel is 2^34 - 16
+  // bytes into the tile
+  ptiff.x_size = ptiff.y_size = 32768;
+  ptiff.block_x_size = ptiff.block_y_size = 32768;
+  ptiff.tiles_across = ptiff.tiles_down = 1;
+  ASSERT_EQ(17179873264LL, sptw::calculate_file_offset(&ptiff, 32767, 32767));
+}
+
+TEST(BlockResidency, CountsResidentPixels) {
+  BlockResidency residency(10, 10);
+  residency.first_block_x = residency.first_block_y = 1;
+  residency.blocks_across = residency.blocks_down = 2;
+  residency.resident.assign(4, false);
+  residency.resident[0] = residency.resident[3] = true;
+
+  ASSERT_TRUE(residency.IsResident(1, 1));
+  ASSERT_FALSE(residency.IsResident(2, 1));
+  ASSERT_FALSE(residency.IsResident(0, 0));
+  ASSERT_TRUE(residency.IsResident(2, 2));
+  ASSERT_EQ(200, residency.ResidentPixels(Area(5, 5, 29, 29)));
+  ASSERT_EQ(25 + 25, residency.ResidentPixels(Area(15, 15, 24, 24)));
+}
+
+TEST(BlockResidency, CoversKernelFootprints) {
+  // A 0.5 degree input and a 1 degree output, both geographic
+  const std::string srs = "+proj=longlat +datum=WGS84";
+  const Coordinate input_ul(-32.0, 32.0, librasterblaster::UNDEF);
+  const Coordinate output_ul(-20.0, 20.0, librasterblaster::UNDEF);
+  const Area output_area(8, 8, 23, 23);
+
+  BlockResidency residency(16, 16);
+  const Area minbox = librasterblaster::RasterMinbox2(srs, output_ul, 1.0,
+                                                      40, 40, srs, input_ul,
+                                                      0.5, 128, 128,
+                                                      output_area,
+                                                      &residency);
+  ASSERT_NE(-1.0, minbox.ul.x);
+  ASSERT_FALSE(residency.resident.empty());
+  ASSERT_GT(residency.ResidentPixels(minbox), 0);
+
+  RasterChunk source, destination;
+  InitTestChunk(&source, minbox.lr.y - minbox.ul.y + 1,
+                minbox.lr.x - minbox.ul.x + 1, 1, GDT_Byte);
+  source.raster_location_ = minbox.ul;
+  source.ul_projected_corner_ = Coordinate(input_ul.x + minbox.ul.x * 0.5,
+                                           input_ul.y - minbox.ul.y * 0.5,
+                                           librasterblaster::UNDEF);
+  source.pixel_size_ = 0.5;
+  InitTestChunk(&destination, 16, 16, 1, GDT_Byte);
+  destination.raster_location_ = output_area.ul;
+  destination.ul_projected_corner_ = Coordinate(-12.0, 12.0,
+                                                librasterblaster::UNDEF);
+
+  librasterblaster::RasterCoordTransformer rt(destination.projection_,
+                                              destination.ul_projected_corner_,
+                                              destination.pixel_size_,
+                                              destination.row_count_,
+                                              destination.column_count_,
+                                              source.projection_,
+                                              source.ul_projected_corner_,
+                                              source.pixel_size_);
+
+  // Every source pixel a kernel reads must lie in a resident block
+  int64_t footprint_count = 0;
+  for (int64_t y = 0; y < destination.row_count_; ++y) {
+    for (int64_t x = 0; x < destination.column_count_; ++x) {
+      Area footprint;
+      if (!librasterblaster::SourceFootprint(&rt, &source, x, y,
+                                             &footprint)) {
+        continue;
+      }
+      ++footprint_count;
+      for (int64_t sy = footprint.ul.y; sy <= footprint.lr.y; ++sy) {
+        for (int64_t sx = footprint.ul.x; sx <= footprint.lr.x; ++sx) {
+          ASSERT_TRUE(residency.IsResident((sx + minbox.ul.x) / 16,
+                                           (sy + minbox.ul.y) / 16));
+        }
+      }
+    }
+  }
+  ASSERT_EQ(destination.row_count_ * destination.column_count_,
+            footprint_count);
+}
+
+TEST(ReprojectChunk, CallerBuffersWithThreads) {
+  const std::string srs = "+proj=longlat +datum=WGS84";
+  const double input_transform[6] = { -30.0, 1.0, 0.0, 20.0, 0.0, -1.0 };
+  const double output_transform[6] = { -24.0, 1.5, 0.0, 15.0, 0.0, -1.5 };
+  vector<float> input(40 * 60);
+  for (size_t i = 0; i < input.size(); ++i) {
+    input[i] = static_cast<float>(i % 97);
+  }
+  vector<float> single(20 * 30), threaded(20 * 30);
+  vector<float> minimum(20 * 30), maximum(20 * 30);
+
+  RasterChunk *source = RasterChunk::CreateRasterChunk(&input[0], 40, 60, 1,
+                                                       GDT_Float32,
+                                                       input_transform, srs);
+  RasterChunk *out_single =
+      RasterChunk::CreateRasterChunk(&single[0], 20, 30, 1, GDT_Float32,
+                                     output_transform, srs);
+  RasterChunk *out_threaded =
+      RasterChunk::CreateRasterChunk(&threaded[0], 20, 30, 1, GDT_Float32,
+                                     output_transform, srs);
+  ASSERT_TRUE(source != NULL && out_single != NULL && out_threaded != NULL);
+  ASSERT_FALSE(source->owns_pixels_);
+  ASSERT_EQ(&input[0], source->pixels_);
+
+  ASSERT_TRUE(ReprojectChunk(source, out_single, "-1",
+                             librasterblaster::MEAN));
+  ASSERT_TRUE(ReprojectChunk(source, out_threaded, "-1",
+                             librasterblaster::MEAN, 4));
+  ASSERT_TRUE(single == threaded);
+  ASSERT_LT(std::count(single.begin(), single.end(), -1.0f),
+            static_cast<std::ptrdiff_t>(single.size()));
+
+  // The fused kernel splits its destinations the same way
+  RasterChunk *out_minimum =
+      RasterChunk::CreateRasterChunk(&minimum[0], 20, 30, 1, GDT_Float32,
+                                     output_transform, srs);
+  RasterChunk *out_maximum =
+      RasterChunk::CreateRasterChunk(&maximum[0], 20, 30, 1, GDT_Float32,
+                                     output_transform, srs);
+  vector<RasterChunk*> destinations;
+  destinations.push_back(out_minimum);
+  destinations.push_back(out_threaded);
+  destinations.push_back(out_maximum);
+  vector<librasterblaster::RESAMPLER> resamplers;
+  resamplers.push_back(librasterblaster::MIN);
+  resamplers.push_back(librasterblaster::MEAN);
+  resamplers.push_back(librasterblaster::MAX);
+  ASSERT_TRUE(librasterblaster::ReprojectChunkMulti(source, destinations,
+                                                    "-1", resamplers, 3));
+  ASSERT_TRUE(single == threaded);
+  for (size_t i = 0; i < single.size(); ++i) {
+    ASSERT_LE(minimum[i], single[i]);
+    ASSERT_GE(maximum[i], single[i]);
+  }
+
+  delete source;
+  delete out_single;
+  delete out_threaded;
+  delete out_minimum;
+  delete out_maximum;
+  // The caller still owns the buffers
+  ASSERT_EQ(5.0f, input[5]);
+
+  const double rotated[6] = { -30.0, 1.0, 0.5, 20.0, 0.0, -1.0 };
+  ASSERT_TRUE(RasterChunk::CreateRasterChunk(&input[0], 40, 60, 1,
+                                             GDT_Float32, rotated,
+                                             srs) == NULL);
+}
+
+TEST(Reprojector, MatchesReprojectChunk) {
+  const std::string srs = "+proj=longlat +datum=WGS84";
+  const double input_transform[6] = { -30.0, 1.0, 0.0, 20.0, 0.0, -1.0 };
+  const double output_transform[6] = { -24.0, 1.5, 0.0, 15.0, 0.0, -1.5 };
+  vector<float> input(40 * 60);
+  for (size_t i = 0; i < input.size(); ++i) {
+    input[i] = static_cast<float>(i % 97);
+  }
+  vector<float> expected(20 * 30), output(20 * 30, -2.0f);
+
+  RasterChunk *source = RasterChunk::CreateRasterChunk(&input[0], 40, 60, 1,
+                                                       GDT_Float32,
+                                                       input_transform, srs);
+  RasterChunk *reference =
+      RasterChunk::CreateRasterChunk(&expected[0], 20, 30, 1, GDT_Float32,
+                                     output_transform, srs);
+  RasterChunk *destination =
+      RasterChunk::CreateRasterChunk(&output[0], 20, 30, 1, GDT_Float32,
+                                     output_transform, srs);
+  ASSERT_TRUE(source != NULL && reference != NULL && destination != NULL);
+  ASSERT_TRUE(ReprojectChunk(source, reference, "-1",
+                             librasterblaster::MEAN));
+
+  Reprojector *reprojector = Reprojector::Create(source, destination,
+                                                 librasterblaster::MEAN,
+                                                 "-1", 3, 8);
+  ASSERT_TRUE(reprojector != NULL);
+  ASSERT_EQ(20, reprojector->row_count());
+
+  // Repeated windows reuse the cached minboxes and transformers
+  for (int pass = 0; pass < 2; ++pass) {
+    RasterChunk *window = reprojector->Reproject(Area(5, 3, 17, 12));
+    ASSERT_TRUE(window != NULL);
+    ASSERT_EQ(&output[3 * 30 + 5], window->pixels_);
+    delete window;
+    for (int y = 3; y <= 12; ++y) {
+      for (int x = 5; x <= 17; ++x) {
+        ASSERT_EQ(expected[y * 30 + x], output[y * 30 + x]);
+      }
+    }
+  }
+  ASSERT_EQ(-2.0f, output[0]);
+
+  ASSERT_TRUE(reprojector->Reproject());
+  ASSERT_TRUE(expected == output);
+  ASSERT_TRUE(reprojector->Reproject(Area(25, 0, 30, 4)) == NULL);
+
+  delete reprojector;
+  delete source;
+  delete reference;
+  delete destination;
+}
@@ -24,6 +24,11 @@
 using std::string;
 
 int rastercompare(string control_filename, string test_filename) {
+  return rastercompare(control_filename, test_filename, 0.0, 0.0);
+}
+
+int rastercompare(string control_filename, string test_filename,
+                  double control_fill, double test_fill) {
   const double delta = 0.001;
   GDALAllRegister();
 
@@ -115,7 +120,9 @@ int rastercompare(string control_filename, string test_filename) {
                test_pixels,
                x_size * sizeof(*control_pixels)) != 0) {
       for (int x = 0; x < x_size; ++x) {
-        if (fabs(control_pixels[x] - test_pixels[x]) > delta) {
+        const bool fill = test_pixels[x] == test_fill
+            && control_pixels[x] == control_fill;
+        if (!fill && fabs(control_pixels[x] - test_pixels[x]) > delta) {
           printf("Values at (%d, %d) are too different! %f vs %f\n",
                  x, y, control_pixels[x], test_pixels[x]);
           bad_pixels++;
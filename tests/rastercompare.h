@@ -28,3 +28,16 @@
  */
 int rastercompare(std::string golden_filename, std::string test_filename);
 
+/**
+ * @brief rastercompare compares two rasters like the function above, except a
+ * test pixel holding test_fill matches a control pixel holding control_fill.
+ * This compares a raster written with a different fill value to a golden.
+ *
+ * @param control_fill fill value of control_filename
+ *
+ * @param test_fill fill value of test_filename
+ *
+ */
+int rastercompare(std::string golden_filename, std::string test_filename,
+                  double control_fill, double test_fill);
+
@@ -15,9 +15,13 @@
  *
  */
 
+#include <algorithm>
+#include <cstdio>
+#include <string>
 #include <vector>
 
 #include <mpi.h>
+#include <tiffio.h>
 #include <unistd.h>
 
 #include "gtest/gtest.h"
@@ -37,47 +41,369 @@ using librasterblaster::PRB_NOERROR;
 #define STR(tok) STR_EXPAND(tok)
 
 namespace {
-TEST(SystemTest, GLOBALVEG) {
-  const int gold_count = 12;
-  const std::string golden_rasters[] = { "aea", "cea", "eck4", "eck6", "gall",
-                                         "gnom", "laea", "merc", "mill",
-                                         "moll", "sinu", "vandg"};
+const std::string kTestData = STR(__PRB_SRC_DIR__) "/tests/testdata/";
+
+// Returns the configuration the goldens were made with, minus the filenames
+// and output projection
+Configuration GlobalVegConfiguration() {
   Configuration conf;
+  conf.input_filename = kTestData + "veg.tif";
+  conf.resampler = librasterblaster::MIN;
+  conf.tile_size = 16;
+  conf.partition_size = 1;
+  return conf;
+}
+
+// Reprojects veg.tif with conf to the projection of the veg_<projection>.tif
+// golden and writes the result to test_name
+int ReprojectVeg(Configuration conf,
+                 const std::string &projection,
+                 const std::string &test_name) {
+  const std::string gold_name = kTestData + "veg_" + projection + ".tif";
 
   GDALAllRegister();
+  // Open golden raster to extract metadata
+  GDALDataset *golden = static_cast<GDALDataset*>(GDALOpen(gold_name.c_str(),
+                                                           GA_ReadOnly));
+  if (golden == NULL) {
+    fprintf(stderr, "Failed to open golden raster: %s\n", gold_name.c_str());
+    return librasterblaster::PRB_IOERROR;
+  }
+  conf.output_filename = test_name;
+  conf.output_srs = golden->GetProjectionRef();
+  GDALClose(golden);
 
-  for (unsigned int i = 0; i < gold_count; ++i) {
-    const std::string gold_name = STR(__PRB_SRC_DIR__) "/tests/testdata/veg_" + golden_rasters[i] + ".tif";
-    const std::string test_name = STR(__PRB_SRC_DIR__) "/tests/testdata/veg_test_" + golden_rasters[i] + ".tif";
+  return prasterblasterpio(conf);
+}
 
-    // Open golden raster to extract metadata
-    GDALDataset *golden = static_cast<GDALDataset*>(GDALOpen(gold_name.c_str(),
-                                                             GA_ReadOnly));
+// Counts the tiles of the first image of filename that were never allocated,
+// or returns -1 if the tile offsets can not be read
+int64_t UnallocatedTiles(const std::string &filename) {
+  TIFF *tiff = TIFFOpen(filename.c_str(), "r");
+  if (tiff == NULL) {
+    return -1;
+  }
+  int64_t count = -1;
+  uint64_t *offsets = NULL;
+  if (TIFFGetField(tiff, TIFFTAG_TILEOFFSETS, &offsets) == 1) {
+    count = 0;
+    for (uint32_t i = 0; i < TIFFNumberOfTiles(tiff); ++i) {
+      count += offsets[i] == 0 ? 1 : 0;
+    }
+  }
+  TIFFClose(tiff);
+  return count;
+}
 
-    if (golden == NULL) {
-      ADD_FAILURE() << "Failed to open golden raster: " + gold_name;
+// Counts the tiles of the first image of filename that do not start on a
+// multiple of alignment, or returns -1 if the tile offsets can not be read
+int64_t MisalignedTiles(const std::string &filename, int64_t alignment) {
+  TIFF *tiff = TIFFOpen(filename.c_str(), "r");
+  if (tiff == NULL) {
+    return -1;
+  }
+  int64_t count = -1;
+  uint64_t *offsets = NULL;
+  if (TIFFGetField(tiff, TIFFTAG_TILEOFFSETS, &offsets) == 1) {
+    count = 0;
+    for (uint32_t i = 0; i < TIFFNumberOfTiles(tiff); ++i) {
+      count += offsets[i] % alignment != 0 ? 1 : 0;
     }
-    ASSERT_TRUE(golden != NULL);
+  }
+  TIFFClose(tiff);
+  return count;
+}
 
-    conf.input_filename = STR(__PRB_SRC_DIR__) "/tests/testdata/veg.tif";
-    conf.output_filename = test_name;
-    conf.resampler = librasterblaster::MIN;
-    conf.output_srs = golden->GetProjectionRef();
-    conf.tile_size = 16;
-    conf.partition_size = 1;
+// Checks the overviews of band 1 of filename, a Byte raster with fill value
+// 0. Each overview has to halve the level before it, rounding up, and hold
+// the smallest of the up to 2 by 2 pixels of that level that are not fill.
+// Returns the number of overviews, or -1 if the raster can not be read, and
+// counts the overviews of the wrong size and the wrong overview pixels.
+int CheckMinOverviews(const std::string &filename,
+                      int64_t *bad_sizes,
+                      int64_t *bad_pixels) {
+  GDALAllRegister();
+  GDALDataset *ds = static_cast<GDALDataset*>(GDALOpen(filename.c_str(),
+                                                       GA_ReadOnly));
+  if (ds == NULL) {
+    return -1;
+  }
+  GDALRasterBand *band = ds->GetRasterBand(1);
+  const int overview_count = band->GetOverviewCount();
+  int columns = band->GetXSize();
+  int rows = band->GetYSize();
+  std::vector<unsigned char> level(static_cast<size_t>(columns) * rows);
+  if (band->RasterIO(GF_Read, 0, 0, columns, rows, &level[0], columns, rows,
+                     GDT_Byte, 0, 0) != CE_None) {
+    GDALClose(ds);
+    return -1;
+  }
 
-    GDALClose(golden);
+  for (int i = 0; i < overview_count; ++i) {
+    GDALRasterBand *overview = band->GetOverview(i);
+    const int overview_columns = (columns + 1) / 2;
+    const int overview_rows = (rows + 1) / 2;
+    if (overview == NULL
+        || overview->GetXSize() != overview_columns
+        || overview->GetYSize() != overview_rows) {
+      ++*bad_sizes;
+      break;
+    }
+    std::vector<unsigned char> pixels(static_cast<size_t>(overview_columns)
+                                      * overview_rows);
+    if (overview->RasterIO(GF_Read, 0, 0, overview_columns, overview_rows,
+                           &pixels[0], overview_columns, overview_rows,
+                           GDT_Byte, 0, 0) != CE_None) {
+      GDALClose(ds);
+      return -1;
+    }
+    for (int y = 0; y < overview_rows; ++y) {
+      for (int x = 0; x < overview_columns; ++x) {
+        unsigned char expected = 0;
+        for (int dy = 0; dy < 2 && 2 * y + dy < rows; ++dy) {
+          for (int dx = 0; dx < 2 && 2 * x + dx < columns; ++dx) {
+            const unsigned char value = level[(2 * y + dy) * columns
+                                              + 2 * x + dx];
+            if (value != 0 && (expected == 0 || value < expected)) {
+              expected = value;
+            }
+          }
+        }
+        *bad_pixels += pixels[y * overview_columns + x] != expected ? 1 : 0;
+      }
+    }
+    level.swap(pixels);
+    columns = overview_columns;
+    rows = overview_rows;
+  }
+  GDALClose(ds);
+  return overview_count;
+}
 
-    int ret = prasterblasterpio(conf);
+// Checks the layout of the Cloud Optimized GeoTIFF filename, whose
+// directories run from the full resolution image to the smallest overview.
+// Returns the number of directories, or -1 if the file can not be read, and
+// counts the directories that are not in front of every tile and the images
+// whose tiles are not all in front of those of the next larger image.
+int CheckCogLayout(const std::string &filename,
+                   int64_t *late_directories,
+                   int64_t *misordered_images) {
+  TIFF *tiff = TIFFOpen(filename.c_str(), "r");
+  if (tiff == NULL) {
+    return -1;
+  }
+  std::vector<uint64_t> directory_offsets, first_tiles, last_tiles;
+  do {
+    uint64_t *offsets = NULL;
+    const uint32_t tile_count = TIFFNumberOfTiles(tiff);
+    if (TIFFGetField(tiff, TIFFTAG_TILEOFFSETS, &offsets) != 1
+        || tile_count == 0) {
+      TIFFClose(tiff);
+      return -1;
+    }
+    directory_offsets.push_back(TIFFCurrentDirOffset(tiff));
+    first_tiles.push_back(offsets[0]);
+    last_tiles.push_back(offsets[0]);
+    for (uint32_t i = 1; i < tile_count; ++i) {
+      first_tiles.back() = std::min(first_tiles.back(), offsets[i]);
+      last_tiles.back() = std::max(last_tiles.back(), offsets[i]);
+    }
+  } while (TIFFReadDirectory(tiff) == 1);
+  TIFFClose(tiff);
+
+  const uint64_t first_tile = *std::min_element(first_tiles.begin(),
+                                                first_tiles.end());
+  for (size_t i = 0; i < directory_offsets.size(); ++i) {
+    *late_directories += directory_offsets[i] >= first_tile ? 1 : 0;
+    if (i > 0) {
+      *misordered_images += last_tiles[i] >= first_tiles[i - 1] ? 1 : 0;
+    }
+  }
+  return static_cast<int>(directory_offsets.size());
+}
+
+// Reprojects veg.tif to every golden projection with conf and compares the
+// results to the goldens. The first process compares and removes each
+// output, the others wait for the result before starting the next one.
+void ReprojectGlobalVeg(const Configuration &conf) {
+  int rank = 0;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  const int gold_count = 12;
+  const std::string golden_rasters[] = { "aea", "cea", "eck4", "eck6", "gall",
+                                         "gnom", "laea", "merc", "mill",
+                                         "moll", "sinu", "vandg"};
+
+  for (unsigned int i = 0; i < gold_count; ++i) {
+#if GDAL_VERSION_MAJOR >= 3
+    // The gnom golden was made with GDAL 2 and PROJ 4. With GDAL 3, and the
+    // PROJ 6 or later it requires, the corners of the whole globe fall
+    // outside of the gnomonic projection domain and the output extent is
+    // not finite, so the case can not run.
+    if (golden_rasters[i] == "gnom") {
+      printf("Skipping veg_gnom: needs GDAL 2 and PROJ 4\n");
+      continue;
+    }
+#endif
+    const std::string gold_name = kTestData + "veg_" + golden_rasters[i]
+        + ".tif";
+    const std::string test_name = kTestData + "veg_test_" + golden_rasters[i]
+        + ".tif";
+
+    int ret = ReprojectVeg(conf, golden_rasters[i], test_name);
     ASSERT_EQ(PRB_NOERROR, ret);
 
-    int raster_compare_ret = rastercompare(gold_name, test_name);
+    int raster_compare_ret = 0;
+    if (rank == 0) {
+      raster_compare_ret = rastercompare(gold_name, test_name);
+      if (raster_compare_ret == 0 && conf.tile_alignment > 0
+          && MisalignedTiles(test_name, conf.tile_alignment) != 0) {
+        printf("Tiles of %s are not aligned\n", test_name.c_str());
+        raster_compare_ret = 1;
+      }
+      if (raster_compare_ret == 0) {
+        unlink(test_name.c_str());
+      }
+    }
+    MPI_Bcast(&raster_compare_ret, 1, MPI_INT, 0, MPI_COMM_WORLD);
 
     ASSERT_EQ(0, raster_compare_ret);
-    unlink(test_name.c_str());
   }
+}
+
+// Reprojects veg.tif to every golden projection with the given output
+// compression
+void ReprojectGlobalVeg(const std::string &compression) {
+  Configuration conf = GlobalVegConfiguration();
+  conf.compression = compression;
+  ReprojectGlobalVeg(conf);
+}
+
+TEST(SystemTest, GLOBALVEG) {
+  ReprojectGlobalVeg("NONE");
+  SUCCEED();
+}
+
+TEST(SystemTest, GLOBALVEGDeflate) {
+  ReprojectGlobalVeg("DEFLATE");
+  SUCCEED();
+}
+
+TEST(SystemTest, GLOBALVEGLZW) {
+  ReprojectGlobalVeg("LZW");
+  SUCCEED();
+}
+
+#ifdef PRB_HAVE_ZSTD
+TEST(SystemTest, GLOBALVEGZSTD) {
+  ReprojectGlobalVeg("ZSTD");
+  SUCCEED();
+}
+#endif
+
+// The goldens have 192 to 324 partitions of one tile, the partition size
+// the goldens depend on. Run with a process count that does not divide some
+// of those counts, such as 2, 3 or 4, some processes have fewer partitions
+// than others and take part in the last collective writes with nothing to
+// write.
+TEST(SystemTest, GLOBALVEGCollective) {
+  Configuration conf = GlobalVegConfiguration();
+  conf.collective_write = true;
+  ReprojectGlobalVeg(conf);
+  SUCCEED();
+}
+
+// Each partition is written while the next one is computed
+TEST(SystemTest, GLOBALVEGAsync) {
+  Configuration conf = GlobalVegConfiguration();
+  conf.async_write = true;
+  ReprojectGlobalVeg(conf);
   SUCCEED();
 }
+
+// Tiles start on 4 KiB boundaries and the tiles of each process are stored
+// together
+TEST(SystemTest, GLOBALVEGAlignedRankLayout) {
+  Configuration conf = GlobalVegConfiguration();
+  conf.tile_alignment = 4096;
+  conf.rank_layout = true;
+  ReprojectGlobalVeg(conf);
+  SUCCEED();
+}
+
+TEST(SystemTest, GLOBALVEGCog) {
+  Configuration conf = GlobalVegConfiguration();
+  conf.cog = true;
+  ReprojectGlobalVeg(conf);
+  SUCCEED();
+}
+
+// The overviews of a Cloud Optimized GeoTIFF have to be found by GDAL, hold
+// the MIN of the level above them and be laid out with every directory in
+// front of the tiles and the tiles of the smallest overview first
+TEST(SystemTest, GLOBALVEGCogOverviews) {
+  int rank = 0;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  const std::string test_name = kTestData + "veg_test_moll.tif";
+  Configuration conf = GlobalVegConfiguration();
+  conf.cog = true;
+
+  ASSERT_EQ(PRB_NOERROR, ReprojectVeg(conf, "moll", test_name));
+
+  // overview count, overviews of the wrong size, wrong overview pixels,
+  // directory count, late directories and misordered images
+  int64_t results[6] = { 0, 0, 0, 0, 0, 0 };
+  if (rank == 0) {
+    results[0] = CheckMinOverviews(test_name, &results[1], &results[2]);
+    results[3] = CheckCogLayout(test_name, &results[4], &results[5]);
+    unlink(test_name.c_str());
+  }
+  MPI_Bcast(results, 6, MPI_INT64_T, 0, MPI_COMM_WORLD);
+
+  // 360 by 180 pixels halve to 12 by 6, a single tile, in 5 levels
+  EXPECT_EQ(5, results[0]);
+  EXPECT_EQ(0, results[1]);
+  EXPECT_EQ(0, results[2]);
+  EXPECT_EQ(6, results[3]);
+  EXPECT_EQ(0, results[4]);
+  EXPECT_EQ(0, results[5]);
+}
+
+// Sparse output with a fill value other than 0 has to read back like dense
+// output, the skipped tiles read as the fill value through the nodata tag
+TEST(SystemTest, GLOBALVEGSparse) {
+  int rank = 0;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  const std::string projections[] = { "moll", "sinu" };
+
+  for (unsigned int i = 0; i < 2; ++i) {
+    const std::string gold_name = kTestData + "veg_" + projections[i] + ".tif";
+    const std::string dense_name = kTestData + "veg_test_" + projections[i]
+        + "_dense.tif";
+    const std::string test_name = kTestData + "veg_test_" + projections[i]
+        + ".tif";
+    Configuration conf = GlobalVegConfiguration();
+    conf.fillvalue = "255";
+
+    ASSERT_EQ(PRB_NOERROR, ReprojectVeg(conf, projections[i], dense_name));
+    conf.sparse = true;
+    ASSERT_EQ(PRB_NOERROR, ReprojectVeg(conf, projections[i], test_name));
+
+    // The goldens were made with a fill value of 0
+    int64_t results[3] = { 0, 0, 0 };
+    if (rank == 0) {
+      results[0] = UnallocatedTiles(test_name);
+      results[1] = rastercompare(gold_name, test_name, 0.0, 255.0);
+      results[2] = rastercompare(dense_name, test_name);
+      unlink(dense_name.c_str());
+      unlink(test_name.c_str());
+    }
+    MPI_Bcast(results, 3, MPI_INT64_T, 0, MPI_COMM_WORLD);
+
+    EXPECT_LT(0, results[0]);
+    ASSERT_EQ(0, results[1]);
+    ASSERT_EQ(0, results[2]);
+  }
+}
 }  // namespace
 
 int main(int argc, char *argv[]) {